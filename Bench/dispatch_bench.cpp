@@ -0,0 +1,249 @@
+/********************************************************************
+@FileName:dispatch_bench.cpp
+@Version: 1.0
+@Notes:   连接热/冷数据拆分的压测：模拟事件循环分发一个可读事件时对连接的访问，比较两种内存布局。
+          · before：拆分前的http_conn（2640字节一个，按fd连续存放），分发用到的字段分散在对象的几个缓存行里：
+                    定时器和sockfd在第0行，read_idx/checked_index在第1行，check_state在968字节处，idle_since在对象末尾
+          · after： 连接表中的conn_state（128字节，两个缓存行，按fd连续存放）
+          每个事件随机挑一个连接：读sockfd、read_idx、checked_index、check_state，清idle_since，刷新时间轮上的定时器
+          （真实的timer_wheel，刷新时还会改到同一个槽里相邻节点的指针），再把连接放进一个环形队列（相当于交给线程池）。
+          连接数越多，before布局越装不进缓存和TLB。能打开硬件性能计数器（perf_event_open）时同时输出
+          每个事件的cache-misses、L1D读缺失和dTLB读缺失，虚拟机或容器里没有硬件计数器时输出n/a。
+          用法：./dispatch_bench [事件数，默认4000000] [连接数...，默认1000 10000 50000]
+          编译：make bench
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/04 16:12:08
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include<new>
+#include<sys/mman.h>
+#include<sys/ioctl.h>
+#include<sys/syscall.h>
+#include<linux/perf_event.h>
+#include"../Code/Http/http_conn.h"
+
+//拆分前http_conn的大小和分发用到的字段的偏移（x86_64，g++ -O2）
+static const size_t OLD_SIZE = 2640;
+static const size_t OLD_TIMER = 24;
+static const size_t OLD_SOCKFD = 56;
+static const size_t OLD_READ_IDX = 104;
+static const size_t OLD_CHECKED_INDEX = 108;
+static const size_t OLD_CHECK_STATE = 968;
+static const size_t OLD_IDLE_SINCE = 2632;
+
+static const int HEADER_TIMEOUT_MS = 15000;
+static const int IDLE_TIMEOUT_MS = 60000;
+static const int QUEUE_SIZE = 1024;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void on_timeout(timer_node* /*node*/, void* /*arg*/)
+{
+}
+
+static volatile long sink;  //防止分发时读的字段被优化掉
+
+//一组硬件性能计数器，打不开的计数器读出-1
+class perf_counters{
+public:
+    static const int NUM = 3;
+
+    perf_counters(){
+        const unsigned long long l1d = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const unsigned long long dtlb = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        m_fd[0] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        m_fd[1] = open(PERF_TYPE_HW_CACHE, l1d);
+        m_fd[2] = open(PERF_TYPE_HW_CACHE, dtlb);
+    }
+    ~perf_counters(){
+        for(int i = 0; i < NUM; i++){
+            if(m_fd[i] >= 0){
+                close(m_fd[i]);
+            }
+        }
+    }
+    void start(){
+        for(int i = 0; i < NUM; i++){
+            if(m_fd[i] >= 0){
+                ioctl(m_fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(m_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+    void stop(long long* values){
+        for(int i = 0; i < NUM; i++){
+            values[i] = -1;
+            if(m_fd[i] >= 0){
+                ioctl(m_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+                if(::read(m_fd[i], &values[i], sizeof(values[i])) != sizeof(values[i])){
+                    values[i] = -1;
+                }
+            }
+        }
+    }
+
+private:
+    static int open(unsigned type, unsigned long long config){
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    int m_fd[NUM];
+};
+
+//拆分前的布局：按偏移访问2640字节的对象
+struct old_layout{
+    char* base;
+    int n;
+    explicit old_layout(int num):n(num){
+        base = (char*)mmap(NULL, n * OLD_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        for(int fd = 0; fd < n; fd++){
+            new(timer(fd)) timer_node();
+            field<int>(fd, OLD_SOCKFD) = fd;
+            field<int>(fd, OLD_READ_IDX) = 0;
+            field<int>(fd, OLD_CHECKED_INDEX) = 0;
+            field<int>(fd, OLD_CHECK_STATE) = 0;
+            field<uint64_t>(fd, OLD_IDLE_SINCE) = 0;
+        }
+    }
+    ~old_layout(){ munmap(base, n * OLD_SIZE); }
+    template<class T> T& field(int fd, size_t off) { return *(T*)(base + fd * OLD_SIZE + off); }
+    timer_node* timer(int fd) { return (timer_node*)(base + fd * OLD_SIZE + OLD_TIMER); }
+    void* conn(int fd) { return base + fd * OLD_SIZE; }
+
+    //和拆分前eventloop分发可读事件时一样的访问
+    int dispatch(int fd, timer_wheel& wheel, void** queue, int& tail){
+        int sum = field<int>(fd, OLD_SOCKFD) + field<int>(fd, OLD_CHECKED_INDEX) + field<int>(fd, OLD_CHECK_STATE);
+        if(field<int>(fd, OLD_READ_IDX) == 0){
+            field<uint64_t>(fd, OLD_IDLE_SINCE) = 0;
+            wheel.refresh(timer(fd), HEADER_TIMEOUT_MS);
+        }else{
+            wheel.refresh(timer(fd), IDLE_TIMEOUT_MS);
+        }
+        queue[tail++ & (QUEUE_SIZE - 1)] = conn(fd);
+        return sum;
+    }
+};
+
+//拆分后的布局：连接表中的conn_state
+struct new_layout{
+    conn_state* states;
+    int n;
+    explicit new_layout(int num):n(num){
+        states = (conn_state*)mmap(NULL, n * sizeof(conn_state), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        for(int fd = 0; fd < n; fd++){
+            new(&states[fd]) conn_state();
+            states[fd].sockfd = fd;
+        }
+    }
+    ~new_layout(){ munmap(states, n * sizeof(conn_state)); }
+    timer_node* timer(int fd) { return &states[fd].timer; }
+
+    int dispatch(int fd, timer_wheel& wheel, void** queue, int& tail){
+        conn_state* state = &states[fd];
+        int sum = state->sockfd + state->checked_index + state->check_state;
+        if(!state->request_started()){
+            state->clear_idle();
+            wheel.refresh(&state->timer, HEADER_TIMEOUT_MS);
+        }else{
+            wheel.refresh(&state->timer, IDLE_TIMEOUT_MS);
+        }
+        queue[tail++ & (QUEUE_SIZE - 1)] = state->conn;
+        return sum;
+    }
+};
+
+template<class LAYOUT>
+static void run(const char* name, int n, const int* fds, int events)
+{
+    LAYOUT layout(n);
+    timer_wheel wheel(100, on_timeout, NULL);
+    for(int fd = 0; fd < n; fd++){
+        wheel.add(layout.timer(fd), IDLE_TIMEOUT_MS);
+    }
+    void* queue[QUEUE_SIZE];
+    int tail = 0;
+    long sum = 0;
+
+    //先跑一遍把页面都分配好
+    for(int i = 0; i < events / 4; i++){
+        sum += layout.dispatch(fds[i], wheel, queue, tail);
+    }
+
+    perf_counters counters;
+    long long values[perf_counters::NUM];
+    counters.start();
+    double t0 = now_sec();
+    for(int i = 0; i < events; i++){
+        sum += layout.dispatch(fds[i], wheel, queue, tail);
+    }
+    double sec = now_sec() - t0;
+    counters.stop(values);
+
+    printf("%7d %-7s %9.1f", n, name, sec * 1e9 / events);
+    for(int i = 0; i < perf_counters::NUM; i++){
+        if(values[i] < 0){
+            printf(" %10s", "n/a");
+        }else{
+            printf(" %10.3f", (double)values[i] / events);
+        }
+    }
+    printf("\n");
+    sink = sum;
+}
+
+int main(int argc, char* argv[])
+{
+    int events = argc > 1 ? atoi(argv[1]) : 4000000;
+    if(events <= 0){
+        printf("usage: %s [events] [conns...]\n", argv[0]);
+        return 1;
+    }
+    int default_conns[] = {1000, 10000, 50000};
+    int* conns = default_conns;
+    int conn_num = 3;
+    if(argc > 2){
+        conns = new int[argc - 2];
+        conn_num = argc - 2;
+        for(int i = 2; i < argc; i++){
+            conns[i - 2] = atoi(argv[i]);
+        }
+    }
+
+    printf("%d events per run, conn_state %zu bytes, old http_conn %zu bytes\n", events, sizeof(conn_state), OLD_SIZE);
+    printf("%7s %-7s %9s %10s %10s %10s\n", "conns", "layout", "ns/event", "miss/ev", "L1D/ev", "dTLB/ev");
+    int* fds = new int[events];
+    for(int c = 0; c < conn_num; c++){
+        int n = conns[c];
+        if(n <= 0){
+            continue;
+        }
+        srand(n);
+        for(int i = 0; i < events; i++){
+            fds[i] = rand() % n;
+        }
+        run<old_layout>("before", n, fds, events);
+        run<new_layout>("after", n, fds, events);
+    }
+    delete [] fds;
+    if(conns != default_conns){
+        delete [] conns;
+    }
+    return 0;
+}
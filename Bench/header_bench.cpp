@@ -0,0 +1,161 @@
+/********************************************************************
+@FileName:header_bench.cpp
+@Version: 1.0
+@Notes:   请求头识别压测：逐个strncasecmp（原来prase_request_head的做法）对比编译期完美哈希（lookup_header）。
+          · chain3：原来只认Host/Connection/Content-Length的三个strncasecmp
+          · chain9：同样的写法加上条件GET、Range、Accept-Encoding、Cookie共9个已知请求头
+          · phash：lookup_header，一次哈希加最多一次比较（计时包括strchr找':'，服务器中这一步已经由scan_char做了）
+          输入是常见浏览器请求中的请求头名字（大部分不是已知请求头），另外先核对两种做法对大小写变化、
+          只差一个字符的名字、'-'换成其他字符等情况的结果一致。
+          用法：./header_bench [轮数，默认2000000]
+          编译：make bench
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/30 15:20:44
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<strings.h>
+#include<ctype.h>
+#include<time.h>
+#include"../Code/Http/http_header.h"
+
+//Chrome、Firefox、Safari、curl请求中出现的请求头名字，后面跟着':'，与读缓冲区中的样子相同
+static const char* LINES[] = {
+    "Host: 192.168.1.1:10000",
+    "Connection: keep-alive",
+    "Cache-Control: max-age=0",
+    "sec-ch-ua: \"Chromium\";v=\"104\"",
+    "sec-ch-ua-mobile: ?0",
+    "sec-ch-ua-platform: \"Windows\"",
+    "Upgrade-Insecure-Requests: 1",
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64)",
+    "Accept: text/html,application/xhtml+xml",
+    "Sec-Fetch-Site: none",
+    "Sec-Fetch-Mode: navigate",
+    "Sec-Fetch-User: ?1",
+    "Sec-Fetch-Dest: document",
+    "Accept-Encoding: gzip, deflate, br",
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8",
+    "Cookie: session=0123456789abcdef",
+    "If-None-Match: \"62b6c0af-2a3\"",
+    "If-Modified-Since: Sat, 25 Jun 2022 08:12:31 GMT",
+    "Referer: http://192.168.1.1:10000/index.html",
+    "Range: bytes=0-1023",
+};
+static const int LINE_NUM = sizeof(LINES) / sizeof(LINES[0]);
+
+struct chain_entry{
+    const char* prefix;     //带':'
+    int len;
+    HEADER_ID id;
+};
+
+static const chain_entry CHAIN[] = {
+    {"Connection:", 11, HDR_CONNECTION},
+    {"Content-Length:", 15, HDR_CONTENT_LENGTH},
+    {"Host:", 5, HDR_HOST},
+    {"If-None-Match:", 14, HDR_IF_NONE_MATCH},
+    {"If-Modified-Since:", 18, HDR_IF_MODIFIED_SINCE},
+    {"If-Range:", 9, HDR_IF_RANGE},
+    {"Range:", 6, HDR_RANGE},
+    {"Accept-Encoding:", 16, HDR_ACCEPT_ENCODING},
+    {"Cookie:", 7, HDR_COOKIE},
+};
+
+//原来的写法：依次strncasecmp，前n个
+static HEADER_ID lookup_chain(const char* line, int n)
+{
+    for(int i = 0; i < n; i++){
+        if(strncasecmp(line, CHAIN[i].prefix, CHAIN[i].len) == 0){
+            return CHAIN[i].id;
+        }
+    }
+    return HDR_UNKNOWN;
+}
+
+static HEADER_ID lookup_phash(const char* line)
+{
+    const char* colon = strchr(line, ':');
+    return lookup_header(line, colon - line);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//两种做法对各种变形的名字结果一致
+static bool verify()
+{
+    char buf[128];
+    for(int i = 0; i < LINE_NUM; i++){
+        const char* line = LINES[i];
+        int name_len = strchr(line, ':') - line;
+        for(int variant = 0; variant < 4 + name_len * 3; variant++){
+            strcpy(buf, line);
+            if(variant == 1){
+                for(int k = 0; k < name_len; k++) buf[k] = toupper(buf[k]);
+            }else if(variant == 2){
+                for(int k = 0; k < name_len; k++) buf[k] = tolower(buf[k]);
+            }else if(variant == 3){
+                buf[name_len - 1] = ':';    //名字少最后一个字符
+            }else if(variant >= 4){
+                //每个位置分别换成'-'、'\r'、和原字符只差0x20的非字母
+                int pos = (variant - 4) / 3;
+                const char repl[3] = {'-', '\r', (char)(buf[pos] ^ 0x20)};
+                char c = repl[(variant - 4) % 3];
+                if(isalpha((unsigned char)buf[pos]) && (c == (buf[pos] ^ 0x20))){
+                    c = '@';    //字母异或0x20只是换了大小写，换成别的
+                }
+                buf[pos] = c;
+            }
+            if(lookup_chain(buf, 9) != lookup_phash(buf)){
+                printf("mismatch: %s\n", buf);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000000;
+    if(rounds <= 0){
+        printf("usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+    if(!verify()){
+        return 1;
+    }
+
+    double total = (double)rounds * LINE_NUM;
+    printf("%d header lines per round, %d rounds\n", LINE_NUM, rounds);
+    printf("%-8s %10s %8s\n", "method", "ns/header", "known");
+
+    const char* names[] = {"chain3", "chain9", "phash"};
+    for(int m = 0; m < 3; m++){
+        long known = 0;
+        double t0 = now_sec();
+        for(int n = 0; n < rounds; n++){
+            for(int i = 0; i < LINE_NUM; i++){
+                HEADER_ID id;
+                if(m == 0){
+                    id = lookup_chain(LINES[i], 3);
+                }else if(m == 1){
+                    id = lookup_chain(LINES[i], 9);
+                }else{
+                    id = lookup_phash(LINES[i]);
+                }
+                known += id != HDR_UNKNOWN;
+            }
+        }
+        double sec = now_sec() - t0;
+        printf("%-8s %10.2f %8ld\n", names[m], sec * 1e9 / total, known / rounds);
+    }
+    return 0;
+}
@@ -0,0 +1,475 @@
+/********************************************************************
+@FileName:loadgen.cpp
+@Version: 1.0
+@Notes:   HTTP压测工具，代替webbench-1.5（每个客户端fork一个进程、每个请求新建一个TCP连接、只输出pages/min）。
+          · 多线程，每个线程一个epoll，管理自己的一批长连接（keep-alive）
+          · -P 流水线深度：每个连接最多同时有几个请求在路上
+          · -r 开环恒定速率：按计划时间发请求，延迟从“计划发出时间”算起，服务器卡住时排队的时间也算进去，
+            避免闭环压测的coordinated omission（服务器越慢、发得越少、测到的延迟反而越好看）
+          · 延迟记录在HDR风格的对数线性直方图中（相对误差<1%），输出p50/p90/p99/p999，结果为JSON
+          用法：./loadgen -p 端口 [-h 127.0.0.1] [-u /index.html] [-t 线程数] [-c 连接数] [-d 秒]
+                          [-P 流水线深度] [-r 每秒请求数，0为闭环]
+          编译：make bench
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/26 16:12:08
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+#include<strings.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<errno.h>
+#include<time.h>
+#include<pthread.h>
+#include<netinet/in.h>
+#include<netinet/tcp.h>
+#include<arpa/inet.h>
+#include<sys/socket.h>
+#include<sys/epoll.h>
+#include<string>
+#include<vector>
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//HDR风格直方图（微秒）：小于SUB的值每个值一格，之后每个2的幂区间再分SUB格，相对误差 < 1/SUB
+struct histogram{
+    static const int SUB_BITS = 7;
+    static const int SUB = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS) * SUB;
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+
+    histogram():total(0), min(UINT64_MAX), max(0), sum(0){
+        memset(counts, 0, sizeof(counts));
+    }
+
+    static int index(uint64_t v){
+        if(v < (uint64_t)SUB){
+            return v;
+        }
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - SUB_BITS;
+        return SUB + shift * SUB + (int)((v >> shift) - SUB);
+    }
+
+    //该格能代表的最大值（与HdrHistogram的highestEquivalentValue一致）
+    static uint64_t value_at(int idx){
+        if(idx < SUB){
+            return idx;
+        }
+        int shift = (idx - SUB) / SUB;
+        uint64_t sub = (idx - SUB) % SUB + SUB;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    void record(uint64_t v){
+        counts[index(v)]++;
+        total++;
+        sum += v;
+        if(v < min) min = v;
+        if(v > max) max = v;
+    }
+
+    void merge(const histogram& o){
+        for(int i = 0; i < BUCKETS; i++){
+            counts[i] += o.counts[i];
+        }
+        total += o.total;
+        sum += o.sum;
+        if(o.min < min) min = o.min;
+        if(o.max > max) max = o.max;
+    }
+
+    uint64_t percentile(double p) const{
+        if(total == 0){
+            return 0;
+        }
+        uint64_t target = (uint64_t)(p / 100.0 * total + 0.5);
+        if(target < 1) target = 1;
+        uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; i++){
+            seen += counts[i];
+            if(seen >= target){
+                uint64_t v = value_at(i);
+                return v > max ? max : v;
+            }
+        }
+        return max;
+    }
+};
+
+struct options{
+    const char* host;
+    int port;
+    const char* path;
+    int threads;
+    int conns;
+    int duration;
+    int depth;          //流水线深度
+    double rate;        //总请求速率，0为闭环
+};
+static options g_opt;
+static std::string g_request;
+static volatile bool g_stop = false;
+
+//一个连接
+struct conn{
+    int fd;
+    std::vector<uint64_t> inflight;     //已发出（或计划发出）还没收到响应的请求的起始时间，环形使用
+    size_t head, count;                 //inflight中最老的请求位置、个数
+    std::string out;                    //待发送的数据
+    size_t out_pos;
+    std::vector<char> in;               //收到还没解析完的数据
+    uint64_t next_send;                 //开环模式：下一个请求的计划发出时间
+    uint64_t interval;                  //开环模式：本连接两个请求之间的间隔
+    bool want_out;                      //是否注册了EPOLLOUT
+};
+
+//一个压测线程的统计
+struct worker_stat{
+    histogram hist;
+    uint64_t requests;
+    uint64_t errors;        //非2xx/3xx响应
+    uint64_t reconnects;    //服务器关闭连接，在路上的请求丢失
+    uint64_t lost;
+    uint64_t bytes;
+    worker_stat():requests(0), errors(0), reconnects(0), lost(0), bytes(0){}
+};
+
+struct worker_ctx{
+    int id;
+    int nconns;
+    worker_stat stat;
+    pthread_t tid;
+};
+
+static int open_conn(int epfd, conn* c){
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(fd < 0){
+        perror("socket");
+        exit(-1);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_opt.port);
+    inet_pton(AF_INET, g_opt.host, &addr.sin_addr);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS){
+        perror("connect");
+        exit(-1);
+    }
+    c->fd = fd;
+    c->head = 0;
+    c->count = 0;
+    c->out.clear();
+    c->out_pos = 0;
+    c->in.clear();
+    c->want_out = true;     //连接建立后可写，先发一批
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    return fd;
+}
+
+static void set_out(int epfd, conn* c, bool want){
+    if(c->want_out == want){
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (want ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->want_out = want;
+}
+
+//把out中的数据尽量写出去，失败返回false
+static bool flush_out(int epfd, conn* c){
+    while(c->out_pos < c->out.size()){
+        ssize_t n = send(c->fd, c->out.data() + c->out_pos, c->out.size() - c->out_pos, MSG_NOSIGNAL);
+        if(n < 0){
+            if(errno == EAGAIN){
+                set_out(epfd, c, true);
+                return true;
+            }
+            if(errno == EINTR){
+                continue;
+            }
+            return false;
+        }
+        c->out_pos += n;
+    }
+    c->out.clear();
+    c->out_pos = 0;
+    set_out(epfd, c, false);
+    return true;
+}
+
+/********************************************************************
+@FunName:static void fill(conn* c, uint64_t now)
+@Input:  c：连接
+         now：当前时间
+@Output: None
+@Retuval:None
+@Notes:  按模式补发请求。闭环：在路上的请求不足流水线深度就补；
+         开环：所有计划时间已到的请求都发（受流水线深度限制），起始时间记为计划时间而不是实际发出时间
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/26 16:40:21
+********************************************************************/
+static void fill(conn* c, uint64_t now){
+    while(c->count < (size_t)g_opt.depth){
+        uint64_t start = now;
+        if(g_opt.rate > 0){
+            if(c->next_send > now){
+                break;
+            }
+            start = c->next_send;
+            c->next_send += c->interval;
+        }
+        c->inflight[(c->head + c->count) % c->inflight.size()] = start;
+        c->count++;
+        c->out += g_request;
+    }
+}
+
+//解析响应，返回完整响应的个数，格式错误返回-1
+static int parse(conn* c, worker_stat& st, uint64_t now){
+    int done = 0;
+    size_t pos = 0;
+    while(true){
+        const char* base = c->in.data() + pos;
+        size_t left = c->in.size() - pos;
+        const char* end = (const char*)memmem(base, left, "\r\n\r\n", 4);
+        if(!end){
+            break;
+        }
+        size_t head_len = end + 4 - base;
+        long body = 0;
+        for(const char* p = base; p < end; ){
+            const char* eol = (const char*)memmem(p, end - p, "\r\n", 2);
+            if(!eol) eol = end;
+            if(eol - p > 15 && strncasecmp(p, "Content-Length:", 15) == 0){
+                body = atol(p + 15);
+            }
+            p = eol + 2;
+        }
+        if(left < head_len + body){
+            break;
+        }
+        if(left < 12 || strncmp(base, "HTTP/1.", 7) != 0){
+            return -1;
+        }
+        int status = atoi(base + 9);
+        if(status < 200 || status >= 400){
+            st.errors++;
+        }
+        if(c->count > 0){
+            uint64_t start = c->inflight[c->head];
+            c->head = (c->head + 1) % c->inflight.size();
+            c->count--;
+            st.hist.record((now - start) / 1000);
+        }
+        st.requests++;
+        st.bytes += head_len + body;
+        pos += head_len + body;
+        done++;
+    }
+    if(pos > 0){
+        c->in.erase(c->in.begin(), c->in.begin() + pos);
+    }
+    return done;
+}
+
+static void reconnect(int epfd, conn* c, worker_stat& st){
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    st.reconnects++;
+    st.lost += c->count;
+    open_conn(epfd, c);
+}
+
+static void* worker(void* arg){
+    worker_ctx* ctx = (worker_ctx*)arg;
+    worker_stat& st = ctx->stat;
+    int epfd = epoll_create1(0);
+    std::vector<conn> conns(ctx->nconns);
+    uint64_t start = now_ns();
+    for(int i = 0; i < ctx->nconns; i++){
+        conn* c = &conns[i];
+        c->inflight.resize(g_opt.depth + 1);
+        if(g_opt.rate > 0){
+            //每个连接分到 rate/总连接数 的速率，起始时间错开，避免所有连接同一时刻发
+            c->interval = (uint64_t)(1e9 * g_opt.conns / g_opt.rate);
+            c->next_send = start + c->interval * (ctx->id * ctx->nconns + i) / g_opt.conns;
+        }
+        open_conn(epfd, c);
+    }
+
+    const int MAX_EVENTS = 256;
+    struct epoll_event events[MAX_EVENTS];
+    char buf[65536];
+    while(!g_stop){
+        int timeout = 100;
+        if(g_opt.rate > 0){
+            //开环模式睡到最近的一个计划发送时间
+            uint64_t now = now_ns(), next = UINT64_MAX;
+            for(size_t i = 0; i < conns.size(); i++){
+                if(conns[i].count < (size_t)g_opt.depth && conns[i].next_send < next){
+                    next = conns[i].next_send;
+                }
+            }
+            timeout = next <= now ? 0 : (int)((next - now) / 1000000);
+            if(timeout > 100) timeout = 100;
+        }
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        uint64_t now = now_ns();
+        for(int i = 0; i < n; i++){
+            conn* c = (conn*)events[i].data.ptr;
+            if(events[i].events & (EPOLLERR | EPOLLHUP)){
+                reconnect(epfd, c, st);
+                continue;
+            }
+            if(events[i].events & EPOLLIN){
+                bool closed = false;
+                while(true){
+                    ssize_t r = recv(c->fd, buf, sizeof(buf), 0);
+                    if(r > 0){
+                        c->in.insert(c->in.end(), buf, buf + r);
+                        continue;
+                    }
+                    if(r == 0 || (errno != EAGAIN && errno != EINTR)){
+                        closed = true;
+                    }
+                    if(r < 0 && errno == EINTR){
+                        continue;
+                    }
+                    break;
+                }
+                if(parse(c, st, now) < 0){
+                    closed = true;
+                    st.errors++;
+                }
+                if(closed){
+                    reconnect(epfd, c, st);
+                    continue;
+                }
+            }
+            if(g_opt.rate == 0){
+                fill(c, now);
+            }
+            if(!c->out.empty() || (events[i].events & EPOLLOUT)){
+                if(!flush_out(epfd, c)){
+                    reconnect(epfd, c, st);
+                }
+            }
+        }
+        if(g_opt.rate > 0){
+            for(size_t i = 0; i < conns.size(); i++){
+                conn* c = &conns[i];
+                size_t before = c->out.size();
+                fill(c, now);
+                if(c->out.size() != before && !flush_out(epfd, c)){
+                    reconnect(epfd, c, st);
+                }
+            }
+        }
+    }
+    for(size_t i = 0; i < conns.size(); i++){
+        close(conns[i].fd);
+    }
+    close(epfd);
+    return NULL;
+}
+
+static void usage(const char* prog){
+    fprintf(stderr, "用法：%s -p port [-h host] [-u path] [-t threads] [-c connections] [-d seconds] [-P pipeline] [-r rate]\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+    g_opt.host = "127.0.0.1";
+    g_opt.port = 0;
+    g_opt.path = "/index.html";
+    g_opt.threads = 2;
+    g_opt.conns = 64;
+    g_opt.duration = 10;
+    g_opt.depth = 1;
+    g_opt.rate = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "h:p:u:t:c:d:P:r:")) != -1){
+        switch(opt){
+            case 'h': g_opt.host = optarg; break;
+            case 'p': g_opt.port = atoi(optarg); break;
+            case 'u': g_opt.path = optarg; break;
+            case 't': g_opt.threads = atoi(optarg); break;
+            case 'c': g_opt.conns = atoi(optarg); break;
+            case 'd': g_opt.duration = atoi(optarg); break;
+            case 'P': g_opt.depth = atoi(optarg); break;
+            case 'r': g_opt.rate = atof(optarg); break;
+            default: usage(argv[0]); return -1;
+        }
+    }
+    if(g_opt.port <= 0 || g_opt.threads <= 0 || g_opt.conns < g_opt.threads || g_opt.depth <= 0 || g_opt.duration <= 0){
+        usage(argv[0]);
+        return -1;
+    }
+    g_request = std::string("GET ") + g_opt.path + " HTTP/1.1\r\nHost: " + g_opt.host + "\r\nConnection: keep-alive\r\n\r\n";
+
+    std::vector<worker_ctx> workers(g_opt.threads);
+    for(int i = 0; i < g_opt.threads; i++){
+        workers[i].id = i;
+        workers[i].nconns = g_opt.conns / g_opt.threads + (i < g_opt.conns % g_opt.threads ? 1 : 0);
+    }
+    for(int i = 0; i < g_opt.threads; i++){
+        pthread_create(&workers[i].tid, NULL, worker, &workers[i]);
+    }
+    uint64_t start = now_ns();
+    sleep(g_opt.duration);
+    g_stop = true;
+    for(int i = 0; i < g_opt.threads; i++){
+        pthread_join(workers[i].tid, NULL);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    worker_stat total;
+    for(int i = 0; i < g_opt.threads; i++){
+        worker_stat& s = workers[i].stat;
+        total.hist.merge(s.hist);
+        total.requests += s.requests;
+        total.errors += s.errors;
+        total.reconnects += s.reconnects;
+        total.lost += s.lost;
+        total.bytes += s.bytes;
+    }
+    const histogram& h = total.hist;
+    printf("{\n");
+    printf("  \"url\": \"http://%s:%d%s\",\n", g_opt.host, g_opt.port, g_opt.path);
+    printf("  \"threads\": %d, \"connections\": %d, \"pipeline\": %d, \"target_rate\": %.0f,\n",
+           g_opt.threads, g_opt.conns, g_opt.depth, g_opt.rate);
+    printf("  \"duration_s\": %.3f,\n", elapsed);
+    printf("  \"requests\": %llu, \"errors\": %llu, \"reconnects\": %llu, \"lost\": %llu,\n",
+           (unsigned long long)total.requests, (unsigned long long)total.errors,
+           (unsigned long long)total.reconnects, (unsigned long long)total.lost);
+    printf("  \"rps\": %.1f, \"mbytes_per_s\": %.2f,\n", total.requests / elapsed, total.bytes / elapsed / 1e6);
+    printf("  \"latency_us\": {\"min\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}\n",
+           (unsigned long long)(h.total ? h.min : 0), h.total ? h.sum / h.total : 0.0,
+           (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(90),
+           (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9),
+           (unsigned long long)h.max);
+    printf("}\n");
+    return 0;
+}
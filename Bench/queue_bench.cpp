@@ -0,0 +1,160 @@
+/********************************************************************
+@FileName:queue_bench.cpp
+@Version: 1.0
+@Notes:   线程池请求队列压测：原来的list+互斥锁+信号量（block_queue）对比无锁队列（mpmc_queue+eventcount）。
+          生产者数 = 消费者数 = 1~64，每个生产者放入N个任务，统计每秒完成的入队+出队次数。
+          用法：./queue_bench [每个生产者的任务数，默认200000]
+          编译：make bench
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/15 10:05:31
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<sched.h>
+#include<pthread.h>
+#include<time.h>
+#include<atomic>
+#include"../Code/Pool/block_queue.h"
+#include"../Code/Pool/mpmc_queue.h"
+#include"../Code/Pool/locker.h"
+
+static const int QUEUE_SIZE = 10000;    //与线程池默认的max_requests一致
+static const int SPIN_COUNT = 200;      //与threadpool::SPIN_COUNT一致
+
+//无锁队列 + 先自旋再futex睡眠，与threadpool::append/take的做法相同
+struct lockfree_queue{
+    mpmc_queue<uintptr_t> q;
+    eventcount ec;
+    lockfree_queue():q(QUEUE_SIZE){}
+
+    bool push(uintptr_t v){
+        if(!q.push(v)){
+            return false;
+        }
+        ec.notify();
+        return true;
+    }
+    uintptr_t pop(){
+        uintptr_t v;
+        while(true){
+            for(int i = 0; i < SPIN_COUNT; i++){
+                if(q.pop(v)){
+                    return v;
+                }
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            unsigned key = ec.prepare_wait();
+            if(q.pop(v)){
+                ec.cancel_wait();
+                return v;
+            }
+            ec.wait(key);
+        }
+    }
+};
+
+//原来的队列
+struct locked_queue{
+    block_queue<uintptr_t> q;
+    locked_queue():q(QUEUE_SIZE){}
+    bool push(uintptr_t v){ return q.push(v); }
+    uintptr_t pop(){ return q.pop(); }
+};
+
+template<class Q>
+struct bench_ctx{
+    Q* queue;
+    long items;
+    std::atomic<uint64_t> sum;
+};
+
+template<class Q>
+void* producer(void* arg){
+    bench_ctx<Q>* ctx = (bench_ctx<Q>*)arg;
+    for(long i = 1; i <= ctx->items; i++){
+        while(!ctx->queue->push((uintptr_t)i)){
+            sched_yield();  //队列满，让一让
+        }
+    }
+    return NULL;
+}
+
+template<class Q>
+void* consumer(void* arg){
+    bench_ctx<Q>* ctx = (bench_ctx<Q>*)arg;
+    uint64_t sum = 0;
+    while(true){
+        uintptr_t v = ctx->queue->pop();
+        if(v == 0){     //0是结束标志
+            break;
+        }
+        sum += v;
+    }
+    ctx->sum.fetch_add(sum);
+    return NULL;
+}
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//返回每秒的任务数（一次入队+一次出队算一个）
+template<class Q>
+double run(int threads, long items){
+    Q queue;
+    bench_ctx<Q> ctx;
+    ctx.queue = &queue;
+    ctx.items = items;
+    ctx.sum = 0;
+
+    pthread_t* prod = new pthread_t[threads];
+    pthread_t* cons = new pthread_t[threads];
+    double start = now_sec();
+    for(int i = 0; i < threads; i++){
+        pthread_create(cons + i, NULL, consumer<Q>, &ctx);
+    }
+    for(int i = 0; i < threads; i++){
+        pthread_create(prod + i, NULL, producer<Q>, &ctx);
+    }
+    for(int i = 0; i < threads; i++){
+        pthread_join(prod[i], NULL);
+    }
+    for(int i = 0; i < threads; i++){
+        while(!queue.push(0)){
+            sched_yield();
+        }
+    }
+    for(int i = 0; i < threads; i++){
+        pthread_join(cons[i], NULL);
+    }
+    double elapsed = now_sec() - start;
+    delete [] prod;
+    delete [] cons;
+
+    uint64_t expect = (uint64_t)threads * items * (items + 1) / 2;
+    if(ctx.sum.load() != expect){
+        fprintf(stderr, "校验失败：sum=%llu expect=%llu\n", (unsigned long long)ctx.sum.load(), (unsigned long long)expect);
+        exit(-1);
+    }
+    return threads * items / elapsed;
+}
+
+int main(int argc, char* argv[])
+{
+    long items = argc > 1 ? atol(argv[1]) : 200000;
+    int threads[] = {1, 2, 4, 8, 16, 32, 64};
+
+    printf("%-8s %22s %22s %8s\n", "threads", "list+mutex+sem(Mops/s)", "mpmc+futex(Mops/s)", "speedup");
+    for(size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++){
+        double locked = run<locked_queue>(threads[i], items);
+        double lockfree = run<lockfree_queue>(threads[i], items);
+        printf("%-8d %22.2f %22.2f %7.2fx\n", threads[i], locked / 1e6, lockfree / 1e6, lockfree / locked);
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+/********************************************************************
+@FileName:response_bench.cpp
+@Version: 1.0
+@Notes:   响应头生成压测：原来的add_response（每行一次vsnprintf）对比预生成的响应头块（http_response.h）。
+          · printf：状态行、Content-Length、Content-Type、Connection、空行各一次vsnprintf（原来的200响应）
+          · block：状态行、Content-Type、Connection、空行是常量块memcpy，Content-Length用fast_utoa
+          · error：404响应，原来是上面五次vsnprintf再加响应体一次，现在是取一个常量（不拷贝）
+          另外先核对fast_utoa和snprintf的结果一致。
+          用法：./response_bench [轮数，默认5000000]
+          编译：make bench
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/04 11:02:37
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdarg.h>
+#include<time.h>
+#include"../Code/Http/http_response.h"
+
+struct out_buf{
+    char data[4096];
+    int len;
+};
+
+//原来add_response的写法
+static bool add_response(out_buf& b, const char* format, ...)
+{
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(b.data + b.len, sizeof(b.data) - b.len, format, arg_list);
+    va_end(arg_list);
+    if(len < 0 || len >= (int)sizeof(b.data) - b.len){
+        return false;
+    }
+    b.len += len;
+    return true;
+}
+
+static bool append(out_buf& b, const char* data, int len)
+{
+    if(len > (int)sizeof(b.data) - b.len){
+        return false;
+    }
+    memcpy(b.data + b.len, data, len);
+    b.len += len;
+    return true;
+}
+
+static bool append(out_buf& b, const header_block& block)
+{
+    return append(b, block.data, block.len);
+}
+
+static void build_printf(out_buf& b, int content_length, bool linger)
+{
+    b.len = 0;
+    add_response(b, "%s %d %s\r\n", "HTTP/1.1", 200, "OK");
+    add_response(b, "Content-Length: %d\r\n", content_length);
+    add_response(b, "Content-Type:%s\r\n", "text/html");
+    add_response(b, "Connection: %s\r\n", linger ? "keep-alive" : "close");
+    add_response(b, "%s", "\r\n");
+}
+
+static void build_block(out_buf& b, const mime_info* mime, int content_length, bool linger)
+{
+    b.len = 0;
+    append(b, status_line(200));
+    char line[48] = "Content-Length: ";
+    int len = 16;
+    len += fast_utoa(content_length, line + len);
+    line[len++] = '\r';
+    line[len++] = '\n';
+    append(b, line, len);
+    append(b, mime->header);
+    append(b, CONNECTION_HEADER[linger ? 1 : 0]);
+    append(b, BLANK_LINE);
+}
+
+static void build_error_printf(out_buf& b, bool linger)
+{
+    const char* form = "The requested file was not found on this server.\n";
+    b.len = 0;
+    add_response(b, "%s %d %s\r\n", "HTTP/1.1", 404, "Not Found");
+    add_response(b, "Content-Length: %d\r\n", (int)strlen(form));
+    add_response(b, "Content-Type:%s\r\n", "text/html");
+    add_response(b, "Connection: %s\r\n", linger ? "keep-alive" : "close");
+    add_response(b, "%s", "\r\n");
+    add_response(b, "%s", form);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool verify()
+{
+    unsigned long long values[] = {0, 1, 9, 10, 99, 100, 12345, 4294967295ULL, 18446744073709551615ULL};
+    for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++){
+        char a[32], b[32];
+        int n = fast_utoa(values[i], a);
+        a[n] = '\0';
+        snprintf(b, sizeof(b), "%llu", values[i]);
+        if(strcmp(a, b) != 0){
+            printf("fast_utoa mismatch: %s %s\n", a, b);
+            return false;
+        }
+    }
+    for(int v = 0; v < 1000000; v += 7){
+        char a[32], b[32];
+        a[fast_utoa(v, a)] = '\0';
+        snprintf(b, sizeof(b), "%d", v);
+        if(strcmp(a, b) != 0){
+            printf("fast_utoa mismatch: %s %s\n", a, b);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 5000000;
+    if(rounds <= 0){
+        printf("usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+    if(!verify()){
+        return 1;
+    }
+    const mime_info* mime = mime_type("/index.html");
+    static out_buf b;
+    long sink = 0;
+    printf("%d responses\n", rounds);
+    printf("%-8s %12s\n", "method", "ns/response");
+
+    double t0 = now_sec();
+    for(int i = 0; i < rounds; i++){
+        build_printf(b, 1000 + (i & 0xffff), i & 1);
+        sink += b.len;
+    }
+    double t1 = now_sec();
+    for(int i = 0; i < rounds; i++){
+        build_block(b, mime, 1000 + (i & 0xffff), i & 1);
+        sink += b.len;
+    }
+    double t2 = now_sec();
+    for(int i = 0; i < rounds; i++){
+        build_error_printf(b, i & 1);
+        sink += b.len;
+    }
+    double t3 = now_sec();
+    for(int i = 0; i < rounds; i++){
+        sink += error_response(404, i & 1).len;
+    }
+    double t4 = now_sec();
+    printf("%-8s %12.2f\n", "printf", (t1 - t0) * 1e9 / rounds);
+    printf("%-8s %12.2f\n", "block", (t2 - t1) * 1e9 / rounds);
+    printf("%-8s %12.2f\n", "err-prt", (t3 - t2) * 1e9 / rounds);
+    printf("%-8s %12.2f\n", "err-blk", (t4 - t3) * 1e9 / rounds);
+    printf("(%ld)\n", sink);
+    return 0;
+}
@@ -0,0 +1,234 @@
+/********************************************************************
+@FileName:scan_bench.cpp
+@Version: 1.0
+@Notes:   请求解析扫描压测：原来的逐字节找\r\n + 逐个strncasecmp对比line_scan的scalar/sse2/avx2实现。
+          输入是几组常见浏览器的真实请求头（Chrome、Firefox、Safari、curl），每轮把所有请求切成行，
+          再在每个请求头里找':'并识别Host/Connection/Content-Length，统计每个请求的耗时和扫描带宽。
+          开始前先用随机数据核对各实现找到的位置与逐字节版本一致。
+          用法：./scan_bench [轮数，默认200000]
+          编译：make bench
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/26 15:02:44
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<strings.h>
+#include<time.h>
+#include"../Code/Http/line_scan.h"
+
+static const char* REQUESTS[] = {
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 192.168.1.1:10000\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"104\", \" Not A;Brand\";v=\"99\", \"Google Chrome\";v=\"104\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/104.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.9\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "\r\n",
+
+    "GET /images/logo.png HTTP/1.1\r\n"
+    "Host: 192.168.1.1:10000\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:103.0) Gecko/20100101 Firefox/103.0\r\n"
+    "Accept: image/avif,image/webp,*/*\r\n"
+    "Accept-Language: zh-CN,zh;q=0.8,zh-TW;q=0.7,zh-HK;q=0.5,en-US;q=0.3,en;q=0.2\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.1:10000/index.html\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n",
+
+    "GET /css/style.css HTTP/1.1\r\n"
+    "Host: 192.168.1.1:10000\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Connection: keep-alive\r\n"
+    "If-Modified-Since: Sat, 25 Jun 2022 08:12:31 GMT\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/15.6 Safari/605.1.15\r\n"
+    "Accept-Language: zh-CN,zh-Hans;q=0.9\r\n"
+    "Referer: http://192.168.1.1:10000/index.html\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "\r\n",
+
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost:10000\r\n"
+    "User-Agent: curl/7.81.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+};
+static const int REQUEST_NUM = sizeof(REQUESTS) / sizeof(REQUESTS[0]);
+
+typedef const char* (*line_end_fn)(const char* begin, const char* end);
+typedef const char* (*char_fn)(const char* begin, const char* end, char c);
+
+//原来parse_line的做法：逐字节比较
+static const char* line_end_bytewise(const char* p, const char* end)
+{
+    for(; p < end; ++p){
+        if(*p == '\r' || *p == '\n'){
+            return p;
+        }
+    }
+    return end;
+}
+
+struct result{
+    int lines;
+    int host;
+    int conn;
+    int length;
+};
+
+//原来prase_request_head的做法：对每个请求头依次strncasecmp
+static void parse_old(const char* buf, int len, result& r)
+{
+    const char* p = buf;
+    const char* end = buf + len;
+    bool first = true;
+    while(p < end){
+        const char* eol = line_end_bytewise(p, end);
+        if(eol == end || eol + 1 == end || eol[1] != '\n'){
+            break;
+        }
+        r.lines++;
+        if(!first && eol != p){
+            if(strncasecmp(p, "Connection:", 11) == 0){
+                r.conn++;
+            }else if(strncasecmp(p, "Content-Length:", 15) == 0){
+                r.length++;
+            }else if(strncasecmp(p, "Host:", 5) == 0){
+                r.host++;
+            }
+        }
+        first = false;
+        p = eol + 2;
+    }
+}
+
+//新的做法：scan_line_end找行尾，scan_char找':'后按字段名长度分支，与http_conn::prase_request_head相同
+static void parse_new(const char* buf, int len, result& r)
+{
+    const char* p = buf;
+    const char* end = buf + len;
+    bool first = true;
+    while(p < end){
+        const char* eol = scan_line_end(p, end);
+        if(eol == end || eol + 1 == end || eol[1] != '\n'){
+            break;
+        }
+        r.lines++;
+        if(!first && eol != p){
+            const char* colon = scan_char(p, eol, ':');
+            if(colon != eol){
+                switch(colon - p){
+                    case 4: if(strncasecmp(p, "Host", 4) == 0) r.host++; break;
+                    case 10: if(strncasecmp(p, "Connection", 10) == 0) r.conn++; break;
+                    case 14: if(strncasecmp(p, "Content-Length", 14) == 0) r.length++; break;
+                    default: break;
+                }
+            }
+        }
+        first = false;
+        p = eol + 2;
+    }
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//随机数据上核对当前实现与逐字节版本的结果，覆盖各种长度和起始偏移（包括不足一个向量的尾部）
+static bool verify()
+{
+    static char buf[4096];
+    srand(12345);
+    for(int round = 0; round < 20000; round++){
+        int len = rand() % 200;
+        for(int i = 0; i < len; i++){
+            int x = rand() % 64;
+            buf[i] = x == 0 ? '\r' : x == 1 ? '\n' : x == 2 ? ':' : (char)('a' + x % 26);
+        }
+        int off = len ? rand() % len : 0;
+        const char* end = buf + len;
+        if(scan_line_end(buf + off, end) != line_end_bytewise(buf + off, end)){
+            return false;
+        }
+        const char* want = (const char*)memchr(buf + off, ':', len - off);
+        if(scan_char(buf + off, end, ':') != (want ? want : end)){
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 200000;
+    if(rounds <= 0){
+        printf("usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    int lens[REQUEST_NUM];
+    long bytes = 0;
+    for(int i = 0; i < REQUEST_NUM; i++){
+        lens[i] = strlen(REQUESTS[i]);
+        bytes += lens[i];
+    }
+    printf("%d requests, %ld bytes per round, %d rounds\n", REQUEST_NUM, bytes, rounds);
+    printf("%-10s %12s %10s %8s\n", "impl", "ns/request", "GB/s", "speedup");
+
+    //基准：原来的逐字节+strncasecmp
+    result base = {0, 0, 0, 0};
+    double t0 = now_sec();
+    for(int n = 0; n < rounds; n++){
+        for(int i = 0; i < REQUEST_NUM; i++){
+            parse_old(REQUESTS[i], lens[i], base);
+        }
+    }
+    double base_sec = now_sec() - t0;
+    double total_req = (double)rounds * REQUEST_NUM;
+    printf("%-10s %12.1f %10.2f %8.2f\n", "old", base_sec * 1e9 / total_req,
+            bytes * (double)rounds / base_sec / 1e9, 1.0);
+
+    const char* impls[] = {"scalar", "sse2", "avx2"};
+    for(int k = 0; k < 3; k++){
+        if(!scan_select(impls[k])){
+            printf("%-10s %12s\n", impls[k], "unsupported");
+            continue;
+        }
+        if(!verify()){
+            printf("%-10s %12s\n", impls[k], "MISMATCH");
+            return 1;
+        }
+        result r = {0, 0, 0, 0};
+        t0 = now_sec();
+        for(int n = 0; n < rounds; n++){
+            for(int i = 0; i < REQUEST_NUM; i++){
+                parse_new(REQUESTS[i], lens[i], r);
+            }
+        }
+        double sec = now_sec() - t0;
+        if(r.lines != base.lines || r.host != base.host || r.conn != base.conn || r.length != base.length){
+            printf("%-10s %12s\n", impls[k], "MISMATCH");
+            return 1;
+        }
+        printf("%-10s %12.1f %10.2f %8.2f\n", impls[k], sec * 1e9 / total_req,
+                bytes * (double)rounds / sec / 1e9, base_sec / sec);
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/********************************************************************
+@FileName:trace_stat.cpp
+@Version: 1.0
+@Notes:   统计服务器-T写出的追踪文件：把每个请求的时间戳按先后排好，相邻两个时间戳之间算一个阶段（以后一个命名），
+          按阶段输出样本数和p50/p90/p99/p99.9/最大值（微秒），一眼看出慢在排队、解析、取文件还是发送：
+            read          ready→read        事件循环处理这一轮前面的事件、read系统调用
+            queue         read→dequeue      在线程池队列中等待
+            batch_wait    →begin            同一批中排在前面的请求的处理时间（第一个请求是process开始到解析）
+            parse         begin→parsed      解析请求行和头部
+            do_request    parsed→handled    取文件（stat/open/mmap或文件缓存）
+            process_write handled→built     生成响应头
+            batch_rest    built→batch_done  同一批中排在后面的请求的处理时间
+            out_wait      →write            等事件循环开始发送（Proactor模式下是EPOLLOUT）
+            send          write→sent        writev/sendfile
+            total         第一个时间戳→sent
+          用法：./trace_stat [-s 状态码] [追踪文件...]，不给文件时读标准输入
+          编译：make bench
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/06 15:30:42
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<algorithm>
+#include<vector>
+
+//和Code/Trace/trace.cpp中的时间戳名字同样的顺序
+static const int POINT_NUM = 10;
+static const char* point_name[POINT_NUM] = {"ready", "read", "dequeue", "begin", "parsed",
+                                            "handled", "built", "batch_done", "write", "sent"};
+//以这个时间戳结束的阶段的名字，ready是第一个时间戳，没有以它结束的阶段
+static const char* stage_name[POINT_NUM] = {NULL, "read", "queue", "batch_wait", "parse",
+                                            "do_request", "process_write", "batch_rest", "out_wait", "send"};
+
+static std::vector<double> samples[POINT_NUM + 1];     //最后一个是total
+static long records = 0;
+static long dropped = 0;
+
+//一行记录：status=和total_us=以后是"名字=相对第一个时间戳的微秒数"，按值排好后相邻两个相减
+static void parse_line(char* line, int status_filter)
+{
+    double at[POINT_NUM];
+    bool seen[POINT_NUM] = {false};
+    int status = -1;
+    double total = -1;
+    for(char* tok = strtok(line, " \n"); tok; tok = strtok(NULL, " \n")){
+        char* eq = strchr(tok, '=');
+        if(!eq){
+            continue;
+        }
+        *eq = '\0';
+        const char* value = eq + 1;
+        if(strcmp(tok, "status") == 0){
+            status = atoi(value);
+        }else if(strcmp(tok, "total_us") == 0){
+            total = atof(value);
+        }else{
+            for(int p = 0; p < POINT_NUM; p++){
+                if(strcmp(tok, point_name[p]) == 0){
+                    at[p] = atof(value);
+                    seen[p] = true;
+                    break;
+                }
+            }
+        }
+    }
+    if(total < 0 || (status_filter >= 0 && status != status_filter)){
+        return;
+    }
+    records++;
+    samples[POINT_NUM].push_back(total);
+
+    std::vector<int> order;
+    for(int p = 0; p < POINT_NUM; p++){
+        if(seen[p]){
+            order.push_back(p);
+        }
+    }
+    //时间相同时按请求经过的顺序
+    std::stable_sort(order.begin(), order.end(), [&at](int a, int b){ return at[a] < at[b]; });
+    for(size_t i = 1; i < order.size(); i++){
+        samples[order[i]].push_back(at[order[i]] - at[order[i - 1]]);
+    }
+}
+
+static void read_file(FILE* fp, int status_filter)
+{
+    char line[1024];
+    while(fgets(line, sizeof(line), fp)){
+        if(line[0] == '#'){
+            //注释行：文件头和"# dropped=N tid=T"
+            const char* p = strstr(line, "dropped=");
+            if(p){
+                dropped += atol(p + strlen("dropped="));
+            }
+            continue;
+        }
+        parse_line(line, status_filter);
+    }
+}
+
+//第q分位数：排好序后第ceil(q*n)个
+static double quantile(const std::vector<double>& v, double q)
+{
+    size_t rank = (size_t)(q * v.size() + 0.999999);
+    if(rank == 0){
+        rank = 1;
+    }
+    if(rank > v.size()){
+        rank = v.size();
+    }
+    return v[rank - 1];
+}
+
+static void print_row(const char* name, std::vector<double>& v)
+{
+    if(v.empty()){
+        return;
+    }
+    std::sort(v.begin(), v.end());
+    printf("%-14s %9zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, v.size(), quantile(v, 0.5),
+           quantile(v, 0.9), quantile(v, 0.99), quantile(v, 0.999), v.back());
+}
+
+int main(int argc, char* argv[])
+{
+    int status_filter = -1;
+    int opt;
+    while((opt = getopt(argc, argv, "s:")) != -1){
+        if(opt == 's'){
+            status_filter = atoi(optarg);
+        }else{
+            printf("usage: %s [-s status] [trace_file...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(optind >= argc){
+        read_file(stdin, status_filter);
+    }
+    for(int i = optind; i < argc; i++){
+        FILE* fp = fopen(argv[i], "r");
+        if(!fp){
+            perror(argv[i]);
+            return 1;
+        }
+        read_file(fp, status_filter);
+        fclose(fp);
+    }
+
+    printf("%ld records, %ld dropped\n", records, dropped);
+    printf("%-14s %9s %10s %10s %10s %10s %10s\n", "stage(us)", "count", "p50", "p90", "p99", "p99.9", "max");
+    for(int p = 1; p < POINT_NUM; p++){
+        print_row(stage_name[p], samples[p]);
+    }
+    print_row("total", samples[POINT_NUM]);
+    return 0;
+}
@@ -0,0 +1,122 @@
+/********************************************************************
+@FileName:buffer.cpp
+@Version: 1.0
+@Notes:   缓冲区段池和链式缓冲区的实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/29 09:58:13
+********************************************************************/
+#include"buffer.h"
+#include<stdlib.h>
+#include<new>
+
+locker segment_pool::m_global_lock;
+buf_segment* segment_pool::m_global = NULL;
+std::atomic<long> segment_pool::m_allocated(0);
+
+segment_pool::local_list& segment_pool::local()
+{
+    static thread_local local_list l = {NULL, 0};
+    return l;
+}
+
+void segment_pool::refill(local_list& l)
+{
+    m_global_lock.lock();
+    while(m_global && l.count < BATCH){
+        buf_segment* seg = m_global;
+        m_global = seg->next;
+        seg->next = l.head;
+        l.head = seg;
+        l.count++;
+    }
+    m_global_lock.unlock();
+}
+
+void segment_pool::spill(local_list& l)
+{
+    //先在锁外把要交出去的BATCH个段摘下来
+    buf_segment* first = l.head;
+    buf_segment* last = first;
+    for(int i = 1; i < BATCH; i++){
+        last = last->next;
+    }
+    l.head = last->next;
+    l.count -= BATCH;
+
+    m_global_lock.lock();
+    last->next = m_global;
+    m_global = first;
+    m_global_lock.unlock();
+}
+
+/********************************************************************
+@FunName:buf_segment* segment_pool::get()
+@Input:  None
+@Output: None
+@Retuval:借到的段
+@Notes:  先从本线程的空闲链表取，空了从全局链表取一批，都没有才向系统申请。申请失败抛出std::bad_alloc
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/29 10:06:47
+********************************************************************/
+buf_segment* segment_pool::get()
+{
+    local_list& l = local();
+    if(!l.head){
+        refill(l);
+    }
+    buf_segment* seg = l.head;
+    if(seg){
+        l.head = seg->next;
+        l.count--;
+    }else{
+        seg = (buf_segment*)malloc(sizeof(buf_segment));
+        if(!seg){
+            throw std::bad_alloc();
+        }
+        m_allocated.fetch_add(1, std::memory_order_relaxed);
+    }
+    seg->next = NULL;
+    seg->len = 0;
+    return seg;
+}
+
+void segment_pool::put(buf_segment* seg)
+{
+    local_list& l = local();
+    seg->next = l.head;
+    l.head = seg;
+    l.count++;
+    if(l.count > LOCAL_MAX){
+        spill(l);
+    }
+}
+
+void segment_pool::put_chain(buf_segment* head)
+{
+    while(head){
+        buf_segment* next = head->next;
+        put(head);
+        head = next;
+    }
+}
+
+buf_segment* buf_chain::append_segment()
+{
+    buf_segment* seg = segment_pool::get();
+    if(m_tail){
+        m_tail->next = seg;
+    }else{
+        m_head = seg;
+    }
+    m_tail = seg;
+    return seg;
+}
+
+void buf_chain::clear()
+{
+    segment_pool::put_chain(m_head);
+    m_head = NULL;
+    m_tail = NULL;
+}
@@ -0,0 +1,76 @@
+/********************************************************************
+@FileName:buffer.h
+@Version: 1.0
+@Notes:   缓冲区段池。http_conn的读写缓冲区不再是嵌在每个连接里的固定数组，而是用到时从这里借固定大小的段，
+          数据处理完就还回来，空闲的长连接不占缓冲区。
+          · 每个线程一个自己的空闲链表，借还都不加锁；
+          · 段常常在一个线程借、另一个线程还（工作线程生成响应头，事件循环线程发完后归还），
+            本线程空闲链表超过LOCAL_MAX时把一批段交给全局链表，空了时先从全局链表取一批，再不够才malloc，
+            这样各个线程的空闲段不会只进不出
+          · 写缓冲区是段的链表（buf_chain），一批流水线响应的响应头可以跨越多个段
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/29 09:40:26
+********************************************************************/
+#ifndef _BUFFER_H_
+#define _BUFFER_H_
+
+#include<stddef.h>
+#include<atomic>
+#include"../Pool/locker.h"
+
+//缓冲区段，整个段（含头部）正好4KB
+struct buf_segment{
+    static const int SIZE = 4096 - 2 * sizeof(void*);
+
+    buf_segment* next;
+    int len;                //data中已使用的字节数
+    char data[SIZE];
+
+    int avail() const { return SIZE - len; }
+};
+
+class segment_pool{
+public:
+    static buf_segment* get();              //借一个段，len为0
+    static void put(buf_segment* seg);      //还一个段
+    static void put_chain(buf_segment* head);   //还一串用next连起来的段
+    static long allocated() { return m_allocated.load(std::memory_order_relaxed); }   //向系统申请过的段数
+
+    static const int LOCAL_MAX = 64;        //每个线程空闲链表的最大段数
+    static const int BATCH = 32;            //和全局链表之间一次转移的段数
+
+private:
+    struct local_list{
+        buf_segment* head;
+        int count;
+    };
+    static local_list& local();
+    static void refill(local_list& l);      //本线程空闲链表空了：从全局链表取一批
+    static void spill(local_list& l);       //本线程空闲链表满了：交一批给全局链表
+
+    static locker m_global_lock;
+    static buf_segment* m_global;           //全局空闲链表
+    static std::atomic<long> m_allocated;
+};
+
+//由段组成的链式缓冲区，只在尾部追加。写缓冲区用：响应头依次追加，每段对应一个或多个iovec
+class buf_chain{
+public:
+    buf_chain():m_head(NULL), m_tail(NULL){}
+    ~buf_chain(){ clear(); }
+
+    buf_segment* tail() { return m_tail; }
+    bool empty() const { return m_head == NULL; }
+    buf_segment* append_segment();          //在尾部接一个新段并返回它
+    void clear();                           //所有段还回段池
+
+private:
+    buf_segment* m_head;
+    buf_segment* m_tail;
+
+    buf_chain(const buf_chain&);
+    void operator=(const buf_chain&);
+};
+
+#endif
@@ -0,0 +1,109 @@
+/********************************************************************
+@FileName:config.cpp
+@Version: 1.0
+@Notes:   服务器配置类实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/02 10:13:05
+********************************************************************/
+#include"config.h"
+
+Config::Config()
+{
+    port = 0;
+    loop_num = 1;       //默认只有一个事件循环，即原来的单epoll模式
+    thread_num = 8;
+    et = false;         //默认水平触发（LT）
+    uring = false;      //默认epoll引擎
+    ws = false;         //默认共享队列线程池
+    sendfile = false;   //默认mmap+writev
+    reactor = false;    //默认Proactor模式
+    log_level = 1;      //默认INFO，每个事件一条的DEBUG日志不输出
+    log_file = NULL;    //默认标准输出
+    trace_file = NULL;  //默认不追踪
+    slow_us = 0;
+}
+
+/********************************************************************
+@FunName:bool Config::parse_arg(int argc, char* argv[])
+@Input:  argc、argv：main的参数
+@Output: None
+@Retuval:true：解析成功。false：参数有误
+@Notes:  第一个非选项参数为端口号，其余为可选项：
+         -l num  事件循环数量（每个循环一个线程、一个epoll、一个SO_REUSEPORT监听socket）
+         -t num  线程池线程数量
+         -e      边沿触发模式（ET）：accept/read/write都循环到EAGAIN为止
+         -u      io_uring事件引擎（需要5.19以上内核），与-e互斥
+         -w      工作窃取线程池：每个工作线程有自己的队列，同一连接固定交给同一线程，空闲线程去偷忙线程的任务
+         -s      响应体用sendfile发送（响应头带MSG_MORE），不再mmap文件；只用于epoll引擎，与-u互斥
+         -r      Reactor模式：可读事件直接交给工作线程，由它recv、解析、发送，发送遇到EAGAIN才注册EPOLLOUT；
+                 只用于epoll引擎，与-u互斥
+         -v num  运行时日志级别，0 DEBUG，1 INFO，2 WARN，3 ERROR（DEBUG日志还需要编译时LOG_MIN_LEVEL=0）
+         -o file 日志写到文件，默认标准输出
+         -T file 请求分阶段计时（TSC时间戳）写到追踪文件，用Bench/trace_stat统计
+         -S us   只追踪耗时超过us微秒的请求（慢请求），默认0即全部；需要和-T一起用
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/02 10:20:18
+********************************************************************/
+bool Config::parse_arg(int argc, char* argv[])
+{
+    int opt;
+    const char* str = "l:t:euwsrv:o:T:S:";
+    while((opt = getopt(argc, argv, str)) != -1){
+        switch(opt){
+            case 'l':
+                loop_num = atoi(optarg);
+                break;
+            case 't':
+                thread_num = atoi(optarg);
+                break;
+            case 'e':
+                et = true;
+                break;
+            case 'u':
+                uring = true;
+                break;
+            case 'w':
+                ws = true;
+                break;
+            case 's':
+                sendfile = true;
+                break;
+            case 'r':
+                reactor = true;
+                break;
+            case 'v':
+                log_level = atoi(optarg);
+                break;
+            case 'o':
+                log_file = optarg;
+                break;
+            case 'T':
+                trace_file = optarg;
+                break;
+            case 'S':
+                slow_us = atoi(optarg);
+                break;
+            default:
+                return false;
+        }
+    }
+
+    //getopt会把非选项参数排到最后，剩下的第一个就是端口号
+    if(optind >= argc){
+        return false;
+    }
+    port = atoi(argv[optind]);
+
+    if(port <= 0 || loop_num <= 0 || thread_num <= 0 || (et && uring) || (sendfile && uring) || (reactor && uring) || log_level < 0 || log_level > 3
+       || slow_us < 0 || (slow_us > 0 && !trace_file)){
+        return false;
+    }
+    return true;
+}
+
+void Config::usage(const char* prog)
+{
+    printf("请按照如下格式运行：%s port_number [-l loop_num] [-t thread_num] [-e] [-u] [-w] [-s] [-r] [-v log_level] [-o log_file] [-T trace_file] [-S slow_us]\n", prog);
+}
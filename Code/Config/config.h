@@ -0,0 +1,42 @@
+/********************************************************************
+@FileName:config.h
+@Version: 1.0
+@Notes:   服务器配置类，解析命令行参数。
+          用法：./My_Webserver port [-l 事件循环数] [-t 线程池线程数] [-e] [-u] [-w] [-s] [-r] [-v 日志级别] [-o 日志文件]
+                    [-T 追踪文件] [-S 慢请求阈值]
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/02 10:12:40
+********************************************************************/
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<getopt.h>
+
+class Config{
+public:
+    Config();
+    ~Config(){}
+
+    bool parse_arg(int argc, char* argv[]);   //解析命令行参数，失败返回false
+    void usage(const char* prog);             //打印用法
+
+    int port;           //监听端口号
+    int loop_num;       //事件循环（epoll实例）数量，>1时每个循环各自持有一个SO_REUSEPORT监听socket
+    int thread_num;     //线程池线程数量
+    bool et;            //监听socket和连接socket是否使用边沿触发（ET）
+    bool uring;         //使用io_uring事件引擎代替epoll
+    bool ws;            //使用工作窃取线程池（ws_threadpool）代替共享队列的threadpool
+    bool sendfile;      //响应体用sendfile发送，代替mmap+writev
+    bool reactor;       //Reactor模式：工作线程自己收发数据，代替事件循环读写的Proactor模式
+    int log_level;      //运行时日志级别：0 DEBUG，1 INFO，2 WARN，3 ERROR
+    const char* log_file;   //日志文件，NULL表示写到标准输出
+    const char* trace_file; //请求分阶段计时的追踪文件，NULL表示不追踪
+    int slow_us;            //只追踪从ready到发完超过这么多微秒的请求，0表示全部
+};
+
+#endif
@@ -0,0 +1,188 @@
+/********************************************************************
+@FileName:compress_cache.cpp
+@Version: 1.0
+@Notes:   压缩变体缓存实现。gzip用zlib，br用libbrotlienc，都是一次压缩整个文件（文件已经映射在内存中）
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/03 10:21:02
+********************************************************************/
+#include"compress_cache.h"
+#include<stdlib.h>
+#include<string.h>
+#include<stdio.h>
+#include<functional>
+#include<zlib.h>
+#include<brotli/encode.h>
+
+compress_cache* compress_cache::get_instance()
+{
+    static compress_cache instance;
+    return &instance;
+}
+
+void compress_cache::to_variant(file_validator& v, CONTENT_ENCODING enc)
+{
+    int len = strlen(v.etag);   //最后一个字符是引号
+    snprintf(v.etag + len - 1, sizeof(v.etag) - len + 1, "-%s\"", encoding_name(enc));
+    v.build_header();
+}
+
+/********************************************************************
+@FunName:file_entry* compress_cache::acquire(const file_entry* src, CONTENT_ENCODING enc)
+@Input:  src：原文件，调用者持有它的引用
+         enc：ENC_GZIP或ENC_BR
+@Output: None
+@Retuval:压缩后的变体（引用计数已+1），或者NULL（发原文件）
+@Notes:  命中：只加锁查表。未命中：插入占位条目后在锁外压缩，压缩完再加锁填进去。
+         占位条目在压缩期间不会被淘汰，所以同一个键同时只有一个线程在压缩
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/03 10:36:25
+********************************************************************/
+file_entry* compress_cache::acquire(const file_entry* src, CONTENT_ENCODING enc)
+{
+    if(src->st.st_size < MIN_SIZE || src->st.st_size > MAX_SIZE || !src->addr){
+        return NULL;
+    }
+    std::string key = src->path;
+    key += '\0';
+    key += src->valid.etag;
+    key += '\0';
+    key += encoding_name(enc);
+    shard& s = m_shards[std::hash<std::string>()(key) % SHARD_NUM];
+
+    s.lock.lock();
+    std::unordered_map<std::string, variant*>::iterator it = s.map.find(key);
+    if(it != s.map.end()){
+        variant* v = it->second;
+        s.lru.splice(s.lru.begin(), s.lru, v->lru_pos);
+        file_entry* e = v->entry;
+        if(e){
+            e->refcnt.fetch_add(1, std::memory_order_relaxed);
+        }
+        s.lock.unlock();
+        return e;
+    }
+    variant* v = new variant;
+    v->key = key;
+    v->entry = NULL;
+    v->done = false;
+    s.map[key] = v;
+    s.lru.push_front(v);
+    v->lru_pos = s.lru.begin();
+    s.lock.unlock();
+
+    file_entry* e = compress(src, enc);
+
+    s.lock.lock();
+    v->done = true;
+    if(e){
+        e->refcnt.store(2, std::memory_order_relaxed);  //缓存一个，调用者一个
+        v->entry = e;
+        s.bytes += e->st.st_size;
+    }
+    evict(s, v);
+    s.lock.unlock();
+    return e;
+}
+
+//压缩src，生成变体条目（引用计数为0）。没有明显变小（省不到1/16）或内存不够返回NULL
+file_entry* compress_cache::compress(const file_entry* src, CONTENT_ENCODING enc)
+{
+    size_t len = src->st.st_size;
+    size_t out_len = 0;
+    char* out = enc == ENC_BR ? compress_br(src->addr, len, out_len) : compress_gzip(src->addr, len, out_len);
+    if(!out){
+        return NULL;
+    }
+    if(out_len >= len - len / 16){
+        free(out);
+        return NULL;
+    }
+    char* shrunk = (char*)realloc(out, out_len);
+    if(shrunk){
+        out = shrunk;
+    }
+    file_entry* e = new file_entry;
+    e->path = src->path;
+    e->st = src->st;
+    e->st.st_size = out_len;
+    e->valid = src->valid;
+    to_variant(e->valid, enc);
+    e->fd = -1;
+    e->addr = out;
+    e->refcnt.store(0, std::memory_order_relaxed);
+    e->checked = 0;
+    e->cached = false;
+    return e;
+}
+
+//gzip格式（deflate加gzip头尾），windowBits加16让zlib写gzip头
+char* compress_cache::compress_gzip(const char* src, size_t len, size_t& out_len)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+        return NULL;
+    }
+    size_t bound = deflateBound(&zs, len);
+    char* out = (char*)malloc(bound);
+    if(!out){
+        deflateEnd(&zs);
+        return NULL;
+    }
+    zs.next_in = (Bytef*)src;
+    zs.avail_in = len;
+    zs.next_out = (Bytef*)out;
+    zs.avail_out = bound;
+    int ret = deflate(&zs, Z_FINISH);   //输出空间是deflateBound，一次就能完成
+    out_len = zs.total_out;
+    deflateEnd(&zs);
+    if(ret != Z_STREAM_END){
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+char* compress_cache::compress_br(const char* src, size_t len, size_t& out_len)
+{
+    size_t bound = BrotliEncoderMaxCompressedSize(len);
+    char* out = bound ? (char*)malloc(bound) : NULL;
+    if(!out){
+        return NULL;
+    }
+    out_len = bound;
+    if(!BrotliEncoderCompress(BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, (const uint8_t*)src,
+        &out_len, (uint8_t*)out)){
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+//从分片中移除变体，放掉缓存持有的引用。调用者持有分片锁
+void compress_cache::unlink(shard& s, variant* v)
+{
+    s.map.erase(v->key);
+    s.lru.erase(v->lru_pos);
+    if(v->entry){
+        s.bytes -= v->entry->st.st_size;
+        file_cache::get_instance()->release(v->entry);
+    }
+    delete v;
+}
+
+//超出分片的上限时从LRU表尾淘汰。正在压缩的和刚插入的keep不淘汰。调用者持有分片锁
+void compress_cache::evict(shard& s, variant* keep)
+{
+    std::list<variant*>::iterator it = s.lru.end();
+    while((s.map.size() > MAX_ENTRIES / SHARD_NUM || s.bytes > MAX_BYTES / SHARD_NUM) && it != s.lru.begin()){
+        variant* victim = *--it;
+        if(victim == keep || !victim->done){
+            continue;
+        }
+        ++it;   //指向victim后面的一个，删掉victim后仍然有效
+        unlink(s, victim);
+    }
+}
@@ -0,0 +1,74 @@
+/********************************************************************
+@FileName:compress_cache.h
+@Version: 1.0
+@Notes:   压缩变体缓存，所有http_conn共用。文本类文件第一次按某种编码（gzip/br）被请求时压缩一次，
+          结果按（路径，ETag，编码）缓存，ETag里有inode、大小和mtime，文件变了就是新的键，旧的变体由LRU淘汰。
+          · 变体也是一个file_entry（fd为-1，addr是压缩后的数据），和原文件一样由引用计数管理，
+            发送时m_iv直接指向缓存中的数据，不拷贝，用完file_cache::release
+          · 同一个变体只压缩一次：第一个请求先插入一个占位条目再在锁外压缩，
+            压缩完成之前其他请求看到占位条目就先发不压缩的原文件，不等待也不重复压缩
+          · 压缩后没有明显变小的也记下来（占位条目不带数据），以后直接发原文件
+          · 按分片加锁，每个分片有条目数和字节数上限，同file_cache
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/03 10:20:17
+********************************************************************/
+#ifndef _COMPRESS_CACHE_H_
+#define _COMPRESS_CACHE_H_
+
+#include<string>
+#include<list>
+#include<unordered_map>
+#include"../Pool/locker.h"
+#include"file_cache.h"
+#include"http_header.h"
+
+class compress_cache{
+public:
+    static compress_cache* get_instance();
+
+    //取src（从file_cache取出的原文件）按enc压缩后的变体，引用计数+1，用完调用file_cache::release。
+    //返回NULL表示这次发原文件：文件太小或太大、别的线程正在压缩、压缩后没有明显变小
+    file_entry* acquire(const file_entry* src, CONTENT_ENCODING enc);
+    //把原文件的验证器改成变体的：ETag在引号内加上"-编码名"
+    static void to_variant(file_validator& v, CONTENT_ENCODING enc);
+
+    static const int SHARD_NUM = 16;
+    static const size_t MAX_ENTRIES = 1024;             //整个缓存最多的条目数（含占位条目）
+    static const size_t MAX_BYTES = 32 * 1024 * 1024;   //整个缓存最多的压缩数据字节数
+    static const off_t MIN_SIZE = 256;                  //比这小的文件压缩省不了多少，不压缩
+    static const off_t MAX_SIZE = 1024 * 1024;          //比这大的文件不压缩（压缩在工作线程中进行，太大会长时间占住线程）
+    //压缩在处理请求的工作线程中进行，用中等级别：gzip 9比6只小1%左右但慢两倍多，br 9比5慢四五倍
+    static const int GZIP_LEVEL = 6;
+    static const int BROTLI_QUALITY = 5;                //11压缩率最高但慢一个数量级
+
+private:
+    struct variant{
+        std::string key;
+        file_entry* entry;      //压缩后的数据，NULL表示正在压缩或不值得压缩
+        bool done;              //压缩是否已经结束，正在压缩的条目不淘汰
+        std::list<variant*>::iterator lru_pos;
+    };
+    struct shard{
+        locker lock;
+        std::unordered_map<std::string, variant*> map;
+        std::list<variant*> lru;    //表头是最近使用的
+        size_t bytes;
+        shard():bytes(0){}
+    };
+
+    compress_cache(){}
+    ~compress_cache(){}
+    compress_cache(const compress_cache&);
+    void operator=(const compress_cache&);
+
+    static file_entry* compress(const file_entry* src, CONTENT_ENCODING enc);
+    static char* compress_gzip(const char* src, size_t len, size_t& out_len);
+    static char* compress_br(const char* src, size_t len, size_t& out_len);
+    void unlink(shard& s, variant* v);      //调用者持有分片锁
+    void evict(shard& s, variant* keep);
+
+    shard m_shards[SHARD_NUM];
+};
+
+#endif
@@ -0,0 +1,289 @@
+/********************************************************************
+@FileName:file_cache.cpp
+@Version: 1.0
+@Notes:   打开文件缓存实现。这里的stat/open/mmap失败是正常情况（404、403），
+          所以直接调系统调用，不用Wrap中出错就退出的封装
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/21 09:31:02
+********************************************************************/
+#include"file_cache.h"
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<functional>
+#include"http_header.h"
+
+file_cache* file_cache::get_instance()
+{
+    static file_cache instance;     //C++11起局部静态变量的初始化是线程安全的
+    return &instance;
+}
+
+//单调时钟的秒数。CLOCK_MONOTONIC_COARSE走vDSO，不进内核
+time_t file_cache::now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec;
+}
+
+//文件是否被修改过（或被替换成了另一个文件、改了权限）
+static bool same_file(const struct stat& a, const struct stat& b)
+{
+    return a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec
+        && a.st_size == b.st_size && a.st_ino == b.st_ino && a.st_dev == b.st_dev
+        && a.st_mode == b.st_mode;
+}
+
+/********************************************************************
+@FunName:file_entry* file_cache::acquire(const char* path, int& err)
+@Input:  path：请求文件的完整路径
+@Output: err：失败时的errno。ENOENT/ENOTDIR：文件不存在；EACCES：其他用户不可读；EISDIR：是目录
+@Retuval:成功返回条目（引用计数已+1，用完调用release），失败返回NULL
+@Notes:  命中且距上次验证不到REVALIDATE_SEC秒：只加锁查表，没有系统调用。
+         命中但需要验证：放开锁stat一次，再加锁重新查表，没变就继续用，变了就把旧条目移出缓存（正在用它的连接不受影响）重新加载。
+         未命中：在锁外stat/open/mmap，再加锁插入；期间别的线程已经插入了同一个文件就用它的，丢掉自己的。
+         移出和淘汰的条目在放开锁之后才释放
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/21 09:52:40
+********************************************************************/
+file_entry* file_cache::acquire(const char* path, int& err)
+{
+    std::string key(path);
+    shard& s = m_shards[std::hash<std::string>()(key) % SHARD_NUM];
+    time_t now = now_sec();
+    struct stat st;
+
+    s.lock.lock();
+    std::unordered_map<std::string, file_entry*>::iterator it = s.map.find(key);
+    if(it != s.map.end() && now - it->second->checked < REVALIDATE_SEC){
+        file_entry* e = it->second;
+        s.lru.splice(s.lru.begin(), s.lru, e->lru_pos);
+        e->refcnt.fetch_add(1, std::memory_order_relaxed);
+        s.lock.unlock();
+        return e;
+    }
+    s.lock.unlock();
+
+    //未命中或需要验证：stat不在锁内做
+    bool stat_ok = stat(path, &st) == 0;
+    int stat_err = errno;
+    std::vector<file_entry*> dead;
+    s.lock.lock();
+    it = s.map.find(key);
+    if(it != s.map.end()){
+        //放开锁期间条目可能被别的线程验证过或换掉了，和自己stat的结果比较
+        file_entry* e = it->second;
+        if(stat_ok && same_file(st, e->st)){
+            e->checked = now;
+            s.lru.splice(s.lru.begin(), s.lru, e->lru_pos);
+            e->refcnt.fetch_add(1, std::memory_order_relaxed);
+            s.lock.unlock();
+            return e;
+        }
+        unlink(s, e, dead);     //文件变了或者没了
+    }
+    s.lock.unlock();
+    release_all(dead);
+
+    if(!stat_ok){
+        err = stat_err;
+        return NULL;
+    }
+    if(!check_file(st, err)){
+        return NULL;
+    }
+    file_entry* e = load(path, st, err);
+    if(!e){
+        return NULL;
+    }
+    if((size_t)st.st_size > MAX_FILE_SIZE){
+        //大文件不缓存，只有调用者一个引用，release时就释放
+        e->refcnt.store(1, std::memory_order_relaxed);
+        return e;
+    }
+    e->refcnt.store(2, std::memory_order_relaxed);
+    e->checked = now;
+    e->cached = true;
+
+    s.lock.lock();
+    it = s.map.find(key);
+    if(it != s.map.end()){
+        file_entry* exist = it->second;
+        s.lru.splice(s.lru.begin(), s.lru, exist->lru_pos);
+        exist->refcnt.fetch_add(1, std::memory_order_relaxed);
+        s.lock.unlock();
+        destroy(e);
+        return exist;
+    }
+    s.map[key] = e;
+    s.lru.push_front(e);
+    e->lru_pos = s.lru.begin();
+    s.bytes += st.st_size;
+    evict(s, e, dead);
+    s.lock.unlock();
+    release_all(dead);
+    return e;
+}
+
+/********************************************************************
+@FunName:bool file_cache::probe(const char* path, file_validator& v, int& err)
+@Input:  path：请求文件的完整路径
+@Output: v：文件的验证器
+         err：失败时的errno，同acquire
+@Retuval:是否成功
+@Notes:  和acquire一样先查缓存，命中且不需要重新验证时直接拷贝条目的验证器。
+         需要验证或未命中时只stat：条件请求大多会得到304，不值得为它打开、映射文件
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/01 11:02:18
+********************************************************************/
+bool file_cache::probe(const char* path, file_validator& v, int& err)
+{
+    std::string key(path);
+    shard& s = m_shards[std::hash<std::string>()(key) % SHARD_NUM];
+    time_t now = now_sec();
+
+    s.lock.lock();
+    std::unordered_map<std::string, file_entry*>::iterator it = s.map.find(key);
+    if(it != s.map.end() && now - it->second->checked < REVALIDATE_SEC){
+        v = it->second->valid;
+        s.lock.unlock();
+        return true;
+    }
+    s.lock.unlock();
+
+    struct stat st;
+    if(!stat_file(path, st, err)){
+        return false;
+    }
+    v.set(st);
+    return true;
+}
+
+//stat文件并检查它能不能发给客户端
+bool file_cache::stat_file(const char* path, struct stat& st, int& err)
+{
+    if(stat(path, &st) < 0){
+        err = errno;
+        return false;
+    }
+    return check_file(st, err);
+}
+
+//文件能不能发给客户端：是普通文件、其他用户可读
+bool file_cache::check_file(const struct stat& st, int& err)
+{
+    if(S_ISDIR(st.st_mode)){
+        err = EISDIR;
+        return false;
+    }
+    //判断访问权限
+    if(!S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH)){
+        err = EACCES;
+        return false;
+    }
+    return true;
+}
+
+//inode、大小、mtime（纳秒）任何一个变了ETag都会变。同一秒内改过两次的文件Last-Modified不变，但ETag会变
+void file_validator::set(const struct stat& st)
+{
+    unsigned long long mtime_ns = (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"", (unsigned long long)st.st_ino,
+        (unsigned long long)st.st_size, mtime_ns);
+    format_http_date(st.st_mtim.tv_sec, last_modified);
+    mtime = st.st_mtim.tv_sec;
+    build_header();
+}
+
+void file_validator::build_header()
+{
+    header_len = snprintf(header, sizeof(header), "ETag: %s\r\nLast-Modified: %s\r\n", etag, last_modified);
+}
+
+//释放一个引用，最后一个引用释放时关闭文件、解除映射
+void file_cache::release(file_entry* e)
+{
+    if(e->refcnt.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        destroy(e);
+    }
+}
+
+//打开并映射文件，失败返回NULL并设置err
+file_entry* file_cache::load(const char* path, const struct stat& st, int& err)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        err = errno;
+        return NULL;
+    }
+    char* addr = NULL;
+    if(st.st_size > 0){     //长度为0的mmap会失败，空文件不映射
+        addr = (char*)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr == MAP_FAILED){
+            err = errno;
+            close(fd);
+            return NULL;
+        }
+    }
+    file_entry* e = new file_entry;
+    e->path = path;
+    e->st = st;
+    e->valid.set(st);
+    e->fd = fd;
+    e->addr = addr;
+    e->refcnt.store(0, std::memory_order_relaxed);
+    e->checked = 0;
+    e->cached = false;
+    return e;
+}
+
+void file_cache::destroy(file_entry* e)
+{
+    if(e->fd == -1){
+        free(e->addr);  //压缩变体
+    }else{
+        if(e->addr){
+            munmap(e->addr, e->st.st_size);
+        }
+        close(e->fd);
+    }
+    delete e;
+}
+
+//从分片中移除条目，缓存持有的那个引用放进dead，放开分片锁后再release（可能munmap）。调用者持有分片锁
+void file_cache::unlink(shard& s, file_entry* e, std::vector<file_entry*>& dead)
+{
+    s.map.erase(e->path);
+    s.lru.erase(e->lru_pos);
+    s.bytes -= e->st.st_size;
+    e->cached = false;
+    dead.push_back(e);
+}
+
+//超出分片的条目数或字节数上限时，从LRU表尾淘汰，刚插入的keep不淘汰。调用者持有分片锁
+void file_cache::evict(shard& s, file_entry* keep, std::vector<file_entry*>& dead)
+{
+    while((s.map.size() > MAX_ENTRIES / SHARD_NUM || s.bytes > MAX_BYTES / SHARD_NUM) && !s.lru.empty()){
+        file_entry* victim = s.lru.back();
+        if(victim == keep){
+            break;
+        }
+        unlink(s, victim, dead);
+    }
+}
+
+//放开分片锁之后释放摘下来的条目，清空dead
+void file_cache::release_all(std::vector<file_entry*>& dead)
+{
+    for(size_t i = 0; i < dead.size(); i++){
+        release(dead[i]);
+    }
+    dead.clear();
+}
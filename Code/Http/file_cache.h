@@ -0,0 +1,101 @@
+/********************************************************************
+@FileName:file_cache.h
+@Version: 1.0
+@Notes:   打开文件缓存，所有http_conn共用。按请求文件的完整路径缓存struct stat、文件fd和只读映射，
+          热点文件（index.html、favicon.ico等）命中后不再有stat/open/mmap/munmap系统调用。
+          · 分片：按路径哈希分到SHARD_NUM个分片，每个分片一把锁，不同文件的请求基本不抢同一把锁
+          · 引用计数：连接取到的条目在响应发完之前一直有效，即使期间被淘汰或文件被修改，最后一个使用者释放时才munmap/close
+          · LRU：每个分片有条目数和字节数上限，超出时从最久未用的一端淘汰，太大的文件（MAX_FILE_SIZE）不进缓存
+          · 重新验证：条目每隔REVALIDATE_SEC秒stat一次，mtime/大小/inode变了就重新加载
+          · 验证器：条目加载时就生成好ETag和Last-Modified，条件GET用probe()只取验证器，不打开、不映射文件
+          · 分片锁内只查表、改LRU：stat在加锁之前做，淘汰和失效的条目先摘下来，放开锁之后才释放（munmap/close），
+            慢盘上的stat或大文件的munmap不会挡住同一分片的其他线程
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/21 09:30:14
+********************************************************************/
+#ifndef _FILE_CACHE_H_
+#define _FILE_CACHE_H_
+
+#include<string>
+#include<list>
+#include<vector>
+#include<unordered_map>
+#include<atomic>
+#include<time.h>
+#include<sys/stat.h>
+#include"../Pool/locker.h"
+
+//文件的验证器，由struct stat生成，文件没变就不变
+struct file_validator{
+    char etag[64];              //强ETag："inode-大小-mtime纳秒"（十六进制），带引号
+    char last_modified[32];     //mtime，HTTP日期格式
+    time_t mtime;               //mtime的秒数，和If-Modified-Since比较
+    char header[128];           //"ETag: ...\r\nLast-Modified: ...\r\n"，生成响应头时整块拷贝
+    int header_len;
+
+    void set(const struct stat& st);
+    void build_header();        //etag或last_modified改了之后重新生成header
+};
+
+//缓存条目。fd和addr在条目的整个生命周期内不变，多个连接可以同时使用（sendfile用自己的偏移量，不改变文件位置）
+struct file_entry{
+    std::string path;
+    struct stat st;
+    file_validator valid;
+    int fd;                     //打开的文件，sendfile模式使用。-1表示是压缩变体（compress_cache.h），没有文件
+    char* addr;                 //只读映射，mmap模式使用。空文件为NULL。压缩变体是malloc的压缩数据
+    std::atomic<int> refcnt;    //缓存本身持有一个引用，每个正在发送它的连接各持有一个
+    time_t checked;             //上次stat验证的时间（单调时钟，秒）
+    bool cached;                //是否在缓存中（太大的文件不进缓存，用完即释放）
+    std::list<file_entry*>::iterator lru_pos;
+};
+
+class file_cache{
+public:
+    static file_cache* get_instance();
+
+    //取path对应的条目，引用计数+1。失败返回NULL，err为errno（ENOENT、EACCES、EISDIR等）
+    file_entry* acquire(const char* path, int& err);
+    //用完之后释放
+    void release(file_entry* e);
+    //只取path的验证器，用来判断条件GET能不能回304。缓存命中时没有系统调用，未命中时只stat，不打开文件也不进缓存。
+    //失败返回false，err同acquire
+    bool probe(const char* path, file_validator& v, int& err);
+
+    static const int SHARD_NUM = 16;
+    static const size_t MAX_ENTRIES = 1024;             //整个缓存最多的条目数
+    static const size_t MAX_BYTES = 64 * 1024 * 1024;   //整个缓存最多映射的字节数
+    //超过这个大小的文件不缓存。字节数上限是按分片算的（每个分片MAX_BYTES / SHARD_NUM），
+    //单个文件不超过分片上限的1/4，一个大文件不会把分片中其他条目都挤出去
+    static const size_t MAX_FILE_SIZE = MAX_BYTES / SHARD_NUM / 4;
+    static const int REVALIDATE_SEC = 1;                //条目重新stat的间隔
+
+private:
+    struct shard{
+        locker lock;
+        std::unordered_map<std::string, file_entry*> map;
+        std::list<file_entry*> lru;     //表头是最近使用的
+        size_t bytes;
+        shard():bytes(0){}
+    };
+
+    file_cache(){}
+    ~file_cache(){}
+    file_cache(const file_cache&);
+    void operator=(const file_cache&);
+
+    static bool stat_file(const char* path, struct stat& st, int& err);
+    static bool check_file(const struct stat& st, int& err);
+    static file_entry* load(const char* path, const struct stat& st, int& err);
+    static void destroy(file_entry* e);
+    static time_t now_sec();
+    //从分片中移除，缓存持有的引用放进dead，调用者放开分片锁后release。调用者持有分片锁
+    void unlink(shard& s, file_entry* e, std::vector<file_entry*>& dead);
+    void evict(shard& s, file_entry* keep, std::vector<file_entry*>& dead);
+    void release_all(std::vector<file_entry*>& dead);      //释放dead中的条目并清空
+
+    shard m_shards[SHARD_NUM];
+};
+
+#endif
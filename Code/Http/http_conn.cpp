@@ -1,22 +1,23 @@
 #include"http_conn.h"
+#include"../Server/uring_loop.h"
+#include"../Metrics/metrics.h"
+#include<atomic>
 
 //静态成员变量初始化
-int http_conn::m_epollfd = -1;
-int http_conn::m_user_count = 0;
-
-// 定义HTTP响应的一些状态信息
-const char* ok_200_title = "OK";
-const char* error_400_title = "Bad Request";
-const char* error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char* error_403_title = "Forbidden";
-const char* error_403_form = "You do not have permission to get file from this server.\n";
-const char* error_404_title = "Not Found";
-const char* error_404_form = "The requested file was not found on this server.\n";
-const char* error_500_title = "Internal Error";
-const char* error_500_form = "There was an unusual problem serving the requested file.\n";
-
-//网站的根目录
-const char* doc_root = "/home/xiaodexin/桌面/MyProject2_WebServer/Resources";
+bool http_conn::m_et_mode = false;
+bool http_conn::m_sendfile_mode = false;
+bool http_conn::m_reactor_mode = false;
+const char http_conn::METRICS_PATH[] = "/__metrics";
+static_assert(http_conn::MAX_PIPELINE <= trace_batch::MAX_REQ, "trace_batch放不下一批流水线请求");
+
+//多区间206响应中每个部分前面的头：分隔符、类型、区间
+static const char* PART_FORMAT = "\r\n--%016lx\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n";
+//多区间响应的分隔符，每个响应用不同的值（16位十六进制，长度固定）
+static std::atomic<unsigned long> boundary_seq(0x5f3759df00000000UL);
+
+//网站的根目录，长度编译期算好，do_request不用每个请求strlen
+static const char doc_root[] = "/home/xiaodexin/桌面/MyProject2_WebServer/Resources";
+static const int DOC_ROOT_LEN = sizeof(doc_root) - 1;
 
 /********************************************************************
 @FunName:void setnonblocking(int fd)
@@ -36,29 +37,31 @@ void setnonblocking(int fd){
 
 
 /********************************************************************
-@FunName:int addfd(int epollfd, int fd)
+@FunName:int addfd(int epollfd, int fd, bool one_shot, bool et)
 @Input:  epollfd:epoll句柄
          fd：要添加的fd
+         one_shot：是否注册EPOLLONESHOT
+         et：是否边沿触发(EPOLLET)
 @Output: None
 @Retuval:None
-@Notes:  添加文件描述符到epoll中
+@Notes:  添加文件描述符到epoll中。fd须事先设置为非阻塞（accept4(SOCK_NONBLOCK)或setnonblocking），
+         这里不再额外调用两次fcntl
 @Author: XiaoDexin
 @Email:  xiaodexin0701@163.com
 @Time:   2022/05/04 16:06:04
 ********************************************************************/
-void addfd(int epollfd, int fd, bool one_shot)
+void addfd(int epollfd, int fd, bool one_shot, bool et)
 {
     epoll_event event;
     event.data.fd = fd;
     event.events = EPOLLIN | EPOLLRDHUP;//EPOLLRDHUP是内核2.6.17后才有的，该事件作用是若对端连接断开时，触发此事件，在底层对对端断开进行处理（之前是在上层通过Recv函数返回值判断）
-    //event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;//边沿触发
+    if(et){
+        event.events |= EPOLLET;//边沿触发，读写都必须循环到EAGAIN为止
+    }
     if(one_shot){
-        event.events | EPOLLONESHOT;
+        event.events |= EPOLLONESHOT;
     }
     Epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    
-    //设置文件描述符为非阻塞
-    setnonblocking(fd);
 }
 
 
@@ -68,7 +71,8 @@ void addfd(int epollfd, int fd, bool one_shot)
          fd：要删除的fd
 @Output: None
 @Retuval:None
-@Notes:  从epoll中删除文件描述符
+@Notes:  从epoll中删除文件描述符。不关闭fd：fd号一释放就可能被别的事件循环accept到，
+         要等连接对象还给连接表之后由事件循环最后关闭
 @Author: XiaoDexin
 @Email:  xiaodexin0701@163.com
 @Time:   2022/05/04 16:06:51
@@ -76,15 +80,15 @@ void addfd(int epollfd, int fd, bool one_shot)
 void removefd(int epollfd, int fd)
 {
     Epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
-    Close(fd);
 
 }
 
 /********************************************************************
-@FunName:void modfd(int epollfd, int fd, int ev)
+@FunName:void modfd(int epollfd, int fd, int ev, bool et)
 @Input:  epollfd:epoll句柄
          fd：要修改的fd
          ev：要修改的event
+         et：是否边沿触发(EPOLLET)
 @Output: None
 @Retuval:None
 @Notes:  修改文件epoll上的描述符,重置socket上的EPOLLONESHOT事件，以确保下一次可读时，EPOLLIN事件可以触发
@@ -92,55 +96,101 @@ void removefd(int epollfd, int fd)
 @Email:  xiaodexin0701@163.com
 @Time:   2022/05/04 16:36:34
 ********************************************************************/
-void modfd(int epollfd, int fd, int ev)
+void modfd(int epollfd, int fd, int ev, bool et)
 {
     epoll_event event;
     event.data.fd = fd;
     event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
+    if(et){
+        event.events |= EPOLLET;
+    }
     Epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
 //初始化连接
-void http_conn::init(int sockfd, sockaddr_in &addr)
+void http_conn::init(int sockfd, sockaddr_in &addr, int epollfd, timer_wheel* wheel)
 {
-    m_sockfd = sockfd;
+    m_epollfd = epollfd;
+    m_uring = NULL;
+    m_wheel = wheel;
+    m_state->sockfd = sockfd;
     m_address = addr;
 
-    //端口复用
-    int reuse = 1;
-    setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    //添加到epoll红黑树中（sockfd已由accept4设置为非阻塞）
+    addfd(m_epollfd, m_state->sockfd, true, m_et_mode);   //connfd需要有onshot事件
+    metrics::conn_opened();     //在线连接数+1（本线程的计数器）
+    init();
+}
 
-    //添加到epoll红黑树中
-    addfd(m_epollfd, m_sockfd, true);   //connfd需要有onshot事件
-    m_user_count++; //总用户数（客户端数）+1
+//初始化由io_uring引擎接收的连接，不挂到epoll上，第一次recv由uring_loop提交
+void http_conn::init(int sockfd, sockaddr_in &addr, uring_loop* uring, timer_wheel* wheel)
+{
+    m_epollfd = -1;
+    m_uring = uring;
+    m_wheel = wheel;
+    m_state->sockfd = sockfd;
+    m_address = addr;
+    metrics::conn_opened();     //在线连接数+1（本线程的计数器）
     init();
 }
 
 //初始化连接其余的信息
 void http_conn::init(){ //把两个init分开写的原因是此init在解析的过程中要用到，若两个init写在一起会导致把sockfd也初始化了
-    m_read_idx = 0;
-    m_write_idx = 0;
+    m_state->read_idx = 0;
+    release_read_buf();
+    m_write.clear();
+    m_resp_start = 0;
+    m_state->checked_index = 0;
+    init_request();
+    m_file = 0;
+    m_file_address = 0;
+    m_file_fd = -1;
+    m_file_count = 0;
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_batch_linger = false;
+    m_batch_responses = 0;
+    m_recv_us = 0;
+    m_body.clear();
+    m_state->parse_pending = false;
+    m_state->idle_since.store(0, std::memory_order_relaxed);
+    //缓冲区都不清零：读缓冲区按read_idx/checked_index和请求头的视图（偏移+长度）访问，
+    //写缓冲区按每段的len发送，m_real_file在do_request中拼好并写上\0，上一个请求留下的字节不会被读到
+    m_real_file[0] = '\0';
+}
+
+//开始解析下一个请求。保持连接时不再清空读缓冲区：客户端流水线发来的后续请求可能已经读进来了，
+//从checked_index（上一个请求的结尾）接着解析
+void http_conn::init_request(){
     m_method = GET;         // 默认请求方式为GET
-    m_check_state = CHECK_STATE_REQUESTLINE;    //初始化状态为 当前正在解析请求首行
-    m_checked_index = 0;
-    m_start_line = 0;
-    m_method = GET;
-    m_url = 0;
-    m_version = 0;
-    m_host = 0;
+    m_state->check_state = CHECK_STATE_REQUESTLINE;    //初始化状态为 当前正在解析请求首行
+    m_state->start_line = m_state->checked_index;
+    m_state->request_start = m_state->checked_index;
+    m_state->line_len = 0;
+    m_request.clear();
     m_linger = false;
     m_content_length = 0;
-    bzero(m_read_buf,READ_BUFFER_SIZE);
-    bzero(m_write_buf, READ_BUFFER_SIZE);
-    bzero(m_real_file, FILENAME_LEN);
+    m_range_count = 0;
+    m_mime = mime_html();
+    m_encoding = ENC_IDENTITY;
 }
 
-//关闭连接
+//关闭连接：释放连接占用的资源，取下定时器，从epoll中删除。socket不在这里关闭，
+//由事件循环在连接对象还给连接表之后关闭（见eventloop::close_conn）
 void http_conn::close_conn(){
-    if(m_sockfd != -1){
-        removefd(m_epollfd, m_sockfd);
-        m_sockfd = -1;
-        m_user_count--;//客户端总数减1
+    if(m_state->sockfd != -1){
+        unmap();    //响应没发完就关闭时，释放映射区/文件fd
+        m_write.clear();    //缓冲区还给段池
+        m_state->read_idx = 0;
+        release_read_buf();
+        if(m_wheel){
+            m_wheel->cancel(&m_state->timer);
+        }
+        if(!m_uring){
+            removefd(m_epollfd, m_state->sockfd);
+        }
+        m_state->sockfd = -1;
+        metrics::conn_closed();     //在线连接数-1
     }
 }
 
@@ -149,14 +199,18 @@ void http_conn::close_conn(){
 //循环读取客户数据，直到无数据可读或者对方关闭连接
 bool http_conn::read()
 {
-    if(m_read_idx >= READ_BUFFER_SIZE){
+    //没有缓冲区时借一个段；上次读满了还没解析出完整的请求（请求头太大），缓冲区翻倍
+    if(!reserve_read(1)){
         return false;
     }
 
     //读取到的字节
     int bytes_read = 0;
-    while(true){
-        bytes_read = recv(m_sockfd, m_read_buf+m_read_idx, READ_BUFFER_SIZE-m_read_idx, 0);//前面可能已经有数据读到缓冲区了，所以应该保存到缓冲区的m_read_buf+m_read_idx位置，缓冲区的剩余大小也就为READ_BUFFER_SIZE-m_read_idx
+    int old_idx = m_state->read_idx;
+    while(m_state->read_idx < m_state->read_size){
+        //缓冲区满了就先不读：流水线请求可能一次来很多，处理完一批腾出空间后，
+        //重新注册的EPOLLIN（ET模式下EPOLL_CTL_MOD也会重新检查）会再次触发
+        bytes_read = recv(m_state->sockfd, m_state->read_buf+m_state->read_idx, m_state->read_size-m_state->read_idx, 0);//前面可能已经有数据读到缓冲区了，所以应该保存到缓冲区的read_buf+read_idx位置，缓冲区的剩余大小也就为read_size-read_idx
         if(bytes_read == -1){
 		    if(errno == EAGAIN || errno == EWOULDBLOCK){
 			    //没有数据/读完，跳出循环
@@ -170,116 +224,394 @@ bool http_conn::read()
             return false;
         }
         //bytes_read>0 读到数据
-        //更新m_read_idx
-        m_read_idx += bytes_read;
+        //更新read_idx
+        m_state->read_idx += bytes_read;
     }
-    //若读到了数据，打印一下
-    if(m_read_buf){
-        std::cout<<"读到了数据:"<<std::endl<<m_read_buf<<std::endl;
-    }else{
-        std::cout<<"没有读到数据"<<std::endl;
+    if(m_state->read_idx > old_idx){
+        //请求的延迟从最后一次读到数据算起，这时请求才完整
+        m_recv_us = metrics::now_us();
+        if(m_trace){
+            m_trace->mark(TP_READ);
+        }
     }
+    //打印读到的数据（读缓冲区不一定以\0结尾，按长度打印）
+    LOG_DEBUG("读到了数据:\n%.*s", m_state->read_idx, m_state->read_buf);
     return true;
 }
 
-//非阻塞的分散写
-//写HTTP响应到客户端，此函数在main中被调用
+//非阻塞的写
+//写HTTP响应到客户端，此函数在事件循环中被调用（Reactor模式下工作线程直接调用write_batch）。
+//发完或EAGAIN后按write_batch的结果重新注册事件
 bool http_conn::write()
 {
-    std::cout<<"开始向客户端写数据"<<std::endl;
-    int temp= 0;
-    int bytes_have_send = 0; //已经发送的字节
-    int bytes_to_send = m_write_idx;//将要发送的字节（m_write_idx）写缓冲区中待发送的字节数
-
-    if(bytes_to_send == 0){
-        //将要发送的字节数为0，这一次响应结束
-        modfd(m_epollfd, m_sockfd, EPOLLIN);//由于用了EPOLLONESHOT，所以每次读写结束都要重新modfd
-        init();
+    LOG_DEBUG("开始向客户端写数据");
+    if(m_iv_count == 0){
+        //没有要发送的响应
+        modfd(m_epollfd, m_state->sockfd, EPOLLIN, m_et_mode);//由于用了EPOLLONESHOT，所以每次读写结束都要重新modfd
         return true;
     }
 
+    switch(write_batch()){
+        case WRITE_AGAIN:
+            // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
+            // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
+            LOG_DEBUG("写缓冲区没有空间，修改监听时间modfd为EPOLLOUT，继续监听直到写缓冲区可写");
+            modfd(m_epollfd, m_state->sockfd, EPOLLOUT, m_et_mode);
+            return true;
+        case WRITE_KEEPALIVE:
+            LOG_DEBUG("发送成功！继续监听...");
+            modfd(m_epollfd, m_state->sockfd, EPOLLIN, m_et_mode);
+            return true;
+        case WRITE_PROCESS:
+            //读缓冲区中还有请求，由事件循环交给线程池（request_pending），这时不能注册EPOLLIN
+            return true;
+        default:
+            return false;
+    }
+}
+
+/********************************************************************
+@FunName:http_conn::WRITE_STATUS http_conn::write_batch()
+@Input:  None
+@Output: None
+@Retuval:WRITE_AGAIN：TCP发送缓冲区满了还没发完。WRITE_KEEPALIVE/WRITE_PROCESS：发完了，保持连接。
+         WRITE_CLOSE：发完了不保持连接，或者发送出错
+@Notes:  一批流水线响应一起发：mmap模式：所有响应头和映射的文件一次writev；sendfile模式：文件前面的内存块用MSG_MORE发
+         （告诉内核后面还有数据，不要单独发一个小包），再sendfile发文件。两种模式都记录发送进度，EAGAIN后从断点继续。
+         不重新注册事件，由调用者（事件循环的write或Reactor模式的工作线程）按返回值决定
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/02 10:16:38
+********************************************************************/
+http_conn::WRITE_STATUS http_conn::write_batch()
+{
+    int temp = 0;
+    if(m_trace && !m_trace->tsc[TP_WRITE]){
+        m_trace->mark(TP_WRITE);    //EAGAIN后继续发送时不再记
+    }
+
     //轮询写
     while(1){
-        //分散写
-        std::cout<<"开始分散写..."<<std::endl;
-        std::cout<<"内存块m_write_buf(响应行+响应头)中数据："<<std::endl<<m_write_buf<<std::endl;
-        std::cout<<"内存块m_file_address(响应体)中数据："<<std::endl<<m_file_address<<std::endl;
-        temp = Writev(m_sockfd, m_iv, m_iv_count);
+        while(m_iv_idx < m_iv_count && m_iv[m_iv_idx].iov_len == 0){
+            m_iv_idx++;
+        }
+        if(m_iv_idx == m_iv_count){
+            // 这一批HTTP响应发送成功，根据最后一个请求的Connection字段决定是否立即关闭连接
+            bool linger = m_batch_linger;
+            finish_batch();
+            if(linger){
+                return m_state->parse_pending ? WRITE_PROCESS : WRITE_KEEPALIVE;
+            }
+            return WRITE_CLOSE;
+        }
+
+        int i = m_iv_idx;
+        bool is_file = m_iv_file[i] != -1;
+        if(is_file){
+            temp = Sendfile(m_state->sockfd, m_iv_file[i], &m_iv_offset[i], m_iv[i].iov_len);
+        }else{
+            //从i开始连续的内存块一起发，后面跟着文件时加MSG_MORE
+            int n = i;
+            while(n < m_iv_count && m_iv_file[n] == -1){
+                n++;
+            }
+            if(n < m_iv_count){
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = m_iv + i;
+                msg.msg_iovlen = n - i;
+                temp = sendmsg(m_state->sockfd, &msg, MSG_MORE);
+            }else{
+                temp = Writev(m_state->sockfd, m_iv + i, n - i);
+            }
+        }
+
         if ( temp <= -1 ) {
-            // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
-            // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
+            if(errno == EINTR){
+                continue;
+            }
             if( errno == EAGAIN ) {
-                std::cout<<"写缓冲区没有空间，修改监听时间modfd为EPOLLOUT，继续监听直到写缓冲区可写"<<std::endl;
-                modfd( m_epollfd, m_sockfd, EPOLLOUT );
-                return true;
+                return WRITE_AGAIN;
+            }
+            LOG_WARN("发送失败！%s", strerror(errno));
+            unmap();//否则说明发送失败，先释放响应体
+            return WRITE_CLOSE;
+        }
+        metrics::sent(temp);
+        if(is_file){
+            if(temp == 0){
+                //文件在发送过程中被截短了，Content-Length已经发出去，只能关闭连接
+                LOG_WARN("发送失败！文件被截短");
+                unmap();
+                return WRITE_CLOSE;
             }
-            std::cout<<"发送失败！(分散写失败)"<<std::endl;
-            unmap();//否则说明发送失败，先关闭mmap映射，然后return false
+            m_iv[i].iov_len -= temp;
+        }else{
+            advance_iov(temp);
+        }
+    }
+}
+
+//m_iv已发出bytes字节，推进m_iv。writev/send可能只写出一部分，剩下的从断点继续发
+bool http_conn::advance_iov(int bytes)
+{
+    for(; m_iv_idx < m_iv_count; m_iv_idx++){
+        int n = (size_t)bytes < m_iv[m_iv_idx].iov_len ? bytes : m_iv[m_iv_idx].iov_len;
+        m_iv[m_iv_idx].iov_base = (char*)m_iv[m_iv_idx].iov_base + n;
+        m_iv[m_iv_idx].iov_len -= n;
+        bytes -= n;
+        if(m_iv[m_iv_idx].iov_len > 0){
             return false;
         }
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
-        if ( bytes_to_send <= bytes_have_send ) {
-            // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
-            unmap();
-            if(m_linger) {
-                std::cout<<"发送成功！继续监听..."<<std::endl;
-                init();
-                modfd( m_epollfd, m_sockfd, EPOLLIN );
-                return true;
-            } else {
-                modfd( m_epollfd, m_sockfd, EPOLLIN );
-                return false;
-            } 
+    }
+    return true;
+}
+
+/********************************************************************
+@FunName:bool http_conn::add_to_batch()
+@Input:  None
+@Output: None
+@Retuval:true：加入成功。false：m_iv放不下
+@Notes:  响应头接在上一块之后时合并成一块（连续的错误响应只占一个iovec）。
+         响应体：mmap模式是映射的内存，sendfile模式记下文件fd和偏移，Range请求只取文件中的区间。
+         多区间响应的响应头在m_part_pos处切开，每个区间的文件数据插在对应部分的头后面。
+         文件移到m_files，这一批发完后一起release
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/28 10:42:19
+********************************************************************/
+bool http_conn::add_to_batch()
+{
+    int pieces = !m_file ? 0 : (m_range_count > 0 ? m_range_count : 1);
+    if(m_iv_count + 2 * pieces + 1 > MAX_IOV){
+        return false;
+    }
+    buf_segment* seg = m_write.tail();
+    char* base = seg->data + m_resp_start;
+    int len = seg->len - m_resp_start;
+    if(!m_file){
+        add_mem_iov(base, len);
+        return true;
+    }
+    if(m_range_count == 0){
+        add_mem_iov(base, len);
+        add_file_iov(0, m_file_stat.st_size);
+    }else if(m_range_count == 1){
+        add_mem_iov(base, len);
+        add_file_iov(m_ranges[0].first, m_ranges[0].len);
+    }else{
+        int pos = 0;
+        for(int i = 0; i < m_range_count; i++){
+            add_mem_iov(base + pos, m_part_pos[i] - pos);
+            add_file_iov(m_ranges[i].first, m_ranges[i].len);
+            pos = m_part_pos[i];
         }
+        add_mem_iov(base + pos, len - pos);     //结束分隔符
     }
-    std::cout<<"发送成功！"<<std::endl;
+    m_files[m_file_count++] = m_file;
+    m_file = 0;
+    m_file_address = 0;
+    m_file_fd = -1;
     return true;
 }
 
+//写缓冲区中的一块加入m_iv，紧接在上一块内存之后时合并
+void http_conn::add_mem_iov(const char* base, int len)
+{
+    struct iovec* last = m_iv_count > 0 ? m_iv + m_iv_count - 1 : NULL;
+    if(last && m_iv_file[m_iv_count - 1] == -1 && (char*)last->iov_base + last->iov_len == base){
+        last->iov_len += len;
+    }else{
+        m_iv[m_iv_count].iov_base = (void*)base;    //writev不会写这块内存，错误响应的常量也可以放进来
+        m_iv[m_iv_count].iov_len = len;
+        m_iv_file[m_iv_count] = -1;
+        m_iv_count++;
+    }
+}
+
+//当前文件从first开始的len字节加入m_iv
+void http_conn::add_file_iov(off_t first, off_t len)
+{
+    if(m_file_fd != -1){
+        //sendfile模式：iov_len记剩余长度，在write()中用sendfile从m_iv_offset发
+        m_iv[m_iv_count].iov_base = NULL;
+        m_iv_file[m_iv_count] = m_file_fd;
+        m_iv_offset[m_iv_count] = first;
+    }else{
+        m_iv[m_iv_count].iov_base = m_file_address + first;
+        m_iv_file[m_iv_count] = -1;
+    }
+    m_iv[m_iv_count].iov_len = len;
+    m_iv_count++;
+}
+
+//这一批响应发完：记下这一批请求的延迟，释放文件，清空m_iv和写缓冲区，准备下一批
+void http_conn::finish_batch()
+{
+    if(m_batch_responses > 0){
+        if(m_trace){
+            m_trace->mark(TP_SENT);
+            m_trace->emit(m_state->sockfd, m_batch_responses);
+        }
+        metrics::latency(metrics::now_us() - m_batch_start, m_batch_responses);
+        m_batch_responses = 0;
+    }
+    m_body.clear();
+    unmap();
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_write.clear();
+    m_resp_start = 0;
+    if(m_state->read_idx == 0){
+        release_read_buf();     //没有流水线请求剩下，读缓冲区也还回去，下一个请求来了再借
+    }
+}
+
+//把读缓冲区中当前请求（还没处理完的部分）移到开头。已解析出的view都是偏移，一起平移
+void http_conn::compact()
+{
+    int delta = m_state->request_start;
+    if(delta == 0){
+        return;
+    }
+    memmove(m_state->read_buf, m_state->read_buf + delta, m_state->read_idx - delta);
+    m_state->read_idx -= delta;
+    m_state->checked_index -= delta;
+    m_state->start_line -= delta;
+    m_state->request_start = 0;
+    m_request.shift(-delta);
+}
 
-//主状态机 解析HTTP请求（解析m_read_buf中的数据）
+/********************************************************************
+@FunName:bool http_conn::reserve_read(int len)
+@Input:  len：要再放进读缓冲区的字节数
+@Output: None
+@Retuval:true：放得下。false：超过MAX_READ_BUFFER_SIZE
+@Notes:  没有读缓冲区时从段池借一个段。不够时大小翻倍（改用malloc，一般只有带大Cookie的请求会走到），
+         拷贝已有的数据，解析出的view都是偏移，不用改
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/29 10:31:05
+********************************************************************/
+bool http_conn::reserve_read(int len)
+{
+    if(!m_state->read_buf){
+        m_state->read_seg = segment_pool::get();
+        m_state->read_buf = m_state->read_seg->data;
+        m_state->read_size = buf_segment::SIZE;
+    }
+    if(m_state->read_size - m_state->read_idx >= len){
+        return true;
+    }
+    int size = m_state->read_size;
+    while(size - m_state->read_idx < len){
+        size *= 2;
+    }
+    if(size > MAX_READ_BUFFER_SIZE){
+        return false;
+    }
+    char* buf = (char*)malloc(size);
+    if(!buf){
+        return false;
+    }
+    memcpy(buf, m_state->read_buf, m_state->read_idx);
+    if(m_state->read_seg){
+        segment_pool::put(m_state->read_seg);
+        m_state->read_seg = NULL;
+    }else{
+        free(m_state->read_buf);
+    }
+    m_state->read_buf = buf;
+    m_state->read_size = size;
+    return true;
+}
+
+//读缓冲区中没有数据时还回去（段还给段池，翻倍后malloc的内存直接free）
+void http_conn::release_read_buf()
+{
+    if(!m_state->read_buf || m_state->read_idx != 0){
+        return;
+    }
+    if(m_state->read_seg){
+        segment_pool::put(m_state->read_seg);
+        m_state->read_seg = NULL;
+    }else{
+        free(m_state->read_buf);
+    }
+    m_state->read_buf = NULL;
+    m_state->read_size = 0;
+}
+
+//把io_uring收到的数据追加到读缓冲区（相当于read()中recv的那一步，由内核完成）
+bool http_conn::feed(const char* data, int len)
+{
+    if(!reserve_read(len)){
+        return false;
+    }
+    memcpy(m_state->read_buf + m_state->read_idx, data, len);
+    m_state->read_idx += len;
+    m_recv_us = metrics::now_us();
+    if(m_trace){
+        m_trace->mark(TP_READ);
+    }
+    return true;
+}
+
+//io_uring的writev完成了bytes字节，推进m_iv。writev可能只写出一部分，剩下的从断点继续发
+http_conn::WRITE_STATUS http_conn::written(int bytes)
+{
+    metrics::sent(bytes);
+    if(!advance_iov(bytes)){
+        return WRITE_AGAIN;
+    }
+    // 这一批HTTP响应发送成功，根据最后一个请求的Connection字段决定是否立即关闭连接
+    bool linger = m_batch_linger;
+    finish_batch();
+    if(linger){
+        return m_state->parse_pending ? WRITE_PROCESS : WRITE_KEEPALIVE;
+    }
+    return WRITE_CLOSE;
+}
+
+//主状态机 解析HTTP请求（解析读缓冲区中的数据）
 http_conn::HTTP_CODE http_conn::process_read()
 {
     LINE_STATUS line_status = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
 
-    char * text = 0; 
-    while(((m_check_state == CHECK_STATE_CONTENT) && (line_status == LINE_OK))
-            || ((line_status = parse_line()) == LINE_OK)){
+    const char * text = 0;
+    //请求体不按行解析：在CHECK_STATE_CONTENT状态下不调用parse_line，否则它会把checked_index推过请求体
+    while(((m_state->check_state == CHECK_STATE_CONTENT) && (line_status == LINE_OK))
+            || ((m_state->check_state != CHECK_STATE_CONTENT) && ((line_status = parse_line()) == LINE_OK))){
         //解析到了一行完整的数据，或者解析到了请求体，也是完整的数据
 
         //获取一行数据
         text = get_line();
 
-        m_start_line = m_checked_index;//行起始位置更新
-        std::cout<<"获取到一行HTTP数据:"<<text<<std::endl;
+        m_state->start_line = m_state->checked_index;//行起始位置更新
+        LOG_DEBUG("获取到一行HTTP数据:%.*s", m_state->line_len, text);
 
-        switch(m_check_state){
+        switch(m_state->check_state){
             case CHECK_STATE_REQUESTLINE:
             {
-                ret = prase_request_line(text);
+                ret = prase_request_line(text, m_state->line_len);
                 if(ret == BAD_REQUEST){
                     return BAD_REQUEST;
                 }
                 // std::cout<<"获取到请求行："<<std::endl;
-                // std::cout<<"m_url:"<<m_url<<std::endl;
-                // std::cout<<"m_version:"<<m_version<<std::endl;
-                // std::cout<<"m_method:"<<m_method<<std::endl;
                 break;
             }
 
             case CHECK_STATE_HEADER:
             {
-                ret = prase_request_head(text);
-                // std::cout<<"获取到请求头："<<text<<std::endl;
-                // std::cout<<"Connection::"<<m_linger<<std::endl;
-                // std::cout<<"Connection-Length:"<<m_content_length<<std::endl;
-                // std::cout<<"Host:"<<m_host<<std::endl;
+                ret = prase_request_head(text, m_state->line_len);
                 if(ret == BAD_REQUEST){
                     return BAD_REQUEST;
                 }else if(ret == GET_REQUEST){
-                    std::cout<<"获取完成, 开始具体解析"<<std::endl;
+                    LOG_DEBUG("获取完成, 开始具体解析");
+                    if(m_trace){
+                        m_trace->mark(TP_PARSED);
+                    }
                     return do_request();//解析具体的信息
                 }
                 break;   
@@ -288,8 +620,13 @@ http_conn::HTTP_CODE http_conn::process_read()
             case CHECK_STATE_CONTENT:
             {
                 ret = prase_request_content(text);
-                if(ret == GET_REQUEST){ //如果解析完了
-                    std::cout<<"获取完成, 开始具体解析"<<std::endl;
+                if(ret == BAD_REQUEST){
+                    return BAD_REQUEST;
+                }else if(ret == GET_REQUEST){ //如果解析完了
+                    LOG_DEBUG("获取完成, 开始具体解析");
+                    if(m_trace){
+                        m_trace->mark(TP_PARSED);
+                    }
                     return do_request();//解析具体的信息
                 }
                 //否则就是有问题
@@ -306,344 +643,871 @@ http_conn::HTTP_CODE http_conn::process_read()
     return NO_REQUEST;//若到此还没获取到信息，则说明请求不完整
 }
 
-//解析HTTP请求首行，获得请求方法，目标URL，HTTP版本
-http_conn::HTTP_CODE http_conn::prase_request_line(char * text){
-    //GET /index.html HTTP/1.1
-    m_url = strpbrk(text, " \t");//strpbrk:判断空格和\t哪一个在text中先出现，（空格先出现，返回空格的索引）
+//在[p, end)中找第一个空格或\t，没有返回end
+static const char* find_blank(const char* p, const char* end)
+{
+    while(p < end && *p != ' ' && *p != '\t'){
+        ++p;
+    }
+    return p;
+}
 
-    //GET\0/index.html HTTP/1.1
-    *m_url++ = '\0';
+//解析HTTP请求首行，获得请求方法，目标URL，HTTP版本。只记录它们在读缓冲区中的位置，不修改读缓冲区
+http_conn::HTTP_CODE http_conn::prase_request_line(const char * text, int len){
+    //GET /index.html HTTP/1.1
+    const char * end = text + len;
+    const char * url = find_blank(text, end);   //方法后面的第一个空格或\t
+    if(url == end){
+        return BAD_REQUEST;
+    }
 
-    //GET\0
-    char * method = text;
-    if(strcasecmp(method, "GET") == 0){ //只判断了GET
+    //GET
+    m_request.method.off = text - m_state->read_buf;
+    m_request.method.len = url - text;
+    if(view_equal(m_state->read_buf, m_request.method, "GET")){ //只判断了GET
         m_method = GET;
     }else{
         return BAD_REQUEST;
     }
 
     // /index.html HTTP/1.1
-    m_version = strpbrk(m_url, " \t");
-    if(!m_version){
+    url++;
+    const char * version = find_blank(url, end);
+    if(version == end){
         return BAD_REQUEST;
     }
-    // /index.html\0HTTP/1.1
-    *m_version++ = '\0';
-    if(strcasecmp(m_version, "HTTP/1.1") != 0){
+    // HTTP/1.1
+    m_request.version.off = version + 1 - m_state->read_buf;
+    m_request.version.len = end - (version + 1);
+    if(!view_equal(m_state->read_buf, m_request.version, "HTTP/1.1")){
         return BAD_REQUEST;
     }
 
     // http://192.168.1.1:10000/index.html
-    if(strncasecmp(m_url, "http://", 7) == 0){
-        m_url += 7; // 192.168.1.1:10000/index.html 
-        m_url = strchr(m_url, '/');// /index.html 
+    if(version - url >= 7 && strncasecmp(url, "http://", 7) == 0){
+        url += 7; // 192.168.1.1:10000/index.html
+        url = (const char*)memchr(url, '/', version - url);// /index.html
     }
-    if(!m_url || m_url[0] != '/'){
+    if(!url || url == version || url[0] != '/'){
         return BAD_REQUEST;
     }
+    m_request.url.off = url - m_state->read_buf;
+    m_request.url.len = version - url;
 
-    m_check_state = CHECK_STATE_HEADER; //已经解析完请求行，改变主状态机状态为检查请求头
+    m_state->check_state = CHECK_STATE_HEADER; //已经解析完请求行，改变主状态机状态为检查请求头
 
     return NO_REQUEST;  //虽然到此解析完了请求行，但还没有将完整的客户请求解析完，所以还是return NO_REQUEST
 }
 
+//已知请求头的处理函数，下标是HEADER_ID。只需要记下值的请求头（Host、If-None-Match、Range等）为NULL，
+//值在m_request.known中，生成响应时再用
+const http_conn::header_handler http_conn::m_header_handlers[HDR_NUM] = {
+    NULL,                               //HDR_UNKNOWN
+    NULL,                               //HDR_HOST
+    &http_conn::on_connection,          //HDR_CONNECTION
+    &http_conn::on_content_length,      //HDR_CONTENT_LENGTH
+    NULL,                               //HDR_IF_NONE_MATCH
+    NULL,                               //HDR_IF_MODIFIED_SINCE
+    NULL,                               //HDR_IF_RANGE
+    NULL,                               //HDR_RANGE
+    NULL,                               //HDR_ACCEPT_ENCODING
+    NULL,                               //HDR_COOKIE
+};
+static_assert(HDR_COOKIE + 1 == HDR_NUM, "HEADER_ID增加了，m_header_handlers也要加");
+
 //解析HTTP请求头
-http_conn::HTTP_CODE http_conn::prase_request_head(char * text)
+//每个请求头记录成（字段名，字段值）两个view放进m_request.headers。
+//用scan_char找到':'后，lookup_header一次哈希识别已知请求头（http_header.h），记到m_request.known并调用对应的处理函数，
+//不认识的请求头只多一次哈希和最多一次比较
+http_conn::HTTP_CODE http_conn::prase_request_head(const char * text, int len)
 {
     //遇到空行，表示头部解析完成
-    if(text[0] == '\0'){
+    if(len == 0){
         //若HTTP请求有消息体，则还需要读取m_content_length字节的消息体
         //状态机转移到CHECK_STATE_CONTENT状态
         if( m_content_length != 0){
-            m_check_state = CHECK_STATE_CONTENT;
+            m_state->check_state = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
         //否则说明我们已经得到了一个完整的HTTP请求
         return GET_REQUEST;
-    } else if(strncasecmp(text, "Connection:", 11) == 0){
-        //处理Connection 头部字段 Connection: keep-alive
-        text += 11;
-        text += strspn(text, " \t");    //strspn返回字符串中第一个不在指定字符串中出现的字符下标,即若text开头有\t，则跳过
-        if(strcasecmp(text, "keep-alive") == 0){
-            m_linger = true;
-        }
-    } else if(strncasecmp(text, "Content-Length:", 15) == 0){
-        //处理Content-Length字段
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text); //char转为long int
-    } else if(strncasecmp(text, "Host:", 5) == 0){
-        //处理Host头部字段
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    } else{
-        //获取到其他字段，暂不处理
-        //std::cout<<"oop! 其他字段，无法识别: "<<text<<std::endl;
+    }
+
+    //找不到':'的行按其他字段忽略
+    const char* end = text + len;
+    const char* colon = scan_char(text, end, ':');
+    if(colon == end){
+        return NO_REQUEST;
+    }
+    //字段值去掉首尾的空格和\t
+    const char* value = colon + 1;
+    while(value < end && (*value == ' ' || *value == '\t')){
+        value++;
+    }
+    while(end > value && (end[-1] == ' ' || end[-1] == '\t')){
+        end--;
+    }
+    http_view name_view = {(int)(text - m_state->read_buf), (int)(colon - text)};
+    http_view value_view = {(int)(value - m_state->read_buf), (int)(end - value)};
+    m_request.add_header(name_view, value_view);
+
+    HEADER_ID id = lookup_header(text, name_view.len);
+    if(id == HDR_UNKNOWN){
+        //获取到其他字段，暂不处理，需要时用m_request.find()取
+        return NO_REQUEST;
+    }
+    m_request.known[id] = value_view;
+    if(m_header_handlers[id]){
+        return (this->*m_header_handlers[id])(value_view);
     }
     return NO_REQUEST;
 }
 
+//处理Connection 头部字段 Connection: keep-alive
+http_conn::HTTP_CODE http_conn::on_connection(http_view value)
+{
+    if(view_equal(m_state->read_buf, value, "keep-alive")){
+        m_linger = true;
+    }
+    return NO_REQUEST;
+}
+
+//处理Content-Length字段，只允许十进制数字（读缓冲区中没有\0结尾，不能用atol）。
+//请求体要整个放进读缓冲区，超过MAX_READ_BUFFER_SIZE按错误处理；每加一位就检查，数字再长也不会溢出
+http_conn::HTTP_CODE http_conn::on_content_length(http_view value)
+{
+    if(value.len == 0){
+        return BAD_REQUEST;
+    }
+    long length = 0;
+    const char* p = view_data(value);
+    for(int i = 0; i < value.len; i++){
+        if(p[i] < '0' || p[i] > '9'){
+            return BAD_REQUEST;
+        }
+        length = length * 10 + (p[i] - '0');
+        if(length > MAX_READ_BUFFER_SIZE){
+            return BAD_REQUEST;
+        }
+    }
+    m_content_length = length;
+    return NO_REQUEST;
+}
+
 //解析HTTP请求体
-//其实并没有真正的去解析请求体，只是判断它是否被完整的读入了
-http_conn::HTTP_CODE http_conn::prase_request_content(char * text)
+//其实并没有真正的去解析请求体，只是判断它是否被完整的读入了。checked_index停在请求体开头
+http_conn::HTTP_CODE http_conn::prase_request_content(const char * text)
 {
-    //一行一行的读取请求体，直到读到请求体最后一行（当m_read_idx >= (m_content_length + m_checked_index)时就是最后一行）
-    //此时说明请求体已全部读到，return GET_REQUEST
-    if( m_read_idx >= (m_content_length + m_checked_index)){
-        text[m_content_length] = '\0';
+    //请求头加请求体要整个放进读缓冲区（compact后请求从开头放），放不下的请求永远读不完，按错误处理
+    if(m_content_length > MAX_READ_BUFFER_SIZE - (m_state->checked_index - m_state->request_start)){
+        return BAD_REQUEST;
+    }
+    //读缓冲区中请求体开头之后的数据够m_content_length字节时，请求体已全部读到，return GET_REQUEST
+    if(m_content_length <= m_state->read_idx - m_state->checked_index){
+        m_request.body.off = text - m_state->read_buf;
+        m_request.body.len = m_content_length;
+        m_state->checked_index += m_content_length;    //下一个流水线请求从请求体后面开始
         return GET_REQUEST;
     }
     return NO_REQUEST;
 }
 
 //解析一行(获取一行），根据\r\n来判断
+//行结束符用scan_line_end一次16/32字节地找（见line_scan.h），找到之后的判断与原来逐字节的版本相同
 http_conn::LINE_STATUS http_conn::parse_line(){
-    // std::cout<<"开始解析一行（将每行数据按“\\0”分隔开"<<std::endl;
-    char temp;
-    // std::cout<<"m_checked_index:"<<m_checked_index<<std::endl;
-    // std::cout<<"m_read_idx:"<<m_read_idx<<std::endl;
-    for(; m_checked_index < m_read_idx; ++m_checked_index){
-        temp = m_read_buf[m_checked_index];
-        if(temp == '\r'){
-            if((m_checked_index + 1) == m_read_idx){
-                //解析的当前字符是\r，且当前读缓冲区没有数据了，则认为是不完整的
-                std::cout<<"LINE_OPEN1"<<std::endl;
-                return LINE_OPEN;
-            }else if(m_read_buf[m_checked_index+1] == '\n'){
-                //说明是'\r\n'，则将 m_read_buf[m_checked_index]以及m_read_buf[m_checked_index+1]置为字符串结束符\0，最后m_checked_index指向下一行数据的第一个元素
-                m_read_buf[m_checked_index++] = '\0';
-                m_read_buf[m_checked_index++] = '\0';
-                return LINE_OK;
-            }
-            std::cout<<"LINE_BAD1"<<std::endl;
-            return LINE_BAD;//其余情况出错
-        }else if(temp == '\n'){
-            //说明上一次检查最后一个字符为'\r'，再有数据来的时候就是'\n'
-            if((m_checked_index >1) && (m_read_buf[m_checked_index - 1] == '\r')){
-                m_read_buf[m_checked_index - 1] = '\0';
-                m_read_buf[m_checked_index++] = '\0';   //先将\n置为\0，再将m_checked_index+1
-                return LINE_OK;
-            }
-            std::cout<<"LINE_BAD2"<<std::endl;
-            return LINE_BAD;//其余情况出错（上一个字符不是\r）
+    const char* hit = scan_line_end(m_state->read_buf + m_state->checked_index, m_state->read_buf + m_state->read_idx);
+    m_state->checked_index = hit - m_state->read_buf;
+    if(m_state->checked_index >= m_state->read_idx){
+        LOG_DEBUG("LINE_OPEN2");
+        return LINE_OPEN;
+    }
+    if(*hit == '\r'){
+        if((m_state->checked_index + 1) == m_state->read_idx){
+            //解析的当前字符是\r，且当前读缓冲区没有数据了，则认为是不完整的
+            LOG_DEBUG("LINE_OPEN1");
+            return LINE_OPEN;
+        }else if(m_state->read_buf[m_state->checked_index+1] == '\n'){
+            //说明是'\r\n'，记下行的长度，checked_index指向下一行数据的第一个元素。读缓冲区不做修改
+            m_state->line_len = m_state->checked_index - m_state->start_line;
+            m_state->checked_index += 2;
+            return LINE_OK;
         }
+        LOG_DEBUG("LINE_BAD1");
+        return LINE_BAD;//其余情况出错
+    }
+    //说明上一次检查最后一个字符为'\r'，再有数据来的时候就是'\n'
+    //（'\r'必须属于当前行，上一行结尾的\r\n后面紧跟的'\n'是错误的）
+    if((m_state->checked_index > m_state->start_line) && (m_state->read_buf[m_state->checked_index - 1] == '\r')){
+        m_state->line_len = m_state->checked_index - 1 - m_state->start_line;
+        m_state->checked_index++;
+        return LINE_OK;
     }
-    std::cout<<"LINE_OPEN2"<<std::endl;
-    return LINE_OPEN;
+    LOG_DEBUG("LINE_BAD2");
+    return LINE_BAD;//其余情况出错（上一个字符不是\r）
+}
+
+//取文件失败时的errno对应的响应
+static http_conn::HTTP_CODE file_error(int err)
+{
+    if(err == ENOENT || err == ENOTDIR || err == ENAMETOOLONG){
+        return http_conn::NO_RESOURCE;
+    }else if(err == EACCES){
+        return http_conn::FORBIDDEN_REQUEST;   //其他用户不可读
+    }else if(err == EISDIR){
+        return http_conn::BAD_REQUEST;         //是目录
+    }
+    return http_conn::INTERNAL_ERROR;
+}
+
+//process_write生成的响应的状态码，记指标用
+static int response_status(http_conn::HTTP_CODE code)
+{
+    switch(code){
+        case http_conn::FILE_REQUEST:
+        case http_conn::METRICS_REQUEST:
+            return 200;
+        case http_conn::PARTIAL_CONTENT:
+            return 206;
+        case http_conn::NOT_MODIFIED:
+            return 304;
+        case http_conn::BAD_REQUEST:
+            return 400;
+        case http_conn::FORBIDDEN_REQUEST:
+            return 403;
+        case http_conn::NO_RESOURCE:
+            return 404;
+        case http_conn::RANGE_NOT_SATISFIABLE:
+            return 416;
+        default:
+            return 500;
+    }
+}
+
+/********************************************************************
+@FunName:bool http_conn::not_modified(const file_validator& v)
+@Input:  v：目标文件的验证器
+@Output: None
+@Retuval:true：客户端缓存的就是最新的，回304
+@Notes:  按RFC 7232：有If-None-Match时只看它（弱比较），忽略If-Modified-Since；
+         否则If-Modified-Since的时间不早于文件的mtime时成立，日期格式不对时忽略
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/01 11:20:36
+********************************************************************/
+bool http_conn::not_modified(const file_validator& v)
+{
+    http_view inm = m_request.known[HDR_IF_NONE_MATCH];
+    if(inm.off >= 0){
+        return etag_list_match(view_data(inm), inm.len, v.etag, true);
+    }
+    http_view ims = m_request.known[HDR_IF_MODIFIED_SINCE];
+    time_t since;
+    return ims.off >= 0 && parse_http_date(view_data(ims), ims.len, since) && v.mtime <= since;
+}
+
+//If-Range是实体标签时按强比较，是日期时要和Last-Modified相同。没有If-Range时Range总是有效
+bool http_conn::range_applies()
+{
+    http_view ir = m_request.known[HDR_IF_RANGE];
+    if(ir.off < 0){
+        return true;
+    }
+    const char* p = view_data(ir);
+    if(ir.len > 0 && p[0] == '"'){
+        return etag_list_match(p, ir.len, m_file->valid.etag, false);
+    }
+    time_t t;
+    return parse_http_date(p, ir.len, t) && t == m_file->valid.mtime;
 }
 
 //当得到一个完整的、正确的HTTP请求时，我们就分析目标文件的属性，
-//如果目标文件存在，对所有用户可读，且不是目录，则使用mmap将其
-//映射到内存地址m_file_address中，并告诉调用者获取文件成功
+//如果目标文件存在，对所有用户可读，且不是目录，则从打开文件缓存中取出它的映射（或fd），
+//并告诉调用者获取文件成功。热点文件命中缓存时没有任何文件系统调用。
+//带If-None-Match/If-Modified-Since且文件没变时返回NOT_MODIFIED，不取文件；带Range时返回PARTIAL_CONTENT或RANGE_NOT_SATISFIABLE
 http_conn::HTTP_CODE http_conn::do_request(){
+    //内置的指标页面，不对应文件
+    if(m_request.url.len == sizeof(METRICS_PATH) - 1 && memcmp(view_data(m_request.url), METRICS_PATH, m_request.url.len) == 0){
+        return METRICS_REQUEST;
+    }
     // "/home/xiaodexin/桌面/MyProject2_WebServer"
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    strncpy(m_real_file + len, m_url, FILENAME_LEN - len -1);
-    // 获取m_real_file文件的相关的状态信息，-1失败，0成功
-    if(Stat(m_real_file, &m_file_stat) < 0){
-        return NO_REQUEST;
+    memcpy(m_real_file, doc_root, DOC_ROOT_LEN);
+    int len = DOC_ROOT_LEN;
+    //url在读缓冲区中没有\0结尾，按长度拷贝；拼起来超长的按文件不存在处理，不截断（截断后可能指向别的文件）
+    if(m_request.url.len > FILENAME_LEN - len - 1){
+        return NO_RESOURCE;
     }
-
-    //判断访问权限
-    if(!(m_file_stat.st_mode & S_IROTH)){
-        return FORBIDDEN_REQUEST;
+    memcpy(m_real_file + len, view_data(m_request.url), m_request.url.len);
+    m_real_file[len + m_request.url.len] = '\0';
+
+    m_mime = mime_type(m_real_file);     //错误响应是常量，不用这个类型
+    //Accept-Encoding协商。Range请求的区间是按原文件说的，这时不压缩
+    CONTENT_ENCODING enc = ENC_IDENTITY;
+    if(m_mime->compressible && m_request.has(HDR_ACCEPT_ENCODING) && !m_request.has(HDR_RANGE)){
+        http_view ae = m_request.known[HDR_ACCEPT_ENCODING];
+        enc = choose_encoding(view_data(ae), ae.len);
     }
 
-    //判断是否是目录
-    if(S_ISDIR(m_file_stat.st_mode)){
-        return BAD_REQUEST;
+    int err = 0;
+    //条件GET：先只取验证器（缓存命中时没有系统调用，未命中时只stat一次），条件成立就回304，不打开也不映射文件。
+    //协商出压缩编码时客户端缓存的可能是压缩变体也可能是原文件（变体还没生成时发的），两个ETag都认
+    if(m_request.has(HDR_IF_NONE_MATCH) || m_request.has(HDR_IF_MODIFIED_SINCE)){
+        if(!file_cache::get_instance()->probe(m_real_file, m_validator, err)){
+            return file_error(err);
+        }
+        if(enc != ENC_IDENTITY){
+            file_validator v = m_validator;
+            compress_cache::to_variant(v, enc);
+            if(not_modified(v)){
+                m_validator = v;
+                return NOT_MODIFIED;
+            }
+        }
+        if(not_modified(m_validator)){
+            return NOT_MODIFIED;
+        }
     }
-
-    //以只读方式打开文件
-    int fd = Open(m_real_file, O_RDONLY);
-    //创建内存映射
-    m_file_address = (char*)Mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);    //mmap:使一个磁盘文件与存储空间中的一个缓冲区相映射
-    Close(fd);
-    std::cout<<"解析到的请求文件的路径m_real_file："<<m_real_file<<std::endl<<"解析请求完成！"<<std::endl;
+    m_file = file_cache::get_instance()->acquire(m_real_file, err);
+    if(!m_file){
+        return file_error(err);
+    }
+    //换成压缩变体（第一次请求时在这里压缩，以后直接从缓存取），没有变体时发原文件
+    if(enc != ENC_IDENTITY){
+        file_entry* variant = compress_cache::get_instance()->acquire(m_file, enc);
+        if(variant){
+            file_cache::get_instance()->release(m_file);
+            m_file = variant;
+            m_encoding = enc;
+        }
+    }
+    m_file_stat = m_file->st;
+    if(m_sendfile_mode && m_file->fd != -1){
+        //sendfile模式：用缓存中的fd，发送时由内核直接从页缓存拷贝到socket，偏移量每个响应自己记（m_iv_offset）
+        m_file_fd = m_file->fd;
+    }else{
+        //mmap模式，或者压缩变体（只在内存中）
+        m_file_address = m_file->addr;
+    }
+    //Range：只发文件的一部分，和整个文件一样走m_iv（映射中的一段，或sendfile的起始偏移），不拷贝
+    if(m_request.has(HDR_RANGE) && range_applies()){
+        http_view range = m_request.known[HDR_RANGE];
+        int n = parse_range(view_data(range), range.len, m_file_stat.st_size, m_ranges, MAX_RANGES);
+        if(n == 0){
+            unmap();    //416没有响应体
+            return RANGE_NOT_SATISFIABLE;
+        }
+        if(n > 0){
+            m_range_count = n;
+            LOG_DEBUG("Range请求：%d个区间", n);
+            return PARTIAL_CONTENT;
+        }
+    }
+    LOG_DEBUG("解析到的请求文件的路径m_real_file：%s 解析请求完成！", m_real_file);
     return FILE_REQUEST;
 
 }
 
 //根据服务器处理HTTP请求的结果，决定返回给客户端的内容
 //这个函数其实是生成对应的响应，真正的写回客户端是在write()函数中实现的，该函数在main中被调用
+//响应头由预生成的常量块拼成（http_response.h），每一行只是一次memcpy；错误响应是完整的常量，直接加入这一批
 bool http_conn::process_write(HTTP_CODE read_ret){
+    //这个响应的响应头从写缓冲区最后一个段的这里开始，前面是同一批中前面的响应
+    m_resp_start = m_write.empty() ? 0 : m_write.tail()->len;
     switch(read_ret)
     {
         case INTERNAL_ERROR:
         {
-            std::cout<<"服务器内部错误！"<<std::endl;
-            add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_form));
-            if(!add_content(error_500_form)){//出错的话响应体也发错误信息
+            LOG_WARN("服务器内部错误！");
+            return add_error(500);
+        }
+        case BAD_REQUEST:
+        {
+            LOG_DEBUG("请求的文件不存在或请求命令错误！");
+            return add_error(400);
+        }
+        case NO_RESOURCE:
+        {
+            LOG_DEBUG("404 Not found! 请求的文件不存在");
+            return add_error(404);
+        }
+        case FORBIDDEN_REQUEST:
+        {
+            LOG_DEBUG("没有访问该文件的权限！");
+            return add_error(403);
+        }
+        case FILE_REQUEST:
+        {
+            LOG_DEBUG("开始生成响应...");
+            if(!(add_status_line(200) && add_validators(m_file->valid) && add_encoding()
+                && append(ACCEPT_RANGES_HEADER) && add_headers(m_file_stat.st_size))){
                 return false;
             }
             break;
         }
-        case BAD_REQUEST:
+        case METRICS_REQUEST:
         {
-            std::cout<<"请求的文件不存在或请求命令错误！"<<std::endl;
-            add_status_line(400, error_400_title);
-            add_headers(strlen(error_400_form));
-            if(!add_content(error_400_form)){
+            //响应体在m_body中，一批只放一个：已经有了就返回false，等这一批发完再处理这个请求
+            if(!m_body.empty() || m_iv_count + 2 > MAX_IOV){
                 return false;
             }
-            break;
+            metrics::render(m_body);
+            if(!(add_status_line(200) && add_content_length(m_body.size()) && append(METRICS_HEADERS)
+                && add_linger() && add_blank_line())){
+                m_body.clear();
+                return false;
+            }
+            buf_segment* seg = m_write.tail();
+            add_mem_iov(seg->data + m_resp_start, seg->len - m_resp_start);
+            add_mem_iov(m_body.data(), m_body.size());
+            return true;
         }
-        case NO_RESOURCE:
+        case PARTIAL_CONTENT:
         {
-            std::cout<<"404 Not found! 请求的文件不存在"<<std::endl;
-            add_status_line( 404, error_404_title );
-            add_headers( strlen( error_404_form ) );
-            if ( ! add_content( error_404_form ) ) {
+            LOG_DEBUG("206 Partial Content");
+            if(!(add_status_line(206) && add_validators(m_file->valid) && add_encoding())){
+                return false;
+            }
+            if(m_range_count == 1){
+                if(!(add_content_range(m_ranges[0].first, m_ranges[0].first + m_ranges[0].len - 1)
+                    && add_headers(m_ranges[0].len))){
+                    return false;
+                }
+            }else if(!add_multipart()){
                 return false;
             }
             break;
         }
-        case FORBIDDEN_REQUEST:
+        case RANGE_NOT_SATISFIABLE:
         {
-            std::cout<<"没有访问该文件的权限！"<<std::endl;
-            add_status_line( 403, error_403_title );
-            add_headers(strlen( error_403_form));
-            if ( ! add_content( error_403_form ) ) {
+            LOG_DEBUG("416 Range Not Satisfiable");
+            if(!(add_status_line(416) && add_content_range(-1, -1) && add_headers(0))){
                 return false;
             }
             break;
         }
-        case FILE_REQUEST:
+        case NOT_MODIFIED:
         {
-            std::cout<<"开始生成响应..."<<std::endl;
-            add_status_line(200, ok_200_title );//把响应首行加入m_write_buf
-            add_headers(m_file_stat.st_size);//把响应头加入m_write_buf
-            m_iv[ 0 ].iov_base = m_write_buf;//要发的响应行和响应头的内存块m_write_buf
-            m_iv[ 0 ].iov_len = m_write_idx;
-            m_iv[ 1 ].iov_base = m_file_address;//要发的响应体的内存块
-            m_iv[ 1 ].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            std::cout<<"生成响应成功！"<<std::endl;
-            return true;
+            //只有响应头，没有响应体，也不需要Content-Length
+            LOG_DEBUG("304 Not Modified");
+            if(!(add_status_line(304) && add_validators(m_validator) && add_encoding()
+                && add_linger() && add_blank_line())){
+                return false;
+            }
+            break;
         }
         default:
             return false;
     }
-    m_iv[ 0 ].iov_base = m_write_buf;
-    m_iv[ 0 ].iov_len = m_write_idx;
-    m_iv_count = 1;
+    //响应头和响应体（如果有）加入这一批要发送的m_iv
+    if(!add_to_batch()){
+        return false;
+    }
+    LOG_DEBUG("生成响应成功！");
     return true;
 }
 
-//向写缓冲区m_write_buf中添加一行数据
-//format：格式，...：可变参数
-bool http_conn::add_response( const char* format, ... )
+//错误响应（400/403/404/500）是预先生成的完整响应（状态行、响应头、响应体），直接作为一块加入这一批，不写写缓冲区
+bool http_conn::add_error(int status)
 {
-    if( m_write_idx >= WRITE_BUFFER_SIZE){
-        return false;   //写缓冲区写满
-    }
-    va_list arg_list;   //解析可变参数的参数指针
-    va_start( arg_list, format );// va_start使用第一个可选参数的位置来初始化arg_list参数指针,该宏的第二个参数必须是该函数最后一个有名称参数的名称(即feomat)
-    int len = vsnprintf( m_write_buf + m_write_idx, WRITE_BUFFER_SIZE-1-m_write_idx, format, arg_list);
-    /*  int _vsnprintf(char* str, size_t size, const char* format, va_list ap); 
-        函数功能：将可变参数格式化输出到一个字符数组
-        参数说明：
-            1. char *str [out],把生成的格式化的字符串存放在这里.
-            2. size_t size [in], str可接受的最大字符数 [1]  (非字节数，UNICODE一个字符两个字节),防止产生数组越界.
-            3. const char *format [in], 指定输出格式的字符串，它决定了你需要提供的可变参数的类型、个数和顺序。
-            4. va_list ap [in], va_list变量. va:variable-argument:可变参数
-        返回值：执行成功，返回最终生成字符串的长度，若生成字符串的长度大于size，则将字符串的前size个字符复制到str，同时将原串的长度返回（不包含终止符）；执行失败，返回负值，并置errno  
-    */
-    if( len >= (WRITE_BUFFER_SIZE-1-m_write_idx)){
+    if(m_iv_count + 1 > MAX_IOV){
         return false;
     }
-    m_write_idx += len;
-    va_end( arg_list );//当不再需要使用参数指针时，必须调用宏 va_end
+    header_block page = error_response(status, m_linger);
+    add_mem_iov(page.data, page.len);
     return true;
 }
 
-//对内存映射区执行munmap操作
+//写缓冲区的最后一个段放不下当前响应了：接一个新段，把这个响应已经写好的部分挪过去，返回新段。
+//这个响应是从段的开头写起的（挪过去也放不下）时返回NULL
+buf_segment* http_conn::move_response()
+{
+    if(m_resp_start == 0){
+        return NULL;
+    }
+    buf_segment* seg = m_write.tail();
+    buf_segment* next = m_write.append_segment();
+    next->len = seg->len - m_resp_start;
+    memcpy(next->data, seg->data + m_resp_start, next->len);
+    seg->len = m_resp_start;
+    m_resp_start = 0;
+    return next;
+}
+
+//向写缓冲区m_write中添加一块文本（预生成的响应头块），放不下时同add_response
+bool http_conn::append(const char* data, int len)
+{
+    buf_segment* seg = m_write.tail();
+    if(!seg){
+        seg = m_write.append_segment();
+        m_resp_start = 0;
+    }
+    if(len > seg->avail()){
+        seg = move_response();
+        if(!seg || len > seg->avail()){
+            return false;
+        }
+    }
+    memcpy(seg->data + seg->len, data, len);
+    seg->len += len;
+    return true;
+}
+
+//向写缓冲区m_write中添加一行数据
+//format：格式，...：可变参数
+//写在最后一个段里；放不下时接一个新段，把这个响应已经写好的部分挪过去再写，保证每个响应头在一个段内（发送时是一块连续的内存）。
+//一个响应头比一个段还大时返回false。常用的响应头都是预生成的常量块（append），这里只用于多区间响应等少见的情况
+bool http_conn::add_response( const char* format, ... )
+{
+    buf_segment* seg = m_write.tail();
+    if(!seg){
+        seg = m_write.append_segment();
+        m_resp_start = 0;
+    }
+    while(true){
+        va_list arg_list;   //解析可变参数的参数指针
+        va_start( arg_list, format );// va_start使用第一个可选参数的位置来初始化arg_list参数指针,该宏的第二个参数必须是该函数最后一个有名称参数的名称(即feomat)
+        int len = vsnprintf( seg->data + seg->len, seg->avail(), format, arg_list);
+        va_end( arg_list );//当不再需要使用参数指针时，必须调用宏 va_end
+        /*  int _vsnprintf(char* str, size_t size, const char* format, va_list ap); 
+            函数功能：将可变参数格式化输出到一个字符数组
+            参数说明：
+                1. char *str [out],把生成的格式化的字符串存放在这里.
+                2. size_t size [in], str可接受的最大字符数 [1]  (非字节数，UNICODE一个字符两个字节),防止产生数组越界.
+                3. const char *format [in], 指定输出格式的字符串，它决定了你需要提供的可变参数的类型、个数和顺序。
+                4. va_list ap [in], va_list变量. va:variable-argument:可变参数
+            返回值：执行成功，返回最终生成字符串的长度，若生成字符串的长度大于size，则将字符串的前size个字符复制到str，同时将原串的长度返回（不包含终止符）；执行失败，返回负值，并置errno  
+        */
+        if(len < 0){
+            return false;
+        }
+        if(len < seg->avail()){     //vsnprintf还要写一个\0，所以不能正好等于
+            seg->len += len;
+            return true;
+        }
+        seg = move_response();
+        if(!seg){
+            return false;   //这个响应从段的开头写起都放不下
+        }
+    }
+}
+
+//释放响应体占用的资源：把文件还给打开文件缓存（映射和fd由缓存管理，最后一个使用者释放时才munmap/close）
+//包括这一批已生成的响应用到的文件和当前请求刚取出还没加入这一批的文件
 void http_conn::unmap()
 {
-    if(m_file_address){
-        Munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+    for(int i = 0; i < m_file_count; i++){
+        file_cache::get_instance()->release(m_files[i]);
     }
+    m_file_count = 0;
+    if(m_file){
+        file_cache::get_instance()->release(m_file);
+        m_file = 0;
+    }
+    m_file_address = 0;
+    m_file_fd = -1;
 }
 
 //添加响应状态行（响应首行）
-//status: 状态码  title：状态信息描述
-bool http_conn::add_status_line(int status, const char* title)
+//status: 状态码
+bool http_conn::add_status_line(int status)
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    return append(status_line(status));
 }
 
 //添加响应头
-//参数content_length：请求体长度。参数实际简化了，因为我们只实现了GET请求的响应，用不了那么多函数
-bool http_conn::add_headers( int content_length )
+//参数content_length：响应体长度。参数实际简化了，因为我们只实现了GET请求的响应，用不了那么多函数
+bool http_conn::add_headers( off_t content_length )
 {
-    add_content_length(content_length);
-    add_content_type();
-    add_linger();
-    add_blank_line();
+    return add_content_length(content_length) && add_content_type() && add_linger() && add_blank_line();
 }
 
-//添加响应体
-bool http_conn::add_content( const char* content )
+//添加响应类型，按目标文件的扩展名（do_request中取），整行是查表得到的常量
+bool http_conn::add_content_type()
 {
-    return add_response( "%s", content );
+    return append(m_mime->header);
 }
 
-//添加响应类型
-//此处做了简化，实际上应该根据客户端不同的请求进行识别
-bool http_conn::add_content_type()
+//添加响应体长度
+bool http_conn::add_content_length( off_t content_length )
 {
-    return add_response( "Content-Type:%s\r\n", "text/html");
+    char line[48] = "Content-Length: ";
+    int len = 16;
+    len += fast_utoa(content_length, line + len);
+    line[len++] = '\r';
+    line[len++] = '\n';
+    return append(line, len);
 }
 
-//添加响应体长度
-bool http_conn::add_content_length( int content_length )
+//添加Content-Range："bytes first-last/文件大小"，first为-1时是416用的"bytes */文件大小"
+bool http_conn::add_content_range(off_t first, off_t last)
 {
-    return add_response("Content-Length: %d\r\n", content_length);
+    char line[96] = "Content-Range: bytes ";
+    int len = 21;
+    if(first < 0){
+        line[len++] = '*';
+    }else{
+        len += fast_utoa(first, line + len);
+        line[len++] = '-';
+        len += fast_utoa(last, line + len);
+    }
+    line[len++] = '/';
+    len += fast_utoa(m_file_stat.st_size, line + len);
+    line[len++] = '\r';
+    line[len++] = '\n';
+    return append(line, len);
 }
 
 //添加响应是否保持连接
 bool http_conn::add_linger()
 {
-    return add_response( "Connection: %s\r\n", ( m_linger == true ) ? "keep-alive" : "close" );
+    return append(CONNECTION_HEADER[m_linger ? 1 : 0]);
+}
+
+//发压缩变体时添加Content-Encoding。可压缩的类型不管这次压没压缩都加Vary，告诉中间的缓存响应随Accept-Encoding变化
+bool http_conn::add_encoding()
+{
+    return append(CONTENT_ENCODING_HEADER[m_encoding]) && (!m_mime->compressible || append(VARY_HEADER));
+}
+
+//添加验证器（ETag和Last-Modified，文件的验证器中已经拼好），浏览器缓存文件后下次带着它们发条件GET
+bool http_conn::add_validators(const file_validator& v)
+{
+    return append(v.header, v.header_len);
+}
+
+/********************************************************************
+@FunName:bool http_conn::add_multipart()
+@Input:  None
+@Output: None
+@Retuval:写缓冲区放得下返回true
+@Notes:  multipart/byteranges：响应头之后每个区间是"分隔符、部分的头、文件数据"，最后是结束分隔符。
+         这里只写响应头和各部分的头（它们在写缓冲区中是连续的），文件数据由add_to_batch在m_part_pos处插入m_iv。
+         Content-Length要在前面给出，先按同样的格式算出各部分的头的长度
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/02 10:36:51
+********************************************************************/
+bool http_conn::add_multipart()
+{
+    unsigned long boundary = boundary_seq.fetch_add(1, std::memory_order_relaxed);
+    long long size = m_file_stat.st_size;
+    long long total = snprintf(NULL, 0, "\r\n--%016lx--\r\n", boundary);
+    for(int i = 0; i < m_range_count; i++){
+        long long first = m_ranges[i].first;
+        long long last = first + m_ranges[i].len - 1;
+        total += snprintf(NULL, 0, PART_FORMAT, boundary, m_mime->type, first, last, size) + m_ranges[i].len;
+    }
+    if(!(add_content_length(total)
+        && add_response("Content-Type: multipart/byteranges; boundary=%016lx\r\n", boundary)
+        && add_linger() && add_blank_line())){
+        return false;
+    }
+    for(int i = 0; i < m_range_count; i++){
+        long long first = m_ranges[i].first;
+        long long last = first + m_ranges[i].len - 1;
+        if(!add_response(PART_FORMAT, boundary, m_mime->type, first, last, size)){
+            return false;
+        }
+        //响应放不下时add_response会把整个响应移到新段，相对m_resp_start的位置不变
+        m_part_pos[i] = m_write.tail()->len - m_resp_start;
+    }
+    return add_response("\r\n--%016lx--\r\n", boundary);
 }
 
 //添加响应空行
 bool http_conn::add_blank_line()
 {
-    return add_response( "%s", "\r\n" );
+    return append(BLANK_LINE);
 }
 
 
 
-//处理客户端的请求(线程池中的工作线程即子线程执行的代码)
+/********************************************************************
+@FunName:void http_conn::process()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  处理客户端的请求(线程池中的工作线程即子线程执行的代码)。
+         Proactor模式：数据已由事件循环读好，解析生成一批响应后注册EPOLLOUT，由事件循环发送；
+         Reactor模式：交给process_reactor，收发都在本线程
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/28 11:05:33
+********************************************************************/
 void http_conn::process()
 {
-    //解析HTTP请求
-    //有限状态机
-    std::cout<<"process_read开始解析请求......"<<std::endl;
-    HTTP_CODE read_ret = process_read();
-    if(read_ret == NO_REQUEST){
-        //请求不完整，需要继续读客户端，要重置一下事件（因为使用了EPOLLONESHOT)
-        std::cout<<"请求不完整，需要modfd"<<std::endl;
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
+    if(m_trace){
+        m_trace->mark(TP_DEQUEUE);
+    }
+    if(m_reactor_mode){
+        process_reactor();
+        return;
+    }
+    int responses = parse_batch();
+    if(responses < 0){
         return;
     }
-    std::cout<<"process_read解析请求完成！"<<std::endl<<std::endl;
+    if(responses == 0){
+        //没有完整的请求，要重置一下事件（因为使用了EPOLLONESHOT)
+        LOG_DEBUG("请求不完整，需要modfd");
+        rearm(EPOLLIN);
+        return;
+    }
+    LOG_DEBUG("修改fd为EPOLLOUT，监听客户端是否可写");
+    rearm(EPOLLOUT);
+}
 
-    //生成响应
-    //根据解析结果来响应
-    std::cout<<"process_write开始生成响应..."<<std::endl;
-    bool write_ret = process_write(read_ret);
-    if(!write_ret){
-        close_conn();
+/********************************************************************
+@FunName:void http_conn::process_reactor()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  Reactor模式下工作线程执行的代码：recv到EAGAIN，解析生成一批响应，马上在本线程发送。
+         只有发送遇到EAGAIN才注册EPOLLOUT（剩下的由事件循环的write继续发），否则发完直接注册EPOLLIN，
+         这一批发完读缓冲区中还有请求时不用再经过事件循环，接着解析下一批。
+         时间轮只能由事件循环线程操作：发完后只记下空闲开始的时间（conn_state::idle_since），由on_timeout补上空闲超时
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/02 10:31:05
+********************************************************************/
+void http_conn::process_reactor()
+{
+    //事件循环因为request_pending交过来时，读缓冲区中已经有请求了，先处理它们
+    bool need_read = !m_state->parse_pending;
+    while(true){
+        if(need_read && !read()){
+            //对方关闭或读出错
+            shutdown_conn();
+            return;
+        }
+        int responses = parse_batch();
+        if(responses < 0){
+            return;
+        }
+        if(responses == 0){
+            rearm(EPOLLIN);
+            return;
+        }
+        switch(write_batch()){
+            case WRITE_AGAIN:
+                LOG_DEBUG("写缓冲区没有空间，修改fd为EPOLLOUT，由事件循环继续发送");
+                rearm(EPOLLOUT);
+                return;
+            case WRITE_KEEPALIVE:
+                m_state->idle_since.store(timer_wheel::now_ms(), std::memory_order_relaxed);
+                rearm(EPOLLIN);
+                return;
+            case WRITE_PROCESS:
+                need_read = false;
+                break;
+            default:
+                shutdown_conn();
+                return;
+        }
     }
-    std::cout<<"修改fd为EPOLLOUT，监听客户端是否可写"<<std::endl<<std::endl;
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);
+}
 
+/********************************************************************
+@FunName:int http_conn::parse_batch()
+@Input:  None
+@Output: None
+@Retuval:这一批的响应数，0表示没有完整的请求。-1表示出错，连接已经shutdown并重新注册
+@Notes:  HTTP/1.1流水线：读缓冲区中可能有多个完整的请求，依次解析，响应都加入同一批，一次writev发出去。
+         遇到以下情况这一批结束：请求不完整；请求不保持连接（后面的请求不再处理）；满MAX_PIPELINE个；
+         写缓冲区或m_iv放不下（这个请求退回去，这一批发完后再解析）。
+         最后把没处理完的数据移到读缓冲区开头
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/28 11:05:33
+********************************************************************/
+int http_conn::parse_batch()
+{
+    int responses = 0;
+    //读缓冲区中剩下的请求在上一批发完前就到了，从现在算起，不把上一批的发送时间算进来
+    m_batch_start = m_state->parse_pending ? metrics::now_us() : m_recv_us;
+    m_state->parse_pending = false;
+    while(true){
+        //解析HTTP请求
+        //有限状态机
+        LOG_DEBUG("process_read开始解析请求......");
+        if(m_trace){
+            m_trace->begin(responses);
+        }
+        HTTP_CODE read_ret = process_read();
+        if(read_ret == NO_REQUEST){
+            //请求不完整，需要继续读客户端
+            break;
+        }
+        if(m_trace){
+            m_trace->mark(TP_HANDLED);
+        }
+        LOG_DEBUG("process_read解析请求完成！");
+        if(read_ret == BAD_REQUEST){
+            //请求格式错误时不知道这个请求到哪里结束，后面的数据没法再解析，回复后关闭连接
+            m_linger = false;
+        }
+
+        //生成响应
+        //根据解析结果来响应
+        LOG_DEBUG("process_write开始生成响应...");
+        if(!process_write(read_ret)){
+            if(m_file){
+                file_cache::get_instance()->release(m_file);
+                m_file = 0;
+            }
+            if(responses == 0){
+                shutdown_conn();
+                return -1;
+            }
+            //这一批放不下这个响应了：退回这个请求，等这一批发完再从头解析它
+            if(!m_write.empty()){
+                m_write.tail()->len = m_resp_start;
+            }
+            m_state->checked_index = m_state->request_start;
+            init_request();
+            m_state->parse_pending = true;
+            break;
+        }
+        int status = response_status(read_ret);
+        metrics::response(status);
+        if(m_trace){
+            m_trace->mark(TP_BUILT);
+            m_trace->status[responses] = status;
+        }
+        responses++;
+        m_batch_linger = m_linger;
+        init_request();
+        if(!m_batch_linger){
+            break;
+        }
+        if(responses == MAX_PIPELINE){
+            m_state->parse_pending = m_state->checked_index < m_state->read_idx;
+            break;
+        }
+    }
+    compact();
+    m_batch_responses = responses;
+    if(m_trace && responses > 0){
+        m_trace->mark(TP_BATCH_DONE);
+    }
+    return responses;
+}
+
+//不在工作线程里close_conn：时间轮只能由事件循环线程操作。shutdown之后重新注册，
+//事件循环马上收到挂断事件（io_uring引擎下recv返回0），在它自己的线程里关闭
+void http_conn::shutdown_conn()
+{
+    shutdown(m_state->sockfd, SHUT_RDWR);
+    rearm(EPOLLIN);
+}
+
+//重新注册事件。epoll引擎下modfd重置EPOLLONESHOT；io_uring引擎下交给io_uring线程提交recv（EPOLLIN）或writev（EPOLLOUT）
+void http_conn::rearm(int ev)
+{
+    if(m_uring){
+        m_uring->post(this, ev);
+    }else{
+        modfd(m_epollfd, m_state->sockfd, ev, m_et_mode);
+    }
 }
 
 
@@ -1,8 +1,12 @@
 /********************************************************************
 @FileName:http_conn.h
 @Version: 1.0
-@Notes:   http任务类。本项目采用的是Peoactor模式，服务器主线程（main）接收到数据后，
+@Notes:   http任务类。本项目默认采用的是Peoactor模式，服务器主线程（main）接收到数据后，
 将其读出来封装成任务类（本文件），交给子线程（线程池）处理。
+-r选项为Reactor模式：事件循环只通知可读，工作线程自己recv、解析、生成响应并直接send，
+发不完（EAGAIN）才注册EPOLLOUT，少一次epoll_wait往返和一次线程间交接。
+连接的数据分成两部分：事件分发、时间轮和解析状态机每次都要用的字段在conn_state（热数据，两个缓存行），
+按fd连续存放在连接表中；文件名、请求、写缓冲区、iovec等大块数据在http_conn（冷数据）中另外分配。
 @Author:  XiaoDexin
 @Email:   xiaodexin0701@163.com
 @Date:    2022/05/04 13:57:54
@@ -10,7 +14,6 @@
 #ifndef _HTTP_CONN_H_
 #define _HTTP_CONN_H_
 
-#include<iostream>
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
@@ -27,18 +30,71 @@
 #include<signal.h>
 #include<sys/types.h>
 #include<sys/uio.h>
+#include<string>
 #include"../Pool/locker.h"
 #include"../Wrap/wrap.h"
+#include"file_cache.h"
+#include"compress_cache.h"
+#include"http_response.h"
+#include"line_scan.h"
+#include"http_request.h"
+#include"../Log/log.h"
+#include"../Timer/timer_wheel.h"
+#include"../Buffer/buffer.h"
+#include"../Trace/trace.h"
 
-//任务类
+class uring_loop;
+class http_conn;
+
+//连接的热数据。事件循环处理一个事件、时间轮推进时只碰这两个缓存行，不会把http_conn中的冷数据带进缓存：
+//第一行是事件分发和读（Proactor模式下事件循环的read），第二行是解析状态机
+struct alignas(64) conn_state{
+    timer_node timer;       //空闲超时/请求头超时定时器，data指向本结构
+    http_conn* conn;        //冷数据，连接表中没有连接时为NULL
+    int sockfd;             //该HTTP连接的socket，-1表示已关闭
+    int read_idx;           //读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
+    char* read_buf;         //读缓冲区，没有数据时为NULL
+    int read_size;          //读缓冲区的大小
+    int checked_index;      //当前正在解析的字符在读缓冲区的位置
+
+    buf_segment* read_seg;  //读缓冲区是从段池借的段时指向它，翻倍后改用malloc的内存，为NULL
+    std::atomic<uint64_t> idle_since;   //Reactor模式：工作线程发完响应、开始空闲等待的时间（timer_wheel::now_ms），0表示没有。
+                                        //工作线程不能操作时间轮，由事件循环在定时器到期时据此补上空闲超时
+    int start_line;         //当前正在解析的行的起始位置
+    int request_start;      //当前请求在读缓冲区中的起始位置，前面的请求都已处理完
+    int line_len;           //parse_line返回LINE_OK时，该行的长度（不含\r\n）
+    int check_state;        //主状态机当前所处的状态（http_conn::CHECK_STATE）
+    bool parse_pending;     //这一批满了，读缓冲区中还有没解析的请求
+
+    conn_state():conn(NULL), sockfd(-1), read_idx(0), read_buf(NULL), read_size(0), checked_index(0),
+        read_seg(NULL), idle_since(0), start_line(0), request_start(0), line_len(0), check_state(0), parse_pending(false){
+        timer.data = this;
+    }
+
+    //超时管理，由事件循环线程调用
+    bool request_started() { return read_idx > 0; }  //当前请求是否已经收到了数据（用来区分空闲等待和请求头读取中）
+    void clear_idle() { idle_since.store(0, std::memory_order_relaxed); }   //新请求开始，改按请求头超时
+    void expire() {         //超时：只shutdown不close。连接可能正在工作线程中处理，fd不能在这里释放；
+        if(sockfd != -1){   //shutdown之后该连接的下一次事件（或工作线程的下一次收发）都会失败，由正常的出错路径关闭
+            shutdown(sockfd, SHUT_RDWR);
+        }
+    }
+};
+static_assert(sizeof(conn_state) == 128, "conn_state应该正好两个缓存行");
+
+//任务类（连接的冷数据和处理逻辑）
 class http_conn{
 public:
 
-    static int m_epollfd;       //epollfd是所有的http_conn对象（任务对象）所共享的———所有的socket上的事件都被注册到一个epoll对象中（挂到一棵以epoll为根的红黑树上）
-    static int m_user_count;    //统计用户数量
+    static bool m_et_mode;      //连接socket是否使用边沿触发（ET），由命令行-e设置
+    static bool m_sendfile_mode;    //响应体用sendfile发送（保留文件fd）而不是mmap+writev，由命令行-s设置，仅epoll引擎
+    static bool m_reactor_mode;     //Reactor模式，工作线程自己收发数据，由命令行-r设置，仅epoll引擎
     static const int FILENAME_LEN = 200;        // 文件名的最大长度
-    static const int READ_BUFFER_SIZE = 2048;   //读缓冲大小
-    static const int WRITE_BUFFER_SIZE = 1024;  //写缓冲大小
+    static const int MAX_READ_BUFFER_SIZE = 64 * 1024;  //读缓冲区最大大小。平时用一个缓冲区段，一个请求（比如带很大的Cookie）放不下时翻倍，直到这个大小
+    static const int MAX_PIPELINE = 16;         //一次最多处理的流水线请求数，这些请求的响应合成一批发送
+    static const int MAX_IOV = MAX_PIPELINE * 2;    //一般的响应两块：响应头（写缓冲区中的一段）和响应体（映射或文件）。多区间的206响应要2*区间数+1块，这一批能放的响应就少一些
+    static const int MAX_RANGES = 8;            //一个Range请求最多的区间数，再多就忽略Range回完整的文件
+    static const char METRICS_PATH[];           //指标页面的url，Prometheus文本格式
 
     //HTTP请求方法，但我们只支持GET
     enum METHOD{
@@ -77,6 +133,10 @@ public:
         NO_RESCOURCE        :   表示服务器没有资源
         FORBIDDEN_REQUEST   :   表示客户对资源没有足够的访问权限
         FILE_REQUEST        :   文件请求，获取文件成功
+        METRICS_REQUEST     :   内置的指标页面（METRICS_PATH），响应体由metrics::render生成
+        NOT_MODIFIED        :   条件GET，客户端缓存的文件没有变，回304
+        PARTIAL_CONTENT     :   Range请求，回206，区间在m_ranges中
+        RANGE_NOT_SATISFIABLE   :   Range请求的区间都超出了文件，回416
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已关闭连接
     */
@@ -87,65 +147,140 @@ public:
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        METRICS_REQUEST,
+        NOT_MODIFIED,
+        PARTIAL_CONTENT,
+        RANGE_NOT_SATISFIABLE,
         INTERNAL_ERROR,
         CLOSED_CONNECTION
     };
 
-    http_conn(){}
-    ~http_conn(){}
+    /*一次发送（io_uring引擎的writev完成、或write_batch）后连接的状态
+        WRITE_AGAIN         :   响应还没发完，需要继续提交writev（epoll引擎下是等EPOLLOUT）
+        WRITE_KEEPALIVE     :   响应发完了，保持连接，继续接收下一个请求
+        WRITE_PROCESS       :   响应发完了，读缓冲区中还有没处理的流水线请求，交给线程池
+        WRITE_CLOSE         :   响应发完了（或出错），关闭连接
+    */
+    enum WRITE_STATUS{
+        WRITE_AGAIN,
+        WRITE_KEEPALIVE,
+        WRITE_PROCESS,
+        WRITE_CLOSE
+    };
+
+    //打开了追踪（-T）时每个连接带一个trace_batch记各阶段的时间戳
+    explicit http_conn(conn_state* state):m_state(state), m_trace(trace::enabled() ? new trace_batch() : NULL){}
+    ~http_conn(){ delete m_trace; }
 
     void process(); //处理客户端的请求(线程池的工作线程即子线程执行的代码)
-    void init(int sockfd, sockaddr_in &addr);   //初始化新接收的连接（客户端）
+    void init(int sockfd, sockaddr_in &addr, int epollfd, timer_wheel* wheel);   //初始化新接收的连接（客户端），epollfd、wheel为接收该连接的事件循环的epoll和时间轮
+    void init(int sockfd, sockaddr_in &addr, uring_loop* uring, timer_wheel* wheel);   //初始化由io_uring引擎接收的连接
     void init();            //初始化连接其余的信息
+    void init_request();    //开始解析下一个请求：重置解析状态，读缓冲区中已读到的数据保留（流水线请求）
     
-    void close_conn();  //关闭连接
+    void close_conn();  //关闭连接（不关闭socket），只在连接所属的事件循环线程中调用
     bool read();        //非阻塞的读
     bool write();       //非阻塞的写
 
-    HTTP_CODE process_read();       //解析HTTP请求（解析m_read_buf中的数据）
-    HTTP_CODE prase_request_line(char * text); //解析HTTP请求首行
-    HTTP_CODE prase_request_head(char * text); //解析HTTP请求头
-    HTTP_CODE prase_request_content(char * text); //解析HTTP请求体
+    //io_uring引擎使用：数据的收发由内核完成，这里只负责拷贝数据和推进发送进度
+    bool feed(const char* data, int len);   //把io_uring收到的数据追加到读缓冲区，缓冲区满返回false
+    WRITE_STATUS written(int bytes);        //io_uring的writev完成了bytes字节，推进m_iv
+    struct iovec* get_iovec() { return m_iv + m_iv_idx; }
+    int get_iovec_count() { return m_iv_count - m_iv_idx; }
+    int get_sockfd() { return m_state->sockfd; }
+    conn_state* get_state() { return m_state; }
+    timer_node* get_timer() { return &m_state->timer; }
+    bool request_pending() { return m_state->parse_pending && m_iv_count == 0; }  //这一批响应已发完，读缓冲区中还有没处理的请求，要再交给线程池
+    void trace_mark(TRACE_POINT p, uint64_t t) { if(m_trace) m_trace->mark(p, t); }   //事件循环记ready（epoll_wait返回的时间）
+
+    HTTP_CODE process_read();       //解析HTTP请求（解析读缓冲区中的数据）
+    HTTP_CODE prase_request_line(const char * text, int len); //解析HTTP请求首行
+    HTTP_CODE prase_request_head(const char * text, int len); //解析HTTP请求头
+    HTTP_CODE prase_request_content(const char * text); //解析HTTP请求体
+    HTTP_CODE on_connection(http_view value);       //Connection请求头
+    HTTP_CODE on_content_length(http_view value);   //Content-Length请求头
     LINE_STATUS parse_line();    //解析一行(获取一行），根据\r\n来
-    inline char * get_line() { return m_read_buf + m_start_line;} //获取一行数据，m_read_buf+m_start_line就是该行数据在函数parse_line中已经将m_read_buf中的数据按字符串结束符\0分隔开了，所以此时获取m_read_buf+m_start_line获取到的就是该行数据）,函数体较少，使用内联函数
+    inline const char * get_line() { return m_state->read_buf + m_state->start_line;} //获取一行数据的起始位置，长度为line_len（不含\r\n，读缓冲区不做修改，行尾没有\0）
+    const http_request& get_request() { return m_request; }     //解析出的请求，其中的偏移都相对于读缓冲区
+    const char* view_data(http_view v) { return m_state->read_buf + v.off; }   //view在读缓冲区中的起始位置
     HTTP_CODE do_request(); //具体的解析处理
+    bool not_modified(const file_validator& v); //条件GET的条件是否成立（客户端缓存的还是最新的）
+    bool range_applies();   //If-Range：客户端已有的部分和当前文件是否一致，不一致时忽略Range
     
 
     bool process_write(HTTP_CODE read_ret);       //生成HTTP响应
-    bool add_response( const char* format, ... );//向写缓冲区中添加一行数据
-    void unmap();  //对内存映射区执行munmap操作
-    bool add_status_line(int status, const char* title);//添加响应状态行（响应首行）
-    bool add_headers( int content_length );//添加响应头
-    bool add_content( const char* content );//添加响应体
+    bool add_response( const char* format, ... );//向写缓冲区中添加一行数据（格式化）
+    bool append(const char* data, int len);//向写缓冲区中添加一块文本
+    bool append(const header_block& b) { return append(b.data, b.len); }
+    void unmap();  //释放响应体占用的资源：把这一批响应的文件还给打开文件缓存
+    bool add_error(int status);//错误响应：整个响应是预生成的常量
+    bool add_status_line(int status);//添加响应状态行（响应首行）
+    bool add_headers( off_t content_length );//添加响应头
     bool add_content_type();//添加响应类型
-    bool add_content_length( int content_length );//添加响应体长度
+    bool add_content_length( off_t content_length );//添加响应体长度
+    bool add_content_range(off_t first, off_t last);//添加Content-Range
     bool add_linger();//添加响应是否保持连接
+    bool add_validators(const file_validator& v);//添加ETag和Last-Modified
+    bool add_encoding();//添加Content-Encoding（发的是压缩变体时）和Vary（可压缩的类型）
+    bool add_multipart();//添加多区间206响应的响应头和各部分的头，记下各部分的头在响应中的结束位置
     bool add_blank_line();//添加响应空行
 
 private:
-    int m_sockfd;           //该HTTP连接的socket
-    sockaddr_in m_address;  //通信的socket地址
+    typedef HTTP_CODE (http_conn::*header_handler)(http_view value);
+    static const header_handler m_header_handlers[HDR_NUM];    //已知请求头的处理函数，按HEADER_ID一次查表
+
+    int parse_batch();      //解析读缓冲区中的请求，生成一批响应，返回响应数。出错时已shutdown并重新注册，返回-1
+    void process_reactor(); //Reactor模式的process：收、解析、发在一个工作线程里做完
+    WRITE_STATUS write_batch();     //发送这一批响应直到发完或EAGAIN，不重新注册事件
+    void shutdown_conn();   //在工作线程中放弃连接：shutdown后重新注册，由事件循环收到挂断事件后关闭
+    bool advance_iov(int bytes);    //m_iv已发出bytes字节，推进m_iv，全部发完返回true
+    bool add_to_batch();    //把刚生成的响应（写缓冲区中从m_resp_start开始的响应头和响应体）加入这一批要发送的m_iv
+    void add_mem_iov(const char* base, int len);    //一块内存（写缓冲区中的响应头或错误响应的常量）加入m_iv
+    void add_file_iov(off_t first, off_t len);  //当前文件的一个区间加入m_iv
+    buf_segment* move_response();   //写缓冲区的最后一段放不下当前响应时，把它挪到新段
+    void finish_batch();    //这一批响应发完：释放文件，清空m_iv和写缓冲区
+    void compact();         //把读缓冲区中还没处理完的请求移到开头，腾出后面的空间
+    bool reserve_read(int len);     //保证读缓冲区还能再放len字节：没有就借一个段，不够就翻倍，超过MAX_READ_BUFFER_SIZE返回false
+    void release_read_buf();        //读缓冲区中没有数据时还回去，空闲的连接不占缓冲区
+    void rearm(int ev);     //重新注册EPOLLONESHOT事件（epoll引擎）或通知io_uring线程提交recv/writev（io_uring引擎）
 
-    char m_read_buf[READ_BUFFER_SIZE];  //读缓冲区
-    int m_read_idx;         //标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
-    int m_checked_index;    //当前正在解析的字符在读缓冲区的位置
-    int m_start_line;       //当前正在解析的行的起始位置
+    conn_state* m_state;    //热数据，在连接表中
+    int m_epollfd;          //该连接所属事件循环的epoll实例。每个事件循环有自己的epoll，连接只挂在接收它的那个循环上
+    uring_loop* m_uring;    //非空表示该连接由io_uring引擎驱动，m_epollfd无效
+    timer_wheel* m_wheel;   //所属事件循环的时间轮
+    sockaddr_in m_address;  //通信的socket地址
 
-    char m_real_file[FILENAME_LEN];  //客户请求的目标文件的完整路径，其内容等于doc_root + m_url，doc_root是网站根目录
-    char * m_url;           //请求目标文件的文件名
-    char * m_version;       //协议版本，支持HTTP1.1
+    char m_real_file[FILENAME_LEN];  //客户请求的目标文件的完整路径，其内容等于doc_root + 请求的url，doc_root是网站根目录
+    http_request m_request; //解析出的请求行、请求头、请求体在读缓冲区中的位置
     METHOD m_method;        //请求方法
-    char * m_host;          //主机名
     bool m_linger;          //HTTP请求是否要保持连接
     int m_content_length;   //请求体（消息体）长度
-    CHECK_STATE m_check_state;  //主状态机当前所处的状态
 
-    char m_write_buf[ WRITE_BUFFER_SIZE ];  // 写缓冲区
-    int m_write_idx;                        // 写缓冲区中待发送的字节数
-    char* m_file_address;                   // 客户请求的目标文件被mmap到内存中的起始位置
+    buf_chain m_write;                      // 写缓冲区，这一批响应的响应头依次追加在这里，一个段放不下时接一个新段
+    int m_resp_start;                       // 当前正在生成的响应的响应头在m_write最后一个段中的起始位置（每个响应头都在同一个段内）
+    file_entry* m_file;                     // 当前请求从打开文件缓存取出的目标文件，加入这一批后移到m_files
+    char* m_file_address;                   // 客户请求的目标文件被mmap到内存中的起始位置（缓存中的映射）
     struct stat m_file_stat;                // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct iovec m_iv[2];                   // 我们将采用writev来执行写操作，所以定义m_iv、m_iv_count这两个成员，其中m_iv_count表示被写内存块的数量，因为我们要写出的内存块有m_write_buf和m_file_address两个，所以数组定义两个元素。
+    file_validator m_validator;             // 回304时目标文件的验证器（这时没有从缓存取出文件）
+    const mime_info* m_mime;                // 响应体的类型，按目标文件的扩展名。值得压缩的类型响应要带Vary: Accept-Encoding
+    CONTENT_ENCODING m_encoding;            // 响应体的编码，m_file是压缩变体时不是ENC_IDENTITY
+    byte_range m_ranges[MAX_RANGES];        // 206响应要发送的文件区间
+    int m_range_count;                      // 区间数，0表示发送整个文件
+    int m_part_pos[MAX_RANGES];             // 多区间响应：第i个区间的文件数据之前的内容（响应头、各部分的头）在这个响应中的结束位置（相对m_resp_start）
+    int m_file_fd;                          // sendfile模式下目标文件的fd（缓存中的fd），-1表示没有（mmap模式或错误响应）
+    file_entry* m_files[MAX_PIPELINE];      // 这一批响应用到的文件，全部发完后release
+    int m_file_count;
+    struct iovec m_iv[MAX_IOV];             // 这一批响应要发送的内存块：响应头和映射的文件，用一次writev发出去。
+    int m_iv_file[MAX_IOV];                 // sendfile模式下m_iv[i]对应的文件fd（此时m_iv[i].iov_base不用，iov_len是剩余长度），内存块为-1
+    off_t m_iv_offset[MAX_IOV];             // sendfile模式下m_iv[i]对应的文件已发送到的位置，EAGAIN后下一次EPOLLOUT从这里继续
     int m_iv_count;
+    int m_iv_idx;                           // 第一个还没发完的m_iv
+    bool m_batch_linger;                    // 这一批最后一个响应是否保持连接（发完后是否继续接收）
+    int m_batch_responses;                  // 这一批的响应数，发完后记入延迟直方图
+    uint64_t m_recv_us;                     // 最近一次读到数据的时间（metrics::now_us），请求的延迟从这里算起
+    uint64_t m_batch_start;                 // 这一批的开始时间：读到数据的时间，读缓冲区中剩下的请求接着处理时是开始解析的时间
+    std::string m_body;                     // 这一批中指标响应的响应体，一批最多一个，发完后清空
+    trace_batch* m_trace;                   // 这一批请求各阶段的时间戳，没有打开追踪时为NULL
 
 };
 
@@ -0,0 +1,518 @@
+/********************************************************************
+@FileName:http_header.cpp
+@Version: 1.0
+@Notes:   已知请求头的完美哈希表。表在编译期由constexpr函数build_table()生成：
+          依次尝试乘数，直到所有已知名字的哈希互不相同，同时生成每个名字的小写形式和大小写掩码
+          （字母位置是0x20，其他位置是0：输入字节|掩码 == 小写名字 就是忽略大小写相等，'-'不会和别的字符混淆）
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/30 14:12:36
+********************************************************************/
+#include"http_header.h"
+#include<stdint.h>
+#include<string.h>
+#include<strings.h>
+
+#if defined(__x86_64__)
+#include<emmintrin.h>
+#endif
+
+struct known_header{
+    const char* name;
+    HEADER_ID id;
+};
+
+//已知请求头，顺序无关
+static constexpr known_header KNOWN[] = {
+    {"Host", HDR_HOST},
+    {"Connection", HDR_CONNECTION},
+    {"Content-Length", HDR_CONTENT_LENGTH},
+    {"If-None-Match", HDR_IF_NONE_MATCH},
+    {"If-Modified-Since", HDR_IF_MODIFIED_SINCE},
+    {"If-Range", HDR_IF_RANGE},
+    {"Range", HDR_RANGE},
+    {"Accept-Encoding", HDR_ACCEPT_ENCODING},
+    {"Cookie", HDR_COOKIE},
+};
+static constexpr int KNOWN_NUM = sizeof(KNOWN) / sizeof(KNOWN[0]);
+static_assert(KNOWN_NUM == HDR_NUM - 1, "KNOWN和HEADER_ID不一致");
+
+static constexpr int TABLE_BITS = 5;
+static constexpr int TABLE_SIZE = 1 << TABLE_BITS;  //槽数，比已知名字数大几倍，容易找到没有冲突的乘数
+static constexpr int MAX_NAME = 32;                 //已知名字的最大长度
+
+constexpr int const_strlen(const char* s)
+{
+    int n = 0;
+    while(s[n]){
+        n++;
+    }
+    return n;
+}
+
+constexpr bool is_alpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+//哈希：长度、首字母、末字母（都|0x20忽略大小写）组合后乘以seed，取高TABLE_BITS位
+constexpr unsigned name_hash(unsigned seed, unsigned char first, unsigned char last, int len)
+{
+    return (((first | 0x20u) * 31u + (last | 0x20u) + (unsigned)len * 131u) * seed) >> (32 - TABLE_BITS);
+}
+
+struct header_table{
+    unsigned seed;                      //0表示没有找到（编译期断言）
+    signed char slot[TABLE_SIZE];       //槽 -> KNOWN的下标，-1为空槽
+    int len[KNOWN_NUM];
+    char lower[KNOWN_NUM][MAX_NAME];    //小写名字
+    char mask[KNOWN_NUM][MAX_NAME];     //大小写掩码
+};
+
+/********************************************************************
+@FunName:constexpr header_table build_table()
+@Input:  None
+@Output: None
+@Retuval:生成的哈希表
+@Notes:  编译期执行。按线性同余序列逐个尝试奇数乘数，第一个没有冲突的就是结果，最多试MAX_TRY次。失败时seed为0
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/30 14:25:10
+********************************************************************/
+constexpr header_table build_table()
+{
+    header_table t{};
+    for(int k = 0; k < KNOWN_NUM; k++){
+        const char* name = KNOWN[k].name;
+        t.len[k] = const_strlen(name);
+        if(t.len[k] > MAX_NAME){
+            t.seed = 0;
+            return t;
+        }
+        for(int i = 0; i < t.len[k]; i++){
+            t.mask[k][i] = is_alpha(name[i]) ? 0x20 : 0;
+            t.lower[k][i] = name[i] | t.mask[k][i];
+        }
+    }
+    //乘数用线性同余序列生成（只取高位，相邻的乘数结果几乎一样，不能简单地+2）
+    const int MAX_TRY = 10000;
+    unsigned seed = 0x9E3779B1u;
+    for(int n = 0; n < MAX_TRY; n++, seed = (seed * 1664525u + 1013904223u) | 1u){
+        for(int i = 0; i < TABLE_SIZE; i++){
+            t.slot[i] = -1;
+        }
+        bool ok = true;
+        for(int k = 0; k < KNOWN_NUM && ok; k++){
+            const char* name = KNOWN[k].name;
+            unsigned h = name_hash(seed, name[0], name[t.len[k] - 1], t.len[k]);
+            if(t.slot[h] != -1){
+                ok = false;
+            }else{
+                t.slot[h] = k;
+            }
+        }
+        if(ok){
+            t.seed = seed;
+            return t;
+        }
+    }
+    t.seed = 0;
+    return t;
+}
+
+static constexpr header_table TABLE = build_table();
+static_assert(TABLE.seed != 0, "已知请求头的名字超过MAX_NAME，或者没有找到完美哈希（加大TABLE_BITS）");
+
+//s的前len个字节（|掩码之后）是否等于lower。长的部分一次16字节（SSE2）或8字节，最后一块和前一块重叠，不读len之后的字节
+static inline bool name_equal(const char* s, const char* lower, const char* mask, int len)
+{
+    int i = 0;
+#if defined(__x86_64__)
+    if(len >= 16){
+        for(; ; i += 16){
+            if(i + 16 > len){
+                i = len - 16;
+            }
+            __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+            __m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+            __m128i l = _mm_loadu_si128((const __m128i*)(lower + i));
+            if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v, m), l)) != 0xFFFF){
+                return false;
+            }
+            if(i + 16 == len){
+                return true;
+            }
+        }
+    }
+#endif
+    if(len >= 8){
+        for(; ; i += 8){
+            if(i + 8 > len){
+                i = len - 8;
+            }
+            uint64_t v, m, l;
+            memcpy(&v, s + i, 8);
+            memcpy(&m, mask + i, 8);
+            memcpy(&l, lower + i, 8);
+            if((v | m) != l){
+                return false;
+            }
+            if(i + 8 == len){
+                return true;
+            }
+        }
+    }
+    for(; i < len; i++){
+        if((s[i] | mask[i]) != lower[i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+HEADER_ID lookup_header(const char* name, int len)
+{
+    if(len <= 0 || len > MAX_NAME){
+        return HDR_UNKNOWN;
+    }
+    int k = TABLE.slot[name_hash(TABLE.seed, name[0], name[len - 1], len)];
+    if(k < 0 || TABLE.len[k] != len || !name_equal(name, TABLE.lower[k], TABLE.mask[k], len)){
+        return HDR_UNKNOWN;
+    }
+    return KNOWN[k].id;
+}
+
+const char* header_name(HEADER_ID id)
+{
+    for(int k = 0; k < KNOWN_NUM; k++){
+        if(KNOWN[k].id == id){
+            return KNOWN[k].name;
+        }
+    }
+    return "";
+}
+
+static const char* WEEKDAY[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char* MONTH[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static inline void put2(char* p, int v)
+{
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+//按固定位置填，不用strftime（%a、%b跟随locale）
+void format_http_date(time_t t, char* buf)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    int year = tm.tm_year + 1900;
+    memcpy(buf, WEEKDAY[tm.tm_wday], 3);
+    memcpy(buf + 3, ", ", 2);
+    put2(buf + 5, tm.tm_mday);
+    buf[7] = ' ';
+    memcpy(buf + 8, MONTH[tm.tm_mon], 3);
+    buf[11] = ' ';
+    put2(buf + 12, year / 100 % 100);
+    put2(buf + 14, year % 100);
+    buf[16] = ' ';
+    put2(buf + 17, tm.tm_hour);
+    buf[19] = ':';
+    put2(buf + 20, tm.tm_min);
+    buf[22] = ':';
+    put2(buf + 23, tm.tm_sec);
+    memcpy(buf + 25, " GMT", 5);    //带\0
+}
+
+//s[0..n)全是数字时返回它的值，否则返回-1
+static int parse_digits(const char* s, int n)
+{
+    int v = 0;
+    for(int i = 0; i < n; i++){
+        if(s[i] < '0' || s[i] > '9'){
+            return -1;
+        }
+        v = v * 10 + (s[i] - '0');
+    }
+    return v;
+}
+
+/********************************************************************
+@FunName:bool parse_http_date(const char* s, int len, time_t& t)
+@Input:  s、len：请求头的值（已去掉首尾空白）
+@Output: t：解析出的时间
+@Retuval:是否是合法的IMF-fixdate
+@Notes:  只认IMF-fixdate：浏览器回送的If-Modified-Since就是我们发出的Last-Modified原样，都是这个格式。
+         RFC 850和asctime格式已经没有客户端在用，按格式错误处理，这时条件不成立，回完整的200
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/01 10:21:45
+********************************************************************/
+bool parse_http_date(const char* s, int len, time_t& t)
+{
+    //"Sun, 06 Nov 1994 08:49:37 GMT"
+    // 0123456789012345678901234567890
+    if(len != HTTP_DATE_LEN || s[3] != ',' || s[4] != ' ' || s[7] != ' ' || s[11] != ' '
+        || s[16] != ' ' || s[19] != ':' || s[22] != ':' || memcmp(s + 25, " GMT", 4) != 0){
+        return false;
+    }
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_mon = -1;
+    for(int i = 0; i < 12; i++){
+        if(memcmp(s + 8, MONTH[i], 3) == 0){
+            tm.tm_mon = i;
+            break;
+        }
+    }
+    tm.tm_mday = parse_digits(s + 5, 2);
+    int year = parse_digits(s + 12, 4);
+    tm.tm_hour = parse_digits(s + 17, 2);
+    tm.tm_min = parse_digits(s + 20, 2);
+    tm.tm_sec = parse_digits(s + 23, 2);
+    if(tm.tm_mon < 0 || tm.tm_mday < 1 || tm.tm_mday > 31 || year < 1970 || tm.tm_hour < 0 || tm.tm_hour > 23
+        || tm.tm_min < 0 || tm.tm_min > 59 || tm.tm_sec < 0 || tm.tm_sec > 60){
+        return false;
+    }
+    tm.tm_year = year - 1900;
+    t = timegm(&tm);    //星期几不检查
+    return true;
+}
+
+/********************************************************************
+@FunName:bool etag_list_match(const char* s, int len, const char* etag, bool weak)
+@Input:  s、len：请求头的值，"*"或逗号分隔的实体标签，如 W/"abc", "def"
+         etag：我们的实体标签（带引号，强标签）
+         weak：是否弱比较（If-None-Match用弱比较，If-Match、If-Range用强比较）
+@Output: None
+@Retuval:是否匹配
+@Notes:  格式不对的部分跳到下一个逗号
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/01 10:40:12
+********************************************************************/
+bool etag_list_match(const char* s, int len, const char* etag, bool weak)
+{
+    if(len == 1 && s[0] == '*'){
+        return true;
+    }
+    int etag_len = strlen(etag);
+    const char* end = s + len;
+    const char* p = s;
+    while(p < end){
+        while(p < end && (*p == ' ' || *p == '\t' || *p == ',')){
+            p++;
+        }
+        bool is_weak = false;
+        if(end - p >= 2 && p[0] == 'W' && p[1] == '/'){
+            is_weak = true;
+            p += 2;
+        }
+        const char* close = p < end && *p == '"' ? (const char*)memchr(p + 1, '"', end - p - 1) : NULL;
+        if(!close){
+            //不是带引号的标签，跳过这一项
+            p = (const char*)memchr(p, ',', end - p);
+            if(!p){
+                break;
+            }
+            continue;
+        }
+        if((weak || !is_weak) && close + 1 - p == etag_len && memcmp(p, etag, etag_len) == 0){
+            return true;
+        }
+        p = close + 1;
+    }
+    return false;
+}
+
+//从p开始的十进制数，最多18位（不会溢出）。没有数字或太长返回NULL，否则返回数字后面的位置
+static const char* parse_offset(const char* p, const char* end, off_t& v)
+{
+    const char* begin = p;
+    v = 0;
+    while(p < end && *p >= '0' && *p <= '9'){
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    if(p == begin || p - begin > 18){
+        return NULL;
+    }
+    return p;
+}
+
+/********************************************************************
+@FunName:int parse_range(const char* s, int len, off_t size, byte_range* ranges, int max)
+@Input:  s、len：Range请求头的值
+         size：文件大小
+         max：ranges的容量
+@Output: ranges：满足的区间（RFC 7233：超出文件的区间去掉，结尾超出文件的截到文件末尾）
+@Retuval:区间数，0：没有能满足的区间，-1：忽略Range
+@Notes:  重叠的区间不合并，按请求原样返回，区间数由max限制
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/02 09:47:26
+********************************************************************/
+int parse_range(const char* s, int len, off_t size, byte_range* ranges, int max)
+{
+    if(len < 6 || strncasecmp(s, "bytes=", 6) != 0){
+        return -1;
+    }
+    const char* p = s + 6;
+    const char* end = s + len;
+    int count = 0;
+    bool any = false;   //至少有一个语法正确的区间
+    while(p < end){
+        while(p < end && (*p == ' ' || *p == '\t')){
+            p++;
+        }
+        if(p < end && *p == ','){   //列表中允许空元素
+            p++;
+            continue;
+        }
+        if(p == end){
+            break;
+        }
+        off_t first = -1, last = -1;
+        if(*p == '-'){
+            //后缀区间：最后n个字节
+            off_t n;
+            p = parse_offset(p + 1, end, n);
+            if(!p){
+                return -1;
+            }
+            if(n > 0 && size > 0){
+                first = n < size ? size - n : 0;
+                last = size - 1;
+            }
+        }else{
+            p = parse_offset(p, end, first);
+            if(!p || p == end || *p != '-'){
+                return -1;
+            }
+            p++;
+            if(p < end && *p >= '0' && *p <= '9'){
+                p = parse_offset(p, end, last);
+                if(!p || last < first){
+                    return -1;
+                }
+            }else{
+                last = size - 1;    //"500-"：到文件末尾
+            }
+            if(first >= size){
+                first = -1;         //超出文件，去掉
+            }else if(last >= size){
+                last = size - 1;
+            }
+        }
+        while(p < end && (*p == ' ' || *p == '\t')){
+            p++;
+        }
+        if(p < end && *p != ','){
+            return -1;
+        }
+        any = true;
+        if(first >= 0){
+            if(count == max){
+                return -1;
+            }
+            ranges[count].first = first;
+            ranges[count].len = last - first + 1;
+            count++;
+        }
+    }
+    return any ? count : -1;
+}
+
+static const char* ENCODING_NAME[ENC_NUM] = {"identity", "gzip", "br"};
+
+const char* encoding_name(CONTENT_ENCODING enc)
+{
+    return ENCODING_NAME[enc];
+}
+
+//q值（"0"、"0.5"、"1.000"等）换成千分数，格式不对返回-1
+static int parse_qvalue(const char* p, const char* end)
+{
+    if(p == end || (*p != '0' && *p != '1')){
+        return -1;
+    }
+    int q = (*p - '0') * 1000;
+    p++;
+    if(p < end && *p == '.'){
+        p++;
+        for(int scale = 100; p < end && *p >= '0' && *p <= '9' && scale > 0; p++, scale /= 10){
+            q += (*p - '0') * scale;
+        }
+    }
+    return p == end && q <= 1000 ? q : -1;
+}
+
+/********************************************************************
+@FunName:CONTENT_ENCODING choose_encoding(const char* s, int len)
+@Input:  s、len：Accept-Encoding的值，如 "gzip, deflate, br" 或 "br;q=1.0, gzip;q=0.8, *;q=0.1"
+@Output: None
+@Retuval:选择的编码
+@Notes:  没写q的是1，q=0表示不接受。没有列出的编码按"*"的q值，也没有"*"就是不接受。x-gzip等同gzip
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/03 09:55:40
+********************************************************************/
+CONTENT_ENCODING choose_encoding(const char* s, int len)
+{
+    int q[ENC_NUM] = {-1, -1, -1};  //-1：没有列出
+    int any = -1;
+    const char* end = s + len;
+    const char* p = s;
+    while(p < end){
+        const char* item_end = (const char*)memchr(p, ',', end - p);
+        if(!item_end){
+            item_end = end;
+        }
+        //编码名
+        while(p < item_end && (*p == ' ' || *p == '\t')){
+            p++;
+        }
+        const char* name = p;
+        while(p < item_end && *p != ';' && *p != ' ' && *p != '\t'){
+            p++;
+        }
+        int name_len = p - name;
+        //参数中只看q
+        int value = 1000;
+        const char* param = (const char*)memchr(p, ';', item_end - p);
+        if(param){
+            param++;
+            while(param < item_end && (*param == ' ' || *param == '\t')){
+                param++;
+            }
+            const char* qend = item_end;
+            while(qend > param && (qend[-1] == ' ' || qend[-1] == '\t')){
+                qend--;
+            }
+            if(qend - param >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '='){
+                value = parse_qvalue(param + 2, qend);
+            }
+        }
+        if(value >= 0){
+            if(name_len == 1 && name[0] == '*'){
+                any = value;
+            }else if((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) || (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0)){
+                q[ENC_GZIP] = value;
+            }else if(name_len == 2 && strncasecmp(name, "br", 2) == 0){
+                q[ENC_BR] = value;
+            }
+        }
+        p = item_end + 1;
+    }
+    CONTENT_ENCODING best = ENC_IDENTITY;
+    int best_q = 0;
+    const CONTENT_ENCODING order[2] = {ENC_BR, ENC_GZIP};   //q一样时前面的优先
+    for(int i = 0; i < 2; i++){
+        int v = q[order[i]] >= 0 ? q[order[i]] : any;
+        if(v > best_q){
+            best = order[i];
+            best_q = v;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,70 @@
+/********************************************************************
+@FileName:http_header.h
+@Version: 1.0
+@Notes:   已知请求头的识别。请求头名字到HEADER_ID的映射是一个编译期生成的完美哈希：
+          哈希只看名字的长度、首字母和末字母（忽略大小写），编译期找一个让所有已知名字落到不同槽的乘数，
+          所以识别一个请求头只要算一次哈希、最多比较一次名字。名字的比较按字节掩码忽略大小写，长名字一次比较16字节（SSE2）。
+          新增要识别的请求头：在HEADER_ID中加一项，在http_header.cpp的KNOWN中加上名字。
+          另外是几个请求头的值的解析：HTTP日期、实体标签列表、Range、Accept-Encoding
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/30 14:05:51
+********************************************************************/
+#ifndef _HTTP_HEADER_H_
+#define _HTTP_HEADER_H_
+
+#include<time.h>
+#include<sys/types.h>
+
+enum HEADER_ID{
+    HDR_UNKNOWN = 0,
+    HDR_HOST,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_RANGE,
+    HDR_RANGE,
+    HDR_ACCEPT_ENCODING,
+    HDR_COOKIE,
+    HDR_NUM
+};
+
+//识别请求头名字（不含':'），忽略大小写，不认识的返回HDR_UNKNOWN
+HEADER_ID lookup_header(const char* name, int len);
+//HEADER_ID对应的标准写法的名字，HDR_UNKNOWN返回""
+const char* header_name(HEADER_ID id);
+
+//请求头的值的解析，条件GET和Range用
+static const int HTTP_DATE_LEN = 29;    //"Sun, 06 Nov 1994 08:49:37 GMT"
+//t按HTTP日期格式（IMF-fixdate）写到buf，buf至少HTTP_DATE_LEN+1字节
+void format_http_date(time_t t, char* buf);
+//解析IMF-fixdate格式的HTTP日期，格式不对返回false（RFC 7232规定这时忽略这个请求头）
+bool parse_http_date(const char* s, int len, time_t& t);
+//实体标签列表（If-None-Match、If-Match的值）中是否有etag（带引号）。"*"和任何etag匹配。
+//weak为true时是弱比较，忽略两边的W/前缀；否则是强比较，W/开头的标签不和任何etag匹配
+bool etag_list_match(const char* s, int len, const char* etag, bool weak);
+
+//Range请求头中的一个区间，已按文件大小截好
+struct byte_range{
+    off_t first;    //第一个字节的位置
+    off_t len;      //字节数，大于0
+};
+//解析Range请求头（"bytes=0-499, 1000-, -200"），size为文件大小，结果按请求中的顺序放进ranges。
+//返回区间数；0表示所有区间都超出了文件（回416）；-1表示忽略这个请求头回完整的文件：
+//单位不是bytes、格式错误、区间数超过max（防止一个请求要求成百上千个小区间）
+int parse_range(const char* s, int len, off_t size, byte_range* ranges, int max);
+
+//响应体的编码
+enum CONTENT_ENCODING{
+    ENC_IDENTITY = 0,   //不压缩
+    ENC_GZIP,
+    ENC_BR,
+    ENC_NUM
+};
+//Content-Encoding中的名字，ENC_IDENTITY返回"identity"
+const char* encoding_name(CONTENT_ENCODING enc);
+//按Accept-Encoding选择编码：q值最大的，一样大时br优先（压缩率更高）。都不接受返回ENC_IDENTITY
+CONTENT_ENCODING choose_encoding(const char* s, int len);
+
+#endif
@@ -0,0 +1,102 @@
+/********************************************************************
+@FileName:http_request.h
+@Version: 1.0
+@Notes:   解析后的HTTP请求。所有字段都是读缓冲区中的（偏移，长度），解析时不修改读缓冲区、不拷贝、不分配内存。
+          请求头保存在固定容量的数组里，条件GET、Range、Accept-Encoding等以后需要的请求头直接用find()按名字取，
+          不用重新扫描读缓冲区。已知的请求头（http_header.h）另外按HEADER_ID记在known中，直接下标访问。
+          超出MAX_HEADERS的请求头只计数不保存（已知请求头照常处理）。
+          用偏移而不是指针，读缓冲区中的数据整体移动后只需要平移偏移
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/27 10:16:42
+********************************************************************/
+#ifndef _HTTP_REQUEST_H_
+#define _HTTP_REQUEST_H_
+
+#include<string.h>
+#include<strings.h>
+#include"http_header.h"
+
+//读缓冲区中的一段
+struct http_view{
+    int off;
+    int len;
+};
+
+struct http_header{
+    http_view name;
+    http_view value;    //已去掉首尾的空格和\t
+};
+
+//忽略大小写比较view和字符串s
+inline bool view_equal(const char* buf, http_view v, const char* s)
+{
+    return v.len == (int)strlen(s) && strncasecmp(buf + v.off, s, v.len) == 0;
+}
+
+struct http_request{
+    static const int MAX_HEADERS = 32;
+
+    http_view method;
+    http_view url;          //请求的路径，http://host形式的已去掉host部分
+    http_view version;
+    http_view body;         //请求体，没有时len为0
+    http_view known[HDR_NUM];   //已知请求头的值，下标是HEADER_ID，请求中没有时off为-1（同名的取最后一个）
+    http_header headers[MAX_HEADERS];
+    int header_count;
+    int dropped;            //超出MAX_HEADERS没有保存的请求头个数
+
+    void clear(){
+        method.off = method.len = 0;
+        url.off = url.len = 0;
+        version.off = version.len = 0;
+        body.off = body.len = 0;
+        for(int i = 0; i < HDR_NUM; i++){
+            known[i].off = -1;
+            known[i].len = 0;
+        }
+        header_count = 0;
+        dropped = 0;
+    }
+
+    void add_header(http_view name, http_view value){
+        if(header_count == MAX_HEADERS){
+            dropped++;
+            return;
+        }
+        headers[header_count].name = name;
+        headers[header_count].value = value;
+        header_count++;
+    }
+
+    //读缓冲区中的数据整体移动了delta字节，所有view跟着平移
+    void shift(int delta){
+        method.off += delta;
+        url.off += delta;
+        version.off += delta;
+        body.off += delta;
+        for(int i = 0; i < HDR_NUM; i++){
+            if(known[i].off >= 0){
+                known[i].off += delta;
+            }
+        }
+        for(int i = 0; i < header_count; i++){
+            headers[i].name.off += delta;
+            headers[i].value.off += delta;
+        }
+    }
+
+    bool has(HEADER_ID id) const { return known[id].off >= 0; }
+
+    //按名字（忽略大小写）找第一个请求头，已知的请求头直接用known，没有返回NULL。buf为请求所在的读缓冲区
+    const http_header* find(const char* buf, const char* name) const{
+        for(int i = 0; i < header_count; i++){
+            if(view_equal(buf, headers[i].name, name)){
+                return headers + i;
+            }
+        }
+        return NULL;
+    }
+};
+
+#endif
@@ -0,0 +1,186 @@
+/********************************************************************
+@FileName:http_response.cpp
+@Version: 1.0
+@Notes:   响应头的预生成块的实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/04 09:31:40
+********************************************************************/
+#include"http_response.h"
+#include<string.h>
+#include<strings.h>
+#include<string>
+
+#define BLOCK(s) {s, sizeof(s) - 1}
+#define CONTENT_TYPE(t) BLOCK("Content-Type: " t "\r\n")
+
+const header_block CONNECTION_HEADER[2] = {BLOCK("Connection: close\r\n"), BLOCK("Connection: keep-alive\r\n")};
+const header_block CONTENT_ENCODING_HEADER[ENC_NUM] = {BLOCK(""), BLOCK("Content-Encoding: gzip\r\n"), BLOCK("Content-Encoding: br\r\n")};
+const header_block ACCEPT_RANGES_HEADER = BLOCK("Accept-Ranges: bytes\r\n");
+const header_block VARY_HEADER = BLOCK("Vary: Accept-Encoding\r\n");
+const header_block BLANK_LINE = BLOCK("\r\n");
+const header_block METRICS_HEADERS = BLOCK("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\nCache-Control: no-store\r\n");
+
+#define MIME(ext, type, compressible) {ext, type, CONTENT_TYPE(type), compressible}
+
+static const mime_info MIME_TYPES[] = {
+    MIME("html", "text/html", true),
+    MIME("htm", "text/html", true),
+    MIME("css", "text/css", true),
+    MIME("js", "application/javascript", true),
+    MIME("mjs", "application/javascript", true),
+    MIME("json", "application/json", true),
+    MIME("xml", "application/xml", true),
+    MIME("txt", "text/plain", true),
+    MIME("svg", "image/svg+xml", true),
+    MIME("ico", "image/x-icon", true),      //ico一般是没压缩的位图
+    MIME("wasm", "application/wasm", true),
+    MIME("jpg", "image/jpeg", false),
+    MIME("jpeg", "image/jpeg", false),
+    MIME("png", "image/png", false),
+    MIME("gif", "image/gif", false),
+    MIME("webp", "image/webp", false),
+    MIME("mp4", "video/mp4", false),
+    MIME("mp3", "audio/mpeg", false),
+    MIME("pdf", "application/pdf", false),
+    MIME("woff", "font/woff", false),
+    MIME("woff2", "font/woff2", false),
+    MIME("zip", "application/zip", false),
+    MIME("gz", "application/gzip", false),
+};
+static const mime_info MIME_DEFAULT = MIME("", "application/octet-stream", false);
+
+const mime_info* mime_type(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    if(dot && !strchr(dot, '/')){
+        for(size_t i = 0; i < sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]); i++){
+            if(strcasecmp(dot + 1, MIME_TYPES[i].ext) == 0){
+                return &MIME_TYPES[i];
+            }
+        }
+    }
+    return &MIME_DEFAULT;
+}
+
+const mime_info* mime_html()
+{
+    return &MIME_TYPES[0];
+}
+
+//"00" "01" ... "99"
+static const char DIGITS2[] =
+    "00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859" "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+//从低位起两位一组查表写到临时缓冲区的末尾，再整体拷贝出去，每两位只有一次除法
+int fast_utoa(unsigned long long v, char* out)
+{
+    char buf[20];
+    char* p = buf + sizeof(buf);
+    while(v >= 100){
+        unsigned idx = (v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        memcpy(p, DIGITS2 + idx, 2);
+    }
+    if(v >= 10){
+        p -= 2;
+        memcpy(p, DIGITS2 + v * 2, 2);
+    }else{
+        *--p = '0' + v;
+    }
+    int len = buf + sizeof(buf) - p;
+    memcpy(out, p, len);
+    return len;
+}
+
+struct status_entry{
+    int status;
+    header_block line;
+};
+
+#define STATUS(code, title) {code, BLOCK("HTTP/1.1 " #code " " title "\r\n")}
+
+static const status_entry STATUS_LINES[] = {
+    STATUS(200, "OK"),
+    STATUS(206, "Partial Content"),
+    STATUS(304, "Not Modified"),
+    STATUS(400, "Bad Request"),
+    STATUS(403, "Forbidden"),
+    STATUS(404, "Not Found"),
+    STATUS(416, "Range Not Satisfiable"),
+    STATUS(500, "Internal Error"),
+};
+
+header_block status_line(int status)
+{
+    const int n = sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]);
+    for(int i = 0; i < n; i++){
+        if(STATUS_LINES[i].status == status){
+            return STATUS_LINES[i].line;
+        }
+    }
+    return STATUS_LINES[n - 1].line;
+}
+
+struct error_page{
+    int status;
+    const char* body;
+};
+
+//错误响应的响应体
+static const error_page ERROR_PAGES[] = {
+    {400, "Your request has bad syntax or is inherently impossible to satisfy.\n"},
+    {403, "You do not have permission to get file from this server.\n"},
+    {404, "The requested file was not found on this server.\n"},
+    {500, "There was an unusual problem serving the requested file.\n"},
+};
+static const int ERROR_NUM = sizeof(ERROR_PAGES) / sizeof(ERROR_PAGES[0]);
+
+//每个错误响应按不保持连接、保持连接各生成一份，下标为 错误序号*2+是否保持连接
+static std::string* build_error_pages()
+{
+    std::string* pages = new std::string[ERROR_NUM * 2];
+    for(int i = 0; i < ERROR_NUM; i++){
+        const char* body = ERROR_PAGES[i].body;
+        char len[20];
+        std::string head = status_line(ERROR_PAGES[i].status).data;
+        head += "Content-Length: ";
+        head.append(len, fast_utoa(strlen(body), len));
+        head += "\r\n";
+        head += mime_html()->header.data;
+        for(int l = 0; l < 2; l++){
+            pages[i * 2 + l] = head + CONNECTION_HEADER[l].data + BLANK_LINE.data + body;
+        }
+    }
+    return pages;
+}
+
+/********************************************************************
+@FunName:header_block error_response(int status, bool linger)
+@Input:  status：状态码，400、403、404、500，其他的按500
+         linger：是否保持连接
+@Output: None
+@Retuval:完整的错误响应
+@Notes:  所有错误响应在第一次调用时一起生成（C++11起局部静态变量的初始化是线程安全的），之后只是查表。
+         返回的内存在程序运行期间一直有效，可以直接放进iovec
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/04 10:05:13
+********************************************************************/
+header_block error_response(int status, bool linger)
+{
+    static const std::string* pages = build_error_pages();
+    int i = ERROR_NUM - 1;
+    for(int k = 0; k < ERROR_NUM; k++){
+        if(ERROR_PAGES[k].status == status){
+            i = k;
+            break;
+        }
+    }
+    const std::string& page = pages[i * 2 + (linger ? 1 : 0)];
+    header_block b = {page.data(), (int)page.size()};
+    return b;
+}
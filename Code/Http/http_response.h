@@ -0,0 +1,55 @@
+/********************************************************************
+@FileName:http_response.h
+@Version: 1.0
+@Notes:   响应头的预生成块。原来每个响应调用五次add_response（可变参数vsnprintf），
+          这里把不变的部分都事先拼好，生成响应头只是几次memcpy：
+          · 状态行、Connection、Accept-Ranges、Vary、Content-Encoding等是常量块
+          · Content-Type按扩展名查表，表中就是整行"Content-Type: text/html\r\n"
+          · ETag和Last-Modified两行在文件的验证器中生成一次（file_validator::header）
+          · 只有Content-Length、Content-Range中的数字每次生成，用fast_utoa
+          · 400/403/404/500是完整的常量响应（状态行、响应头、响应体），按是否保持连接各一份，
+            直接作为一个iovec发送，不经过写缓冲区
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/04 09:30:52
+********************************************************************/
+#ifndef _HTTP_RESPONSE_H_
+#define _HTTP_RESPONSE_H_
+
+#include"http_header.h"
+
+//一段常量文本
+struct header_block{
+    const char* data;
+    int len;
+};
+
+//响应体的类型
+struct mime_info{
+    const char* ext;        //扩展名，不含'.'
+    const char* type;
+    header_block header;    //"Content-Type: 类型\r\n"
+    bool compressible;      //是否值得压缩（文本类的才值得，图片、视频本身已经压缩过）
+};
+
+//按文件扩展名（忽略大小写）取类型，不认识的扩展名是application/octet-stream
+const mime_info* mime_type(const char* path);
+//text/html，错误页面用
+const mime_info* mime_html();
+
+//十进制整数转字符串，不写\0，返回长度。out至少20字节
+int fast_utoa(unsigned long long v, char* out);
+
+//状态行"HTTP/1.1 200 OK\r\n"。不认识的状态码按500
+header_block status_line(int status);
+//完整的错误响应，status为400、403、404、500，linger为是否保持连接。第一次调用时生成所有错误响应
+header_block error_response(int status, bool linger);
+
+extern const header_block CONNECTION_HEADER[2];     //下标为是否保持连接
+extern const header_block CONTENT_ENCODING_HEADER[ENC_NUM];     //ENC_IDENTITY是空块
+extern const header_block ACCEPT_RANGES_HEADER;
+extern const header_block VARY_HEADER;
+extern const header_block BLANK_LINE;
+extern const header_block METRICS_HEADERS;      //指标页面的Content-Type（Prometheus文本格式）和Cache-Control
+
+#endif
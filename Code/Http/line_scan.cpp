@@ -0,0 +1,178 @@
+/********************************************************************
+@FileName:line_scan.cpp
+@Version: 1.0
+@Notes:   向量化扫描的实现。每种实现一对函数（找行尾、找单个字符），启动时按CPU选一组放进函数指针
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/26 14:20:37
+********************************************************************/
+#include"line_scan.h"
+#include<string.h>
+
+#if defined(__x86_64__)
+#include<immintrin.h>
+#define SCAN_X86 1
+#endif
+
+typedef const char* (*line_end_fn)(const char* begin, const char* end);
+typedef const char* (*char_fn)(const char* begin, const char* end, char c);
+
+struct scan_impl{
+    const char* name;
+    line_end_fn line_end;
+    char_fn find_char;
+};
+
+//逐字节版本，也用于处理向量版本剩下的尾部
+static const char* line_end_scalar(const char* p, const char* end)
+{
+    for(; p < end; ++p){
+        if(*p == '\r' || *p == '\n'){
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char* char_scalar(const char* p, const char* end, char c)
+{
+    for(; p < end; ++p){
+        if(*p == c){
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef SCAN_X86
+/********************************************************************
+@FunName:static const char* line_end_sse2(const char* p, const char* end)
+@Input:  p：扫描起始位置
+         end：扫描结束位置（不含）
+@Output: None
+@Retuval:第一个'\r'或'\n'的位置，没有返回end
+@Notes:  每次不对齐地读16字节，分别和'\r'、'\n'比较后按位或，movemask得到16位的位图，
+         非0时最低的1就是第一个行结束符。不足16字节的尾部交给逐字节版本
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/26 14:31:52
+********************************************************************/
+static const char* line_end_sse2(const char* p, const char* end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for(; end - p >= 16; p += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf));
+        unsigned mask = _mm_movemask_epi8(hit);
+        if(mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return line_end_scalar(p, end);
+}
+
+static const char* char_sse2(const char* p, const char* end, char c)
+{
+    const __m128i key = _mm_set1_epi8(c);
+    for(; end - p >= 16; p += 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, key));
+        if(mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return char_scalar(p, end, c);
+}
+
+//AVX2版本：一次32字节，剩下不足32字节的先用SSE2再逐字节。
+//用target属性单独为这两个函数打开AVX2，其余代码仍按基线指令集编译，只有CPU支持时才会被调用
+__attribute__((target("avx2")))
+static const char* line_end_avx2(const char* p, const char* end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for(; end - p >= 32; p += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf));
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if(mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return line_end_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* char_avx2(const char* p, const char* end, char c)
+{
+    const __m256i key = _mm256_set1_epi8(c);
+    for(; end - p >= 32; p += 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, key));
+        if(mask){
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return char_sse2(p, end, c);
+}
+#endif
+
+static const scan_impl g_impls[] = {
+#ifdef SCAN_X86
+    {"avx2", line_end_avx2, char_avx2},
+    {"sse2", line_end_sse2, char_sse2},
+#endif
+    {"scalar", line_end_scalar, char_scalar},
+};
+static const int IMPL_NUM = sizeof(g_impls) / sizeof(g_impls[0]);
+
+static bool impl_supported(const scan_impl* impl)
+{
+#ifdef SCAN_X86
+    if(strcmp(impl->name, "avx2") == 0){
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return true;
+}
+
+//g_impls按从快到慢排列，取第一个CPU支持的
+static const scan_impl* pick_impl()
+{
+    for(int i = 0; i < IMPL_NUM; i++){
+        if(impl_supported(g_impls + i)){
+            return g_impls + i;
+        }
+    }
+    return g_impls + IMPL_NUM - 1;
+}
+
+static const scan_impl* g_current = pick_impl();
+
+const char* scan_line_end(const char* begin, const char* end)
+{
+    return g_current->line_end(begin, end);
+}
+
+const char* scan_char(const char* begin, const char* end, char c)
+{
+    return g_current->find_char(begin, end, c);
+}
+
+const char* scan_impl_name()
+{
+    return g_current->name;
+}
+
+bool scan_select(const char* name)
+{
+    for(int i = 0; i < IMPL_NUM; i++){
+        if(strcmp(g_impls[i].name, name) == 0 && impl_supported(g_impls + i)){
+            g_current = g_impls + i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,25 @@
+/********************************************************************
+@FileName:line_scan.h
+@Version: 1.0
+@Notes:   请求行/请求头的向量化扫描。parse_line原来逐字节找\r、\n，这里一次比较16字节（SSE2）或32字节（AVX2），
+          用movemask得到命中位图，取最低位就是第一个命中的位置。
+          · x86-64上SSE2总是可用，作为基线；CPU支持AVX2时在程序启动时切换到AVX2版本（运行时选择，不需要-mavx2编译）
+          · 不足一个向量的尾部逐字节处理，不会读到end之后
+          · 其他架构只有逐字节版本
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/26 14:12:08
+********************************************************************/
+#ifndef _LINE_SCAN_H_
+#define _LINE_SCAN_H_
+
+//在[begin, end)中找第一个'\r'或'\n'，没有返回end
+const char* scan_line_end(const char* begin, const char* end);
+//在[begin, end)中找第一个字符c，没有返回end（请求头中找':'）
+const char* scan_char(const char* begin, const char* end, char c);
+//当前使用的实现："avx2"、"sse2"或"scalar"
+const char* scan_impl_name();
+//指定实现（压测对比用），CPU不支持或名字不对返回false，不改变当前实现
+bool scan_select(const char* name);
+
+#endif
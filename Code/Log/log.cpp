@@ -0,0 +1,177 @@
+/********************************************************************
+@FileName:log.cpp
+@Version: 1.0
+@Notes:   异步日志实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/22 19:21:10
+********************************************************************/
+#include"log.h"
+#include<stdio.h>
+#include<stdarg.h>
+#include<string.h>
+#include<time.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/syscall.h>
+#include"../Wrap/wrap.h"
+
+std::atomic<int> Log::m_level(LOG_LEVEL_INFO);
+
+static const char* level_name[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+Log::Log():m_fd(STDOUT_FILENO), m_running(false){}
+
+Log* Log::get_instance()
+{
+    static Log instance;
+    return &instance;
+}
+
+/********************************************************************
+@FunName:bool Log::init(const char* path, int level)
+@Input:  path：日志文件路径，NULL表示写到标准输出
+         level：运行时日志级别，LOG_LEVEL_DEBUG ~ LOG_LEVEL_ERROR
+@Output: None
+@Retuval:true：成功。false：日志文件打不开或刷新线程创建失败
+@Notes:  打开日志文件，启动后台刷新线程。在init之前写的日志留在各线程的环形缓冲区里，刷新线程启动后写出
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/22 19:35:02
+********************************************************************/
+bool Log::init(const char* path, int level)
+{
+    set_level(level);
+    if(path){
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if(fd < 0){
+            return false;
+        }
+        m_fd = fd;
+    }
+    m_running = true;
+    pthread_t tid;
+    if(pthread_create(&tid, NULL, flush_thread, this) != 0){
+        m_running = false;
+        return false;
+    }
+    pthread_detach(tid);
+    return true;
+}
+
+//当前线程的环形缓冲区。线程第一次写日志时分配并登记，之后只是读一个线程局部变量
+Log::ring* Log::thread_ring()
+{
+    static __thread ring* t_ring = NULL;
+    if(!t_ring){
+        t_ring = new ring;
+        m_rings_lock.lock();
+        m_rings.push_back(t_ring);
+        m_rings_lock.unlock();
+    }
+    return t_ring;
+}
+
+/********************************************************************
+@FunName:void Log::write_log(int level, const char* format, ...)
+@Input:  level：日志级别
+         format、...：printf格式
+@Output: None
+@Retuval:None
+@Notes:  格式化为一行"时间 级别 [线程号] 内容\n"，拷进当前线程的环形缓冲区。
+         时间字符串每个线程每秒只用localtime_r格式化一次；缓冲区放不下时丢弃并计数
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/22 19:48:33
+********************************************************************/
+void Log::write_log(int level, const char* format, ...)
+{
+    static __thread time_t t_sec = 0;
+    static __thread char t_time[32];
+    static __thread int t_tid = 0;
+
+    ring* r = thread_ring();
+    if(!t_tid){
+        t_tid = syscall(SYS_gettid);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if(ts.tv_sec != t_sec){
+        struct tm tm_now;
+        localtime_r(&ts.tv_sec, &tm_now);
+        strftime(t_time, sizeof(t_time), "%Y-%m-%d %H:%M:%S", &tm_now);
+        t_sec = ts.tv_sec;
+    }
+
+    char line[LINE_SIZE];
+    int n = snprintf(line, LINE_SIZE, "%s.%06ld %s [%d] ", t_time, ts.tv_nsec / 1000,
+                     level_name[level < 0 ? 0 : (level > 3 ? 3 : level)], t_tid);
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(line + n, LINE_SIZE - n - 1, format, arg_list);
+    va_end(arg_list);
+    if(len < 0){
+        len = 0;
+    }
+    n += len < LINE_SIZE - n - 1 ? len : LINE_SIZE - n - 2;    //超长截断
+    line[n++] = '\n';
+
+    size_t head = r->head.load(std::memory_order_relaxed);
+    size_t tail = r->tail.load(std::memory_order_acquire);
+    if(RING_SIZE - (head - tail) < (size_t)n){
+        r->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    size_t pos = head & (RING_SIZE - 1);
+    size_t first = RING_SIZE - pos < (size_t)n ? RING_SIZE - pos : n;
+    memcpy(r->buf + pos, line, first);
+    memcpy(r->buf, line + first, n - first);
+    r->head.store(head + n, std::memory_order_release);
+}
+
+//把所有环形缓冲区中的日志写出去，写出了数据返回true
+bool Log::drain()
+{
+    bool wrote = false;
+    m_drain_lock.lock();
+    m_rings_lock.lock();
+    for(size_t i = 0; i < m_rings.size(); i++){
+        ring* r = m_rings[i];
+        size_t tail = r->tail.load(std::memory_order_relaxed);
+        size_t head = r->head.load(std::memory_order_acquire);
+        if(head != tail){
+            size_t pos = tail & (RING_SIZE - 1);
+            size_t len = head - tail;
+            size_t first = RING_SIZE - pos < len ? RING_SIZE - pos : len;
+            Writen(m_fd, r->buf + pos, first);
+            Writen(m_fd, r->buf, len - first);
+            r->tail.store(head, std::memory_order_release);
+            wrote = true;
+        }
+        unsigned dropped = r->dropped.exchange(0, std::memory_order_relaxed);
+        if(dropped){
+            char line[64];
+            int n = snprintf(line, sizeof(line), "日志缓冲区满，丢弃了%u条日志\n", dropped);
+            Writen(m_fd, line, n);
+        }
+    }
+    m_rings_lock.unlock();
+    m_drain_lock.unlock();
+    return wrote;
+}
+
+void Log::flush()
+{
+    drain();
+}
+
+void* Log::flush_thread(void* arg)
+{
+    Log* log = (Log*)arg;
+    while(log->m_running){
+        if(!log->drain()){
+            usleep(FLUSH_INTERVAL_US);
+        }
+    }
+    return log;
+}
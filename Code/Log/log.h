@@ -0,0 +1,115 @@
+/********************************************************************
+@FileName:log.h
+@Version: 1.0
+@Notes:   异步日志。代替原来散落在各处的std::cout：
+          · 每个线程第一次写日志时注册一个自己的环形缓冲区（单生产者单消费者，无锁），
+            写日志只是格式化到栈上再拷进自己的环形缓冲区，线程之间不抢同一把锁，也没有系统调用
+          · 后台刷新线程轮询所有环形缓冲区，批量write到日志文件（默认标准输出）
+          · 运行时级别：低于当前级别的日志在格式化之前就返回（命令行-v设置）
+          · 编译期级别：LOG_MIN_LEVEL以下的宏展开为空语句，连级别判断都没有（Makefile中-DLOG_MIN_LEVEL=1去掉LOG_DEBUG）
+          环形缓冲区满时丢弃这条日志并计数，不阻塞工作线程
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/22 19:20:41
+********************************************************************/
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include<stddef.h>
+#include<stdint.h>
+#include<atomic>
+#include<vector>
+#include<pthread.h>
+#include"../Pool/locker.h"
+#include"../Pool/mpmc_queue.h"  //CACHE_LINE_SIZE
+
+//日志级别
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+
+//编译期最低级别，低于它的日志语句不编译进程序
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+class Log{
+public:
+    static Log* get_instance();
+
+    //打开日志文件（path为NULL则写标准输出）并启动刷新线程，level为运行时级别
+    bool init(const char* path, int level);
+    //把所有缓冲区中的日志写出去（进程退出前调用）
+    void flush();
+
+    //格式化一条日志写入当前线程的环形缓冲区
+    void write_log(int level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+    static int level() { return m_level.load(std::memory_order_relaxed); }
+    static void set_level(int level) { m_level.store(level, std::memory_order_relaxed); }
+
+    static const size_t RING_SIZE = 64 * 1024;  //每个线程的环形缓冲区大小，2的幂
+    static const int LINE_SIZE = 1024;          //一条日志的最大长度，超出截断
+    static const int FLUSH_INTERVAL_US = 10000; //刷新线程没有日志可写时的睡眠时间
+
+private:
+    //单生产者（所属线程）单消费者（刷新线程）的字节环形缓冲区。head、tail只增不减，取下标时按位与
+    struct ring{
+        std::atomic<size_t> head;   //生产者写到的位置
+        char pad0[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail;   //消费者读到的位置
+        char pad1[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+        std::atomic<unsigned> dropped;  //缓冲区满丢弃的日志条数
+        char buf[RING_SIZE];
+        ring():head(0), tail(0), dropped(0){}
+    };
+
+    Log();
+    ~Log(){}
+    Log(const Log&);
+    void operator=(const Log&);
+
+    ring* thread_ring();        //当前线程的环形缓冲区，第一次调用时注册
+    bool drain();               //把所有环形缓冲区写出去，有数据返回true
+    static void* flush_thread(void* arg);
+
+    static std::atomic<int> m_level;
+    int m_fd;                   //日志文件
+    bool m_running;
+    locker m_rings_lock;        //只在注册新线程、刷新时遍历用
+    std::vector<ring*> m_rings;
+    locker m_drain_lock;        //刷新线程和flush()不同时写
+};
+
+//被编译期级别去掉的日志：if(0)里的语句会被编译器整体删除，但参数仍然做格式检查，也不会产生"变量未使用"的警告
+#define LOG_NONE(lv, format, ...) \
+    do{ \
+        if(0){ \
+            Log::get_instance()->write_log(lv, format, ##__VA_ARGS__); \
+        } \
+    }while(0)
+
+#define LOG_BASE(lv, format, ...) \
+    do{ \
+        if(Log::level() <= (lv)){ \
+            Log::get_instance()->write_log(lv, format, ##__VA_ARGS__); \
+        } \
+    }while(0)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) LOG_BASE(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) LOG_NONE(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) LOG_BASE(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) LOG_NONE(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#endif
+
+#define LOG_WARN(format, ...) LOG_BASE(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_BASE(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+
+#endif
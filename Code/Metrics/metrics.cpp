@@ -0,0 +1,268 @@
+/********************************************************************
+@FileName:metrics.cpp
+@Version: 1.0
+@Notes:   运行指标的记录和Prometheus文本格式输出
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/05 10:40:18
+********************************************************************/
+#include"metrics.h"
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdarg.h>
+#include<new>
+
+locker metrics::m_lock;
+std::vector<thread_metrics*> metrics::m_threads;
+std::vector<metrics::gauge> metrics::m_gauges;
+
+//按状态码统计的响应数对应的状态码
+static const int STATUS_CODES[STATUS_OTHER] = {200, 206, 304, 400, 403, 404, 416, 500};
+//延迟直方图按Prometheus的histogram输出时的桶上界（秒），由HDR的桶合并而成
+static const double LATENCY_BOUNDS[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                                        0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+//另外按summary输出的分位数，由HDR直方图直接算出
+static const double LATENCY_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+int hdr_histogram::index(uint64_t v)
+{
+    if(v < (uint64_t)SUB_COUNT){
+        return v;
+    }
+    int e = 63 - __builtin_clzll(v);    //最高位
+    if(e >= MAX_BITS){
+        return BUCKETS - 1;
+    }
+    int bucket = e - SUB_BITS + 1;
+    int sub = (v >> (e - SUB_BITS)) - SUB_COUNT;    //最高位后面的SUB_BITS位
+    return bucket * SUB_COUNT + sub;
+}
+
+uint64_t hdr_histogram::lower(int idx)
+{
+    int bucket = idx / SUB_COUNT;
+    int sub = idx % SUB_COUNT;
+    if(bucket == 0){
+        return sub;
+    }
+    return (uint64_t)(SUB_COUNT + sub) << (bucket - 1);
+}
+
+uint64_t hdr_histogram::upper(int idx)
+{
+    int bucket = idx / SUB_COUNT;
+    if(bucket == 0){
+        return lower(idx);
+    }
+    return lower(idx) + ((uint64_t)1 << (bucket - 1)) - 1;
+}
+
+/********************************************************************
+@FunName:thread_metrics& metrics::local()
+@Input:  None
+@Output: None
+@Retuval:本线程的计数器
+@Notes:  第一次调用时分配一块按缓存行对齐的计数器（不和别的线程的计数器共享缓存行），加锁登记到m_threads。
+         以后只是读一次thread_local的指针
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/05 10:46:52
+********************************************************************/
+thread_metrics& metrics::local()
+{
+    static thread_local thread_metrics* t = NULL;
+    if(!t){
+        void* p = NULL;
+        if(posix_memalign(&p, 64, sizeof(thread_metrics)) != 0){
+            throw std::bad_alloc();
+        }
+        t = new(p) thread_metrics();     //值初始化，计数器全为0
+        m_lock.lock();
+        m_threads.push_back(t);
+        m_lock.unlock();
+    }
+    return *t;
+}
+
+static int status_index(int status)
+{
+    for(int i = 0; i < STATUS_OTHER; i++){
+        if(STATUS_CODES[i] == status){
+            return i;
+        }
+    }
+    return STATUS_OTHER;
+}
+
+void metrics::response(int status)
+{
+    add(local().responses[status_index(status)], 1);
+}
+
+void metrics::sent(long bytes)
+{
+    add(local().sent_bytes, bytes);
+}
+
+void metrics::conn_opened()
+{
+    add(local().conn_opened, 1);
+}
+
+void metrics::conn_closed()
+{
+    add(local().conn_closed, 1);
+}
+
+void metrics::pool_rejected()
+{
+    add(local().pool_rejected, 1);
+}
+
+void metrics::recv_nobufs()
+{
+    add(local().recv_nobufs, 1);
+}
+
+void metrics::latency(uint64_t us, int count)
+{
+    thread_metrics& t = local();
+    add(t.latency[hdr_histogram::index(us)], count);
+    add(t.latency_sum, us * count);
+}
+
+void metrics::add_gauge(const char* name, const char* help, std::function<long()> read)
+{
+    m_lock.lock();
+    m_gauges.push_back(gauge{name, help, read});
+    m_lock.unlock();
+}
+
+//格式化追加到out
+static void appendf(std::string& out, const char* format, ...)
+{
+    char line[256];
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(line, sizeof(line), format, arg_list);
+    va_end(arg_list);
+    if(len > 0){
+        out.append(line, len < (int)sizeof(line) ? len : sizeof(line) - 1);
+    }
+}
+
+static void family(std::string& out, const char* name, const char* type, const char* help)
+{
+    appendf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/********************************************************************
+@FunName:void metrics::render(std::string& out)
+@Input:  None
+@Output: out：追加Prometheus文本格式（0.0.4）的指标
+@Retuval:None
+@Notes:  加锁把所有线程的计数器加到局部变量（各线程还在并发记录，每个计数器单独读，总和是抓取那一刻附近的值），
+         gauge在锁内调用回调。延迟同时输出成histogram（固定的桶上界，由HDR的桶合并，最多有一个HDR桶的误差）
+         和summary（HDR直方图直接算的分位数，取所在桶的上界）
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/05 11:02:25
+********************************************************************/
+void metrics::render(std::string& out)
+{
+    uint64_t responses[STATUS_NUM] = {0};
+    uint64_t sent_bytes = 0, opened = 0, closed = 0, rejected = 0, nobufs = 0, latency_sum = 0, latency_count = 0;
+    std::vector<uint64_t> hist(hdr_histogram::BUCKETS, 0);
+
+    m_lock.lock();
+    for(size_t i = 0; i < m_threads.size(); i++){
+        thread_metrics* t = m_threads[i];
+        for(int s = 0; s < STATUS_NUM; s++){
+            responses[s] += t->responses[s].load(std::memory_order_relaxed);
+        }
+        sent_bytes += t->sent_bytes.load(std::memory_order_relaxed);
+        opened += t->conn_opened.load(std::memory_order_relaxed);
+        closed += t->conn_closed.load(std::memory_order_relaxed);
+        rejected += t->pool_rejected.load(std::memory_order_relaxed);
+        nobufs += t->recv_nobufs.load(std::memory_order_relaxed);
+        latency_sum += t->latency_sum.load(std::memory_order_relaxed);
+        for(int b = 0; b < hdr_histogram::BUCKETS; b++){
+            hist[b] += t->latency[b].load(std::memory_order_relaxed);
+        }
+    }
+    std::vector<long> gauges(m_gauges.size());
+    for(size_t i = 0; i < m_gauges.size(); i++){
+        gauges[i] = m_gauges[i].read();
+    }
+    m_lock.unlock();
+    for(int b = 0; b < hdr_histogram::BUCKETS; b++){
+        latency_count += hist[b];
+    }
+
+    family(out, "webserver_responses_total", "counter", "HTTP responses by status code.");
+    for(int s = 0; s < STATUS_OTHER; s++){
+        appendf(out, "webserver_responses_total{code=\"%d\"} %llu\n", STATUS_CODES[s], (unsigned long long)responses[s]);
+    }
+    appendf(out, "webserver_responses_total{code=\"other\"} %llu\n", (unsigned long long)responses[STATUS_OTHER]);
+
+    family(out, "webserver_sent_bytes_total", "counter", "Bytes written to client sockets.");
+    appendf(out, "webserver_sent_bytes_total %llu\n", (unsigned long long)sent_bytes);
+
+    family(out, "webserver_connections_accepted_total", "counter", "Accepted client connections.");
+    appendf(out, "webserver_connections_accepted_total %llu\n", (unsigned long long)opened);
+    family(out, "webserver_connections_active", "gauge", "Open client connections.");
+    appendf(out, "webserver_connections_active %lld\n", (long long)(opened - closed));
+
+    family(out, "webserver_pool_rejected_total", "counter", "Tasks rejected by the thread pool because its queue was full.");
+    appendf(out, "webserver_pool_rejected_total %llu\n", (unsigned long long)rejected);
+
+    family(out, "webserver_uring_recv_nobufs_total", "counter", "io_uring receives that found no free provided buffer.");
+    appendf(out, "webserver_uring_recv_nobufs_total %llu\n", (unsigned long long)nobufs);
+
+    //histogram：le的计数是累计的
+    family(out, "webserver_request_duration_seconds", "histogram",
+           "Time from the last read of a request to the last byte of its response handed to the kernel.");
+    uint64_t cum = 0;
+    int b = 0;
+    for(size_t i = 0; i < sizeof(LATENCY_BOUNDS) / sizeof(LATENCY_BOUNDS[0]); i++){
+        uint64_t bound = LATENCY_BOUNDS[i] * 1e6 + 0.5;
+        for(; b < hdr_histogram::BUCKETS && hdr_histogram::upper(b) <= bound; b++){
+            cum += hist[b];
+        }
+        appendf(out, "webserver_request_duration_seconds_bucket{le=\"%g\"} %llu\n", LATENCY_BOUNDS[i], (unsigned long long)cum);
+    }
+    appendf(out, "webserver_request_duration_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)latency_count);
+    appendf(out, "webserver_request_duration_seconds_sum %.6f\n", latency_sum / 1e6);
+    appendf(out, "webserver_request_duration_seconds_count %llu\n", (unsigned long long)latency_count);
+
+    //summary：分位数取第一个累计数达到count*q的桶
+    family(out, "webserver_request_duration_hdr_seconds", "summary",
+           "Request duration quantiles from the HDR histogram (about 3% relative error).");
+    for(size_t i = 0; i < sizeof(LATENCY_QUANTILES) / sizeof(LATENCY_QUANTILES[0]); i++){
+        double q = LATENCY_QUANTILES[i];
+        uint64_t value = 0;
+        if(latency_count > 0){
+            uint64_t rank = (uint64_t)(q * latency_count + 0.5);
+            if(rank == 0){
+                rank = 1;
+            }
+            cum = 0;
+            for(b = 0; b < hdr_histogram::BUCKETS; b++){
+                cum += hist[b];
+                if(cum >= rank){
+                    value = hdr_histogram::upper(b);
+                    break;
+                }
+            }
+        }
+        appendf(out, "webserver_request_duration_hdr_seconds{quantile=\"%g\"} %.6f\n", q, value / 1e6);
+    }
+    appendf(out, "webserver_request_duration_hdr_seconds_sum %.6f\n", latency_sum / 1e6);
+    appendf(out, "webserver_request_duration_hdr_seconds_count %llu\n", (unsigned long long)latency_count);
+
+    //登记后不会删除，不加锁读名字
+    for(size_t i = 0; i < gauges.size(); i++){
+        family(out, m_gauges[i].name, "gauge", m_gauges[i].help);
+        appendf(out, "%s %ld\n", m_gauges[i].name, gauges[i]);
+    }
+}
@@ -0,0 +1,105 @@
+/********************************************************************
+@FileName:metrics.h
+@Version: 1.0
+@Notes:   运行指标，由内置的/__metrics页面按Prometheus文本格式输出：
+          按状态码的响应数、发送字节数、在线连接数、线程池排队任务数和append被拒绝的次数、
+          io_uring接收缓冲区用光的次数、请求延迟的HDR直方图。
+          · 每个线程（事件循环、工作线程、io_uring线程）第一次记录时分配一块自己的计数器（thread_metrics），登记到全局列表。
+            计数器只由所属线程写，用relaxed的读+写（不是fetch_add，没有lock前缀），线程之间不写同一个缓存行；
+          · 抓取时加锁遍历列表，把所有线程的计数器加起来。线程退出后它的计数器块保留，累计值不会变小；
+          · 排队任务数这类不适合在记录时维护的值登记成gauge，抓取时调用回调读出
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/05 10:12:36
+********************************************************************/
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include<stdint.h>
+#include<time.h>
+#include<atomic>
+#include<string>
+#include<vector>
+#include<functional>
+#include"../Pool/locker.h"
+
+//HDR直方图的桶划分（单位微秒）：每个2的幂区间再等分成SUB_COUNT个桶，所以任何值的相对误差不超过1/SUB_COUNT（约3%），
+//从1微秒到67秒只要BUCKETS个桶，记录一个值只是一次clz和移位
+class hdr_histogram{
+public:
+    static const int SUB_BITS = 5;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_BITS = 26;             //能区分的最大值2^26-1微秒，约67秒，再大的按最大值记
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    static int index(uint64_t v);       //v所在的桶
+    static uint64_t lower(int idx);     //桶中最小的值
+    static uint64_t upper(int idx);     //桶中最大的值
+};
+
+//按状态码统计的响应数的下标，不在表中的状态码记在STATUS_OTHER
+enum STATUS_INDEX{
+    STATUS_200 = 0,
+    STATUS_206,
+    STATUS_304,
+    STATUS_400,
+    STATUS_403,
+    STATUS_404,
+    STATUS_416,
+    STATUS_500,
+    STATUS_OTHER,
+    STATUS_NUM
+};
+
+//一个线程的计数器，只由所属线程写
+struct thread_metrics{
+    std::atomic<uint64_t> responses[STATUS_NUM];
+    std::atomic<uint64_t> sent_bytes;
+    std::atomic<uint64_t> conn_opened;      //在线连接数是所有线程的opened-closed（连接由接收它的事件循环打开和关闭）
+    std::atomic<uint64_t> conn_closed;
+    std::atomic<uint64_t> pool_rejected;
+    std::atomic<uint64_t> recv_nobufs;      //io_uring的recv因为接收缓冲区用光而失败的次数
+    std::atomic<uint64_t> latency_sum;      //微秒
+    std::atomic<uint64_t> latency[hdr_histogram::BUCKETS];
+};
+
+class metrics{
+public:
+    //记录，在任意线程中调用，只写本线程的计数器
+    static void response(int status);
+    static void sent(long bytes);
+    static void conn_opened();
+    static void conn_closed();
+    static void pool_rejected();
+    static void recv_nobufs();
+    static void latency(uint64_t us, int count);    //count个请求的延迟都是us（一批流水线响应一起发完）
+
+    //登记一个抓取时才读的值（比如线程池的排队任务数），服务器启动时调用
+    static void add_gauge(const char* name, const char* help, std::function<long()> read);
+    //把所有线程的计数器加起来，按Prometheus文本格式追加到out
+    static void render(std::string& out);
+
+    static uint64_t now_us(){
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+private:
+    struct gauge{
+        const char* name;
+        const char* help;
+        std::function<long()> read;
+    };
+
+    static thread_metrics& local();     //本线程的计数器，第一次调用时分配并登记
+    static void add(std::atomic<uint64_t>& c, uint64_t n){
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static locker m_lock;               //保护下面两个列表
+    static std::vector<thread_metrics*> m_threads;
+    static std::vector<gauge> m_gauges;
+};
+
+#endif
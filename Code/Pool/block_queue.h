@@ -0,0 +1,58 @@
+/********************************************************************
+@FileName:block_queue.h
+@Version: 1.0
+@Notes:   线程池原来的请求队列：std::list + 互斥锁 + 信号量。
+          线程池已改用mpmc_queue，这里保留下来给Bench/queue_bench.cpp做对比
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/14 21:40:02
+********************************************************************/
+#ifndef _BLOCK_QUEUE_H_
+#define _BLOCK_QUEUE_H_
+
+#include<list>
+#include"locker.h"
+
+template<class T>
+class block_queue
+{
+public:
+    explicit block_queue(int max_requests):m_max_requests(max_requests){}
+
+    //向队列中添加元素，队列满返回false
+    bool push(const T& data){
+        m_queuelocker.lock();   //上锁，线程同步
+        if(m_workqueue.size() > (size_t)m_max_requests){
+            m_queuelocker.unlock();
+            return false;
+        }
+        m_workqueue.push_back(data);
+        m_queuelocker.unlock();
+        m_queuestat.post();
+        return true;
+    }
+
+    //取一个元素，队列空时阻塞
+    T pop(){
+        while(true){
+            m_queuestat.wait();//若信号量>0,则-1，否则阻塞在此
+            m_queuelocker.lock();
+            if(m_workqueue.empty()){
+                m_queuelocker.unlock();
+                continue;
+            }
+            T data = m_workqueue.front();
+            m_workqueue.pop_front();
+            m_queuelocker.unlock();
+            return data;
+        }
+    }
+
+private:
+    int m_max_requests;
+    std::list<T> m_workqueue;
+    locker m_queuelocker;
+    sem m_queuestat;
+};
+
+#endif
@@ -13,6 +13,10 @@
 #include<pthread.h>
 #include<semaphore.h>
 #include<exception> //异常相关头文件
+#include<atomic>
+#include<unistd.h>
+#include<sys/syscall.h>
+#include<linux/futex.h>
 
 //线程同步机制封装类
 
@@ -114,6 +118,57 @@ private:
 };
 
 
+//事件计数器（eventcount），配合无锁队列使用：先自旋，实在等不到再在futex上睡眠。
+//消费者：key = prepare_wait(); 再检查一次条件; 不满足则wait(key)，满足则cancel_wait()
+//生产者：改变条件之后notify()，没有睡眠者时只是一次原子读，不进内核
+class eventcount{
+public:
+    eventcount():m_seq(0), m_waiters(0){}
+
+    //登记为等待者并返回当前序号。必须在最后一次检查条件之前调用，否则可能丢失唤醒
+    unsigned prepare_wait(){
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        return m_seq.load(std::memory_order_seq_cst);
+    }
+
+    //条件已经满足，不睡了
+    void cancel_wait(){
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    //序号还是key（期间没有notify）时睡眠
+    void wait(unsigned key){
+        syscall(SYS_futex, (unsigned*)&m_seq, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    //是否有线程登记了等待（调用者已经发布了数据，用于决定唤醒谁）
+    bool waiting() const{
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_waiters.load(std::memory_order_relaxed) > 0;
+    }
+
+    //唤醒一个等待者
+    void notify(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_waiters.load(std::memory_order_relaxed) > 0){
+            m_seq.fetch_add(1, std::memory_order_seq_cst);
+            syscall(SYS_futex, (unsigned*)&m_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+    }
+
+    //唤醒所有等待者
+    void notify_all(){
+        m_seq.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, (unsigned*)&m_seq, FUTEX_WAKE_PRIVATE, 0x7fffffff, NULL, NULL, 0);
+    }
+
+private:
+    std::atomic<unsigned> m_seq;        //futex字，每次notify加1
+    std::atomic<int> m_waiters;         //登记了的等待者个数
+};
+
+
 
 
 
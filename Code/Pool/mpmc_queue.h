@@ -0,0 +1,161 @@
+/********************************************************************
+@FileName:mpmc_queue.h
+@Version: 1.0
+@Notes:   无锁有界多生产者多消费者队列（Dmitry Vyukov的bounded MPMC queue）。
+          环形数组，每个槽位带一个序号seq：
+            seq == pos        ：槽位空，可以由取到pos的生产者写入
+            seq == pos + 1    ：槽位已写入，可以由取到pos的消费者读出
+          生产者/消费者各自用CAS抢m_enqueue_pos/m_dequeue_pos，抢到之后只写自己的槽位，
+          没有互斥锁，也不像std::list那样每个任务new一个节点。
+          入队位置、出队位置、槽位数组分别放在不同的缓存行上，避免生产者和消费者互相伪共享。
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/14 20:31:05
+********************************************************************/
+#ifndef _MPMC_QUEUE_H_
+#define _MPMC_QUEUE_H_
+
+#include<atomic>
+#include<exception>
+#include<stddef.h>
+#include<stdint.h>
+
+#define CACHE_LINE_SIZE 64
+
+template<class T>
+class mpmc_queue
+{
+public:
+    //capacity会向上取整为2的幂，这样取模可以用按位与
+    explicit mpmc_queue(size_t capacity);
+    ~mpmc_queue();
+
+    bool push(const T& data);   //队列满返回false
+    bool pop(T& data);          //队列空返回false
+    size_t size() const;        //近似的元素个数（并发时只作参考）
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct cell{
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    char m_pad0[CACHE_LINE_SIZE];
+    cell* m_buffer;
+    size_t m_mask;
+    char m_pad1[CACHE_LINE_SIZE - sizeof(cell*) - sizeof(size_t)];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad2[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dequeue_pos;
+    char m_pad3[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    mpmc_queue(const mpmc_queue&);
+    void operator=(const mpmc_queue&);
+};
+
+template<class T>
+mpmc_queue<T>::mpmc_queue(size_t capacity){
+    if(capacity < 2){
+        capacity = 2;
+    }
+    size_t n = 1;
+    while(n < capacity){
+        n <<= 1;
+    }
+    m_buffer = new cell[n];
+    if(!m_buffer){
+        throw std::exception();
+    }
+    m_mask = n - 1;
+    for(size_t i = 0; i < n; i++){
+        m_buffer[i].seq.store(i, std::memory_order_relaxed);
+    }
+    m_enqueue_pos.store(0, std::memory_order_relaxed);
+    m_dequeue_pos.store(0, std::memory_order_relaxed);
+}
+
+template<class T>
+mpmc_queue<T>::~mpmc_queue(){
+    delete [] m_buffer;
+}
+
+/********************************************************************
+@FunName:bool mpmc_queue<T>::push(const T& data)
+@Input:  data：要入队的元素
+@Output: None
+@Retuval:true：入队成功。false：队列满
+@Notes:  抢一个入队位置pos，等它的槽位seq==pos（空）时写入数据，再把seq置为pos+1发布给消费者
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/14 20:40:12
+********************************************************************/
+template<class T>
+bool mpmc_queue<T>::push(const T& data){
+    cell* c;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    for(;;){
+        c = &m_buffer[pos & m_mask];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if(dif == 0){
+            //槽位空，抢这个位置
+            if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        }else if(dif < 0){
+            //槽位还没被消费者取走，队列满
+            return false;
+        }else{
+            //被别的生产者抢先了，重新读位置
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    c->data = data;
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+/********************************************************************
+@FunName:bool mpmc_queue<T>::pop(T& data)
+@Input:  None
+@Output: data：出队的元素
+@Retuval:true：出队成功。false：队列空
+@Notes:  抢一个出队位置pos，等它的槽位seq==pos+1（已写入）时读出数据，
+         再把seq置为pos+容量，留给下一圈的生产者
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/14 20:46:37
+********************************************************************/
+template<class T>
+bool mpmc_queue<T>::pop(T& data){
+    cell* c;
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    for(;;){
+        c = &m_buffer[pos & m_mask];
+        size_t seq = c->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if(dif == 0){
+            if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                break;
+            }
+        }else if(dif < 0){
+            //队列空
+            return false;
+        }else{
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    data = c->data;
+    c->seq.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+}
+
+template<class T>
+size_t mpmc_queue<T>::size() const{
+    size_t enq = m_enqueue_pos.load(std::memory_order_relaxed);
+    size_t deq = m_dequeue_pos.load(std::memory_order_relaxed);
+    return enq > deq ? enq - deq : 0;
+}
+
+#endif
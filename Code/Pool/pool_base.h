@@ -0,0 +1,25 @@
+/********************************************************************
+@FileName:pool_base.h
+@Version: 1.0
+@Notes:   线程池接口。事件循环只通过这个接口投递任务，具体用共享队列的threadpool
+          还是工作窃取的ws_threadpool由命令行选择
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/18 14:10:22
+********************************************************************/
+#ifndef _POOL_BASE_H_
+#define _POOL_BASE_H_
+
+template<class T>
+class pool_base
+{
+public:
+    virtual ~pool_base(){}
+
+    //添加任务。affinity：亲和性提示（通常是连接的fd），同一个值尽量交给同一个工作线程，共享队列的线程池忽略它
+    virtual bool append(T* request, int affinity) = 0;
+    //排队等待处理的任务数（近似值，抓取指标时用）
+    virtual long queued() = 0;
+};
+
+#endif
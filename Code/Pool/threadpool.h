@@ -1,7 +1,8 @@
 /********************************************************************
 @FileName:threadpool.h
 @Version: 1.0
-@Notes:   线程池类
+@Notes:   线程池类。请求队列是无锁有界队列mpmc_queue，append不加锁也不分配内存；
+          工作线程取不到任务时先自旋一会儿，再在eventcount（futex）上睡眠
 @Author:  XiaoDexin
 @Email:   xiaodexin0701@163.com
 @Date:    2022/05/03 13:48:06
@@ -9,19 +10,22 @@
 #ifndef _THREADPOOL_H_
 #define _THREADPOOL_H_
 #include<pthread.h>
-#include<list>
 #include<exception>
-#include<cstdio>
 #include"locker.h"
+#include"../Log/log.h"
+#include"mpmc_queue.h"
+#include"pool_base.h"
+#include"../Metrics/metrics.h"
 
 //线程池类
 template<class T>       //定义成模板是为了代码复用，模板参数T是任务类
-class threadpool
+class threadpool : public pool_base<T>
 {
 public:
     threadpool(int thread_number = 8, int max_requests = 10000);
     ~threadpool();
-    bool append(T* request);
+    bool append(T* request, int affinity = 0);   //所有线程共用一个队列，affinity不起作用
+    long queued() { return m_workqueue.size(); }
 private:
     //线程数量
     int m_thread_number;
@@ -29,24 +33,22 @@ private:
     //线程池数组，大小为线程数量
     pthread_t * m_threads;
 
-    //请求队列中最多允许的等待处理的请求数量
-    int m_max_requests;
+    //请求队列（无锁有界队列），容量即请求队列中最多允许的等待处理的请求数量
+    mpmc_queue< T*> m_workqueue;
 
-    //请求队列
-    std::list< T*> m_workqueue;
-
-    //互斥锁
-    locker m_queuelocker;
-
-    //信号量用来判断是否有任务需要处理，也可以用条件变量
-    sem m_queuestat;
+    //空闲的工作线程在这上面睡眠，append时唤醒
+    eventcount m_queuestat;
 
     //是否结束线程
     bool m_stop;
+
+    //取不到任务时先自旋的次数，超过后才进内核睡眠
+    static const int SPIN_COUNT = 200;
 private:
     //子线程处理函数
     static void* worker(void* arg);
     void run();
+    T* take();  //取一个任务，没有任务时阻塞
 };
 
 /********************************************************************
@@ -62,8 +64,8 @@ private:
 ********************************************************************/
 template<typename T>
 threadpool<T>::threadpool(int thread_number, int max_requests):
-    m_thread_number(thread_number),m_max_requests(max_requests),
-    m_stop(false), m_threads(NULL){
+    m_thread_number(thread_number), m_threads(NULL),
+    m_workqueue(max_requests), m_stop(false){
     
     if((thread_number <= 0) || (max_requests) <= 0){
         throw std::exception();
@@ -77,7 +79,7 @@ threadpool<T>::threadpool(int thread_number, int max_requests):
 
     //创建thread_number个线程，并将它们设置为线程分离
     for(int i = 0; i<thread_number; i++){
-        printf("create the %dth thread\n", i);
+        LOG_INFO("create the %dth thread", i);
 
         //通过第一个参数m_threads + i就将每个子线程按顺序创建出来了
         if(pthread_create(m_threads + i, NULL, worker, (void*)this) != 0){   //C++中worker必须是一个静态函数，无法访问非静态成员，所以只能通过将this指针传给worker来实现对当前对象的非静态成员的访问
@@ -106,32 +108,29 @@ template<typename T>
 threadpool<T>::~threadpool(){
     delete [] m_threads;
     m_stop = true;
+    m_queuestat.notify_all();
 }
 
 
 /********************************************************************
-@FunName:append(T* request)
+@FunName:append(T* request, int affinity)
 @Input:  T* request:任务队列
+         affinity：亲和性提示，这里忽略
 @Output: None
-@Retuval:true：添加成功。false：添加失败
-@Notes:  向任务队列中添加任务
+@Retuval:true：添加成功。false：添加失败（请求队列满），记入指标
+@Notes:  向任务队列中添加任务。入队是一次CAS，只有在有线程睡眠时才进内核唤醒
 @Author: XiaoDexin
 @Email:  xiaodexin0701@163.com
 @Time:   2022/05/03 14:48:46
 ********************************************************************/
 template<typename T>
-bool threadpool<T>::append(T* request){
-
-    m_queuelocker.lock();   //上锁，线程同步
-    if(m_workqueue.size() > m_max_requests){
-        m_queuelocker.unlock();
+bool threadpool<T>::append(T* request, int /*affinity*/){
+    if(!m_workqueue.push(request)){
+        metrics::pool_rejected();
         return false;
     }
-
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    std::cout<<"已将该客户端添加到线程池"<<std::endl;
-    m_queuestat.post();
+    LOG_DEBUG("已将该客户端添加到线程池");
+    m_queuestat.notify();
     return true;
 }
 
@@ -149,7 +148,41 @@ template<class T>
 void* threadpool<T>::worker(void* arg){
     //注意：在静态函数里不能访问非静态成员变量/函数，只能通过传this指针来实现对当前对象的非静态成员的访问
     threadpool * pool = (threadpool*)arg;
-    pool->run();   
+    pool->run();
+    return pool;
+}
+
+/********************************************************************
+@FunName:T* take()
+@Input:  None
+@Output: None
+@Retuval:取到的任务，线程池结束时返回NULL
+@Notes:  从任务队列中取一个任务。先自旋SPIN_COUNT次（任务密集时马上就能取到，省去睡眠/唤醒的系统调用），
+         还取不到就在eventcount上睡眠。登记等待之后要再检查一次队列，避免漏掉登记前刚入队的任务
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/14 21:20:44
+********************************************************************/
+template<class T>
+T* threadpool<T>::take(){
+    T* request = NULL;
+    while(!m_stop){
+        for(int i = 0; i < SPIN_COUNT; i++){
+            if(m_workqueue.pop(request)){
+                return request;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        unsigned key = m_queuestat.prepare_wait();
+        if(m_workqueue.pop(request)){
+            m_queuestat.cancel_wait();
+            return request;
+        }
+        m_queuestat.wait(key);
+    }
+    return NULL;
 }
 
 /********************************************************************
@@ -165,22 +198,11 @@ void* threadpool<T>::worker(void* arg){
 template<class T>
 void threadpool<T>::run(){
     while(!m_stop){
-        m_queuestat.wait();//若信号量>0,则-1，否则阻塞在此
-        std::cout<<"工作线程（子线程）开始处理"<<std::endl;
-        m_queuelocker.lock();
-        if(m_workqueue.empty()){//没数据(任务)
-            m_queuelocker.unlock();
-            continue;
-        }
-
-        T* request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
-
+        T* request = take();//没有任务时阻塞在此
         if(!request){//若没有获取到则continue
             continue;
         }
-
+        LOG_DEBUG("工作线程（子线程）开始处理");
         request->process();//process：任务函数。因为用的是proactor模式，所以到这一步的时候数据已经获取到了
     }
 }
@@ -193,4 +215,3 @@ void threadpool<T>::run(){
 
 
 #endif
-
@@ -0,0 +1,133 @@
+/********************************************************************
+@FileName:ws_deque.h
+@Version: 1.0
+@Notes:   Chase-Lev工作窃取双端队列（有界版本，按Lê等人给出的C11内存序实现）。
+          只有所属的工作线程在底部push/pop（后进先出，刚放进去的任务数据还在缓存里），
+          其他线程从顶部steal（先进先出，偷走最老的任务），只有队列里剩最后一个元素时才需要CAS。
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/18 14:25:40
+********************************************************************/
+#ifndef _WS_DEQUE_H_
+#define _WS_DEQUE_H_
+
+#include<atomic>
+#include<exception>
+#include<stddef.h>
+#include<stdint.h>
+#include"mpmc_queue.h"  //CACHE_LINE_SIZE
+
+template<class T>
+class ws_deque
+{
+public:
+    //capacity会向上取整为2的幂
+    explicit ws_deque(size_t capacity);
+    ~ws_deque();
+
+    bool push(T data);      //所属线程调用，队列满返回false
+    bool pop(T& data);      //所属线程调用，从底部取，队列空返回false
+    bool steal(T& data);    //其他线程调用，从顶部偷，队列空或与别人冲突时返回false
+    bool empty() const;
+    size_t size() const;    //近似的元素个数（并发时只作参考）
+
+private:
+    std::atomic<int64_t> m_top;
+    char m_pad0[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> m_bottom;
+    char m_pad1[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+    std::atomic<T>* m_buffer;
+    int64_t m_mask;
+
+    ws_deque(const ws_deque&);
+    void operator=(const ws_deque&);
+};
+
+template<class T>
+ws_deque<T>::ws_deque(size_t capacity):m_top(0), m_bottom(0){
+    size_t n = 2;
+    while(n < capacity){
+        n <<= 1;
+    }
+    m_buffer = new std::atomic<T>[n];
+    if(!m_buffer){
+        throw std::exception();
+    }
+    m_mask = n - 1;
+}
+
+template<class T>
+ws_deque<T>::~ws_deque(){
+    delete [] m_buffer;
+}
+
+template<class T>
+bool ws_deque<T>::push(T data){
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    if(b - t > m_mask){
+        return false;
+    }
+    m_buffer[b & m_mask].store(data, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+/********************************************************************
+@FunName:bool ws_deque<T>::pop(T& data)
+@Input:  None
+@Output: data：取出的任务
+@Retuval:true：取到。false：队列空
+@Notes:  先把bottom减1“预定”底部元素，再看top。top<b时不可能和小偷冲突；
+         top==b说明只剩这一个，和小偷用CAS抢top
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/18 14:40:03
+********************************************************************/
+template<class T>
+bool ws_deque<T>::pop(T& data){
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    if(t > b){
+        //队列空，恢复bottom
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+    data = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+    if(t == b){
+        //最后一个元素
+        bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+template<class T>
+bool ws_deque<T>::steal(T& data){
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if(t >= b){
+        return false;
+    }
+    data = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+    return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+template<class T>
+bool ws_deque<T>::empty() const{
+    return m_top.load(std::memory_order_relaxed) >= m_bottom.load(std::memory_order_relaxed);
+}
+
+template<class T>
+size_t ws_deque<T>::size() const{
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
+}
+
+#endif
@@ -0,0 +1,268 @@
+/********************************************************************
+@FileName:ws_threadpool.h
+@Version: 1.0
+@Notes:   工作窃取线程池，和threadpool二选一（命令行-w）。
+          每个工作线程有自己的收件箱（mpmc_queue，事件循环线程往里放）和一个Chase-Lev双端队列（ws_deque）。
+          事件循环按连接的fd选工作线程，同一个连接的请求总落在同一个线程上，连接的数据留在那个核的缓存里；
+          工作线程先处理自己的任务，没活干时再去别的线程的双端队列/收件箱里偷。
+          没有所有线程共用的队列，append和取任务不会都挤在同一个缓存行上。
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/18 15:02:17
+********************************************************************/
+#ifndef _WS_THREADPOOL_H_
+#define _WS_THREADPOOL_H_
+#include<pthread.h>
+#include<exception>
+#include"locker.h"
+#include"../Log/log.h"
+#include"mpmc_queue.h"
+#include"ws_deque.h"
+#include"pool_base.h"
+#include"../Metrics/metrics.h"
+
+template<class T>
+class ws_threadpool : public pool_base<T>
+{
+public:
+    ws_threadpool(int thread_number = 8, int max_requests = 10000);
+    ~ws_threadpool();
+    bool append(T* request, int affinity);
+    long queued();
+private:
+    struct worker_ctx{
+        ws_threadpool* pool;
+        int id;
+        mpmc_queue<T*>* inbox;      //事件循环线程投递到这里
+        ws_deque<T*>* deque;        //只有本线程push/pop，其他线程steal
+        eventcount queuestat;       //本线程没活干时在这上面睡眠
+        char pad[CACHE_LINE_SIZE];  //相邻工作线程的eventcount不放在同一缓存行
+    };
+
+    int m_thread_number;
+    pthread_t * m_threads;
+    worker_ctx * m_workers;
+    bool m_stop;
+
+    static const int SPIN_COUNT = 200;  //找不到任务时先自旋的次数
+    static const int BATCH = 32;        //一次从收件箱搬到双端队列的最大任务数
+private:
+    static void* worker(void* arg);
+    void run(worker_ctx* self);
+    T* take(worker_ctx* self);
+    T* find_task(worker_ctx* self);
+};
+
+/********************************************************************
+@FunName:ws_threadpool(int thread_number, int max_requests)
+@Input:  thread_number：线程池线程数量
+         max_requests：请求队列中最多允许的等待处理的请求数量，平均分给各个工作线程的收件箱
+@Output: None
+@Retuval:None
+@Notes:  构造函数，给每个工作线程建好收件箱和双端队列后再创建线程
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/18 15:10:45
+********************************************************************/
+template<class T>
+ws_threadpool<T>::ws_threadpool(int thread_number, int max_requests):
+    m_thread_number(thread_number), m_threads(NULL), m_workers(NULL), m_stop(false){
+
+    if((thread_number <= 0) || (max_requests) <= 0){
+        throw std::exception();
+    }
+
+    m_threads = new pthread_t[m_thread_number];
+    m_workers = new worker_ctx[m_thread_number];
+    if(!m_threads || !m_workers){
+        throw std::exception();
+    }
+
+    int per_worker = (max_requests + thread_number - 1) / thread_number;
+    for(int i = 0; i < thread_number; i++){
+        m_workers[i].pool = this;
+        m_workers[i].id = i;
+        m_workers[i].inbox = new mpmc_queue<T*>(per_worker);
+        m_workers[i].deque = new ws_deque<T*>(BATCH);
+    }
+
+    for(int i = 0; i<thread_number; i++){
+        LOG_INFO("create the %dth thread", i);
+        if(pthread_create(m_threads + i, NULL, worker, (void*)(m_workers + i)) != 0){
+            delete [] m_threads;
+            throw std::exception();
+        }
+        if(pthread_detach(m_threads[i]) != 0){
+            delete [] m_threads;
+            throw std::exception();
+        }
+    }
+}
+
+/********************************************************************
+@FunName:~ws_threadpool()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  析构函数，通知所有工作线程退出。线程是分离的，收件箱和双端队列不释放，随进程退出回收
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/18 15:12:30
+********************************************************************/
+template<class T>
+ws_threadpool<T>::~ws_threadpool(){
+    delete [] m_threads;
+    m_stop = true;
+    for(int i = 0; i < m_thread_number; i++){
+        m_workers[i].queuestat.notify_all();
+    }
+}
+
+/********************************************************************
+@FunName:bool append(T* request, int affinity)
+@Input:  request：任务
+         affinity：亲和性提示（连接的fd），决定投递给哪个工作线程
+@Output: None
+@Retuval:true：添加成功。false：所有收件箱都满了，记入指标
+@Notes:  放进affinity对应的工作线程的收件箱（满了就依次换下一个）。
+         那个线程在睡就唤醒它；它正忙的话，唤醒一个空闲的线程过来偷
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/18 15:20:08
+********************************************************************/
+template<class T>
+bool ws_threadpool<T>::append(T* request, int affinity){
+    if(affinity < 0){
+        affinity = -affinity;
+    }
+    int home = affinity % m_thread_number;
+    int i;
+    for(i = 0; i < m_thread_number; i++){
+        if(m_workers[(home + i) % m_thread_number].inbox->push(request)){
+            break;
+        }
+    }
+    if(i == m_thread_number){
+        metrics::pool_rejected();
+        return false;
+    }
+    home = (home + i) % m_thread_number;
+    LOG_DEBUG("已将该客户端添加到线程池");
+
+    if(m_workers[home].queuestat.waiting()){
+        m_workers[home].queuestat.notify();
+        return true;
+    }
+    for(i = 1; i < m_thread_number; i++){
+        worker_ctx* idle = m_workers + (home + i) % m_thread_number;
+        if(idle->queuestat.waiting()){
+            idle->queuestat.notify();
+            break;
+        }
+    }
+    return true;
+}
+
+//所有收件箱和双端队列中的任务数之和，各个队列分别读，只是近似值
+template<class T>
+long ws_threadpool<T>::queued(){
+    long n = 0;
+    for(int i = 0; i < m_thread_number; i++){
+        n += m_workers[i].inbox->size() + m_workers[i].deque->size();
+    }
+    return n;
+}
+
+template<class T>
+void* ws_threadpool<T>::worker(void* arg){
+    worker_ctx* self = (worker_ctx*)arg;
+    self->pool->run(self);
+    return self->pool;
+}
+
+/********************************************************************
+@FunName:T* find_task(worker_ctx* self)
+@Input:  self：当前工作线程
+@Output: None
+@Retuval:找到的任务，没有返回NULL
+@Notes:  查找顺序：自己的双端队列 -> 自己的收件箱（一次搬BATCH个进双端队列，让别人可以偷）
+         -> 从下一个线程开始依次偷别人的双端队列和收件箱
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/18 15:31:52
+********************************************************************/
+template<class T>
+T* ws_threadpool<T>::find_task(worker_ctx* self){
+    T* request = NULL;
+    if(self->deque->pop(request)){
+        return request;
+    }
+    if(self->inbox->pop(request)){
+        T* more = NULL;
+        for(int i = 1; i < BATCH && self->inbox->pop(more); i++){
+            if(!self->deque->push(more)){
+                //双端队列此时是空的，容量不小于BATCH，不会走到这里
+                self->inbox->push(more);
+                break;
+            }
+        }
+        return request;
+    }
+    for(int i = 1; i < m_thread_number; i++){
+        worker_ctx* victim = m_workers + (self->id + i) % m_thread_number;
+        if(victim->deque->steal(request)){
+            return request;
+        }
+        if(victim->inbox->pop(request)){
+            return request;
+        }
+    }
+    return NULL;
+}
+
+/********************************************************************
+@FunName:T* take(worker_ctx* self)
+@Input:  self：当前工作线程
+@Output: None
+@Retuval:取到的任务，线程池结束时返回NULL
+@Notes:  和threadpool::take一样先自旋再睡眠。登记等待之后要把所有地方再找一遍，
+         append在放入任务之后才检查谁在等待，这样不会漏掉唤醒
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/18 15:40:26
+********************************************************************/
+template<class T>
+T* ws_threadpool<T>::take(worker_ctx* self){
+    T* request = NULL;
+    while(!m_stop){
+        for(int i = 0; i < SPIN_COUNT; i++){
+            if((request = find_task(self)) != NULL){
+                return request;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        unsigned key = self->queuestat.prepare_wait();
+        if((request = find_task(self)) != NULL){
+            self->queuestat.cancel_wait();
+            return request;
+        }
+        self->queuestat.wait(key);
+    }
+    return NULL;
+}
+
+template<class T>
+void ws_threadpool<T>::run(worker_ctx* self){
+    while(!m_stop){
+        T* request = take(self);
+        if(!request){
+            continue;
+        }
+        LOG_DEBUG("工作线程（子线程）开始处理");
+        request->process();
+    }
+}
+
+#endif
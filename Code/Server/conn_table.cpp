@@ -0,0 +1,179 @@
+/********************************************************************
+@FileName:conn_table.cpp
+@Version: 1.0
+@Notes:   连接表实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/03 15:36:12
+********************************************************************/
+#include"conn_table.h"
+#include<stdlib.h>
+#include<new>
+#include<sys/mman.h>
+
+conn_table::conn_table(int max_fd):
+    m_states(NULL), m_max_fd(max_fd), m_partial(NULL), m_empty(0), m_chunks(0), m_live(0){
+    //匿名映射的页是全零的（conn为NULL），第一次写时才分配，没用到的fd不占物理内存
+    void* p = mmap(NULL, max_fd * sizeof(conn_state), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(p == MAP_FAILED){
+        throw std::bad_alloc();
+    }
+    m_states = (conn_state*)p;
+}
+
+//服务器退出时调用，这时事件循环都已停止
+conn_table::~conn_table(){
+    for(int fd = 0; fd < m_max_fd; fd++){
+        destroy(fd);
+    }
+    while(m_partial){
+        chunk* c = m_partial;
+        m_partial = c->next;
+        munmap(c, CHUNK_SIZE);
+    }
+    munmap(m_states, m_max_fd * sizeof(conn_state));
+}
+
+/********************************************************************
+@FunName:http_conn* conn_table::create(int fd)
+@Input:  fd：新连接的socket
+@Output: None
+@Retuval:构造好的连接对象（还没有init）。fd超出MAX_FD或内存不足返回NULL，由调用者关闭fd
+@Notes:  fd对应的热数据重新构造，冷数据从m_partial的第一块中取一个slot：先取还回来的，没有再取从没用过的。没有还有空位的块时mmap一块新的。
+         块满了就从m_partial摘下
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/03 15:41:27
+********************************************************************/
+http_conn* conn_table::create(int fd)
+{
+    if(fd < 0 || fd >= m_max_fd){
+        return NULL;
+    }
+    m_lock.lock();
+    chunk* c = m_partial ? m_partial : new_chunk();
+    if(!c){
+        m_lock.unlock();
+        return NULL;
+    }
+    slot* s = c->free;
+    if(s){
+        c->free = s->next;
+    }else{
+        s = (slot*)(c + 1) + c->top++;
+        s->owner = c;
+    }
+    if(c->live++ == 0){
+        m_empty--;
+    }
+    if(!c->free && c->top == SLOTS_PER_CHUNK){
+        unlink(c);
+    }
+    m_live++;
+    m_lock.unlock();
+
+    conn_state* state = new(&m_states[fd]) conn_state();
+    http_conn* conn = new(&s->obj) http_conn(state);
+    state->conn = conn;
+    return conn;
+}
+
+/********************************************************************
+@FunName:void conn_table::destroy(int fd)
+@Input:  fd：已经close_conn、还没有关闭的socket
+@Output: None
+@Retuval:None
+@Notes:  析构连接对象，slot还回所在的块。块原来是满的就重新放进m_partial；
+         块空了而备用的空块已经够了，munmap还给系统
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/03 15:49:53
+********************************************************************/
+void conn_table::destroy(int fd)
+{
+    http_conn* conn = m_states[fd].conn;
+    if(!conn){
+        return;
+    }
+    m_states[fd].conn = NULL;
+    conn->~http_conn();
+    slot* s = (slot*)conn;
+    chunk* c = s->owner;
+
+    m_lock.lock();
+    if(!c->free && c->top == SLOTS_PER_CHUNK){
+        push_partial(c);
+    }
+    s->next = c->free;
+    c->free = s;
+    m_live--;
+    if(--c->live == 0){
+        if(m_empty >= SPARE_CHUNKS){
+            unlink(c);
+            m_chunks--;
+            munmap(c, CHUNK_SIZE);
+        }else{
+            m_empty++;
+        }
+    }
+    m_lock.unlock();
+}
+
+int conn_table::live()
+{
+    m_lock.lock();
+    int n = m_live;
+    m_lock.unlock();
+    return n;
+}
+
+int conn_table::chunks()
+{
+    m_lock.lock();
+    int n = m_chunks;
+    m_lock.unlock();
+    return n;
+}
+
+//mmap一块。slot从头依次取用（top），用过的再还回来进空闲链表，
+//mmap的页在第一次写时才分配，所以块中没用到的slot不占物理内存
+conn_table::chunk* conn_table::new_chunk()
+{
+    void* p = mmap(NULL, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED){
+        LOG_WARN("连接对象分配失败：%s", strerror(errno));
+        return NULL;
+    }
+    chunk* c = (chunk*)p;
+    c->free = NULL;
+    c->top = 0;
+    c->live = 0;
+    push_partial(c);
+    m_empty++;
+    m_chunks++;
+    return c;
+}
+
+void conn_table::unlink(chunk* c)
+{
+    if(c->prev){
+        c->prev->next = c->next;
+    }else{
+        m_partial = c->next;
+    }
+    if(c->next){
+        c->next->prev = c->prev;
+    }
+    c->prev = NULL;
+    c->next = NULL;
+}
+
+void conn_table::push_partial(chunk* c)
+{
+    c->prev = NULL;
+    c->next = m_partial;
+    if(m_partial){
+        m_partial->prev = c;
+    }
+    m_partial = c;
+}
@@ -0,0 +1,78 @@
+/********************************************************************
+@FileName:conn_table.h
+@Version: 1.0
+@Notes:   连接表。原来main一开始就new http_conn[MAX_FD]，不管有多少客户端，构造函数都要碰到每个对象，
+          一开始就占上百MB内存。现在连接分成热数据（conn_state，两个缓存行）和冷数据（http_conn）两部分：
+          · 热数据以fd为索引连续存放（mmap的数组，只有用到的fd所在的页才真正分配），事件循环按fd找连接、
+            时间轮推进（定时器节点在热数据中）都只碰这个数组；
+          · 冷数据按需从slab分配：slab按块（CHUNK_SIZE，16页）向系统mmap，一块放若干个连接对象，每块有自己的空闲链表；
+            新连接从还有空位的块中取，连接关闭后还回所在的块；
+            一块全空时留SPARE_CHUNKS块备用（连接频繁建立断开时不反复mmap/munmap），再多就munmap还给系统。
+          这样常驻内存跟着在线连接数走。
+          分配和归还在接收/关闭连接时各一次（都在事件循环线程中），加一把锁；按fd查找不加锁：
+          一个fd的连接只由接收它的事件循环创建和归还，也只由这个循环（和它交给的工作线程）访问。
+          这要求fd在连接对象归还之后才关闭：关闭之后fd号可能马上被另一个事件循环accept到，重新create
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/03 15:20:36
+********************************************************************/
+#ifndef _CONN_TABLE_H_
+#define _CONN_TABLE_H_
+
+#include<stddef.h>
+#include<type_traits>
+#include"../Pool/locker.h"
+#include"../Http/http_conn.h"
+
+class conn_table{
+public:
+    static const size_t CHUNK_SIZE = 64 * 1024;     //每块的大小，16页
+    static const int SPARE_CHUNKS = 1;              //最多保留的全空的块
+
+    explicit conn_table(int max_fd);
+    ~conn_table();
+
+    http_conn* get(int fd) { return m_states[fd].conn; }   //按fd查找连接，没有返回NULL
+    conn_state* state(int fd) { return &m_states[fd]; }     //按fd找连接的热数据
+    http_conn* create(int fd);      //为新连接构造热数据、分配并构造连接对象，fd超出范围或内存不足返回NULL
+    void destroy(int fd);           //连接关闭（close_conn）后、socket关闭前析构并归还连接对象
+
+    int live();                     //在线连接对象数
+    int chunks();                   //向系统申请着的块数
+
+private:
+    struct chunk;
+    //一个连接对象的位置。obj放在最前面，连接对象的地址就是slot的地址
+    struct slot{
+        std::aligned_storage<sizeof(http_conn), alignof(http_conn)>::type obj;
+        chunk* owner;       //所在的块
+        slot* next;         //还回来以后：块中下一个空闲的slot
+    };
+    //块头，后面紧跟着SLOTS_PER_CHUNK个slot
+    struct chunk{
+        chunk* prev;        //还有空位的块组成的双向链表
+        chunk* next;
+        slot* free;         //块中还回来的slot的链表
+        int top;            //slot[0, top)用过，后面的还没碰过
+        int live;           //块中在用的slot数
+    };
+    static const int SLOTS_PER_CHUNK = (CHUNK_SIZE - sizeof(chunk)) / sizeof(slot);
+    static_assert(SLOTS_PER_CHUNK >= 8, "连接对象太大，CHUNK_SIZE要加大");
+
+    chunk* new_chunk();                 //mmap一块，加入m_partial
+    void unlink(chunk* c);              //从m_partial中摘下
+    void push_partial(chunk* c);        //放到m_partial开头
+
+    conn_state* m_states;   //热数据，以fd为索引
+    int m_max_fd;
+    locker m_lock;          //保护下面的slab状态
+    chunk* m_partial;       //还有空位的块
+    int m_empty;            //全空的块数（都在m_partial中）
+    int m_chunks;
+    int m_live;
+
+    conn_table(const conn_table&);
+    void operator=(const conn_table&);
+};
+
+#endif
@@ -0,0 +1,275 @@
+/********************************************************************
+@FileName:eventloop.cpp
+@Version: 1.0
+@Notes:   事件循环类实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/02 10:41:30
+********************************************************************/
+#include"eventloop.h"
+
+/********************************************************************
+@FunName:extern void addfd(int epollfd, int fd, bool one_shot, bool et)
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  添加文件描述符到epoll中
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/05/04 16:08:56
+********************************************************************/
+extern void addfd(int epollfd, int fd, bool one_shot, bool et);
+
+/********************************************************************
+@FunName:extern void setnonblocking(int fd)
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  设置指定文件描述符为非阻塞
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/05/04 18:32:32
+********************************************************************/
+extern void setnonblocking(int fd);
+
+/********************************************************************
+@FunName:eventloop(int id, int port, bool reuseport, bool et, conn_table* users, pool_base<http_conn>* pool)
+@Input:  id：循环编号
+         port：监听端口
+         reuseport：是否设置SO_REUSEPORT
+         et：监听socket是否边沿触发
+         users：连接表，以fd查找连接
+         pool：线程池
+@Output: None
+@Retuval:None
+@Notes:  构造函数，创建本循环的监听socket和epoll实例
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/02 10:45:51
+********************************************************************/
+eventloop::eventloop(int id, int port, bool reuseport, bool et, conn_table* users, pool_base<http_conn>* pool):
+    m_id(id), m_listenfd(-1), m_epollfd(-1), m_et(et), m_events(NULL), m_users(users), m_pool(pool),
+    m_timers(TIMER_TICK_MS, on_timeout, this){
+
+    //监听套接字，多个事件循环时设置SO_REUSEPORT
+    m_listenfd = Tcp_listen(port, reuseport, 5);
+
+    //创建epoll对象，事件数组
+    m_events = new epoll_event[MAX_EVENT_NUMBER];
+    m_epollfd = Epoll_create(5);
+
+    //将监听的文件描述符添加到epoll对象中
+    setnonblocking(m_listenfd);                 //监听socket非阻塞，accept4取空队列时返回EAGAIN而不是阻塞
+    addfd(m_epollfd, m_listenfd, false, m_et);  //listenfd不需要添加oneshot
+}
+
+eventloop::~eventloop(){
+    Close(m_epollfd);
+    Close(m_listenfd);
+    delete [] m_events;
+}
+
+/********************************************************************
+@FunName:bool eventloop::start()
+@Input:  None
+@Output: None
+@Retuval:true：线程创建成功。false：失败
+@Notes:  新开一个（分离的）线程运行本事件循环
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/02 11:02:16
+********************************************************************/
+bool eventloop::start(){
+    if(pthread_create(&m_thread, NULL, worker, (void*)this) != 0){
+        return false;
+    }
+    return pthread_detach(m_thread) == 0;
+}
+
+void* eventloop::worker(void* arg){
+    eventloop* el = (eventloop*)arg;
+    el->loop();
+    return NULL;
+}
+
+/********************************************************************
+@FunName:void eventloop::handle_accept()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  监听socket可读，有新客户端连接进来，将其挂到本循环的epoll上。
+         LT模式每次通知接收一个（没取完的下次epoll_wait还会通知）；
+         ET模式只通知一次，必须循环accept直到EAGAIN，否则剩下的连接再也不会被通知
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/02 11:05:40
+********************************************************************/
+void eventloop::handle_accept(){
+    if(!m_et){
+        accept_one();
+        return;
+    }
+    while(accept_one()){
+    }
+}
+
+/********************************************************************
+@FunName:bool eventloop::accept_one()
+@Input:  None
+@Output: None
+@Retuval:true：接收到一个连接（不管是否因连接数满被关闭）。false：监听队列已空或fd耗尽
+@Notes:  用accept4(SOCK_NONBLOCK)接收一个新连接，新socket直接就是非阻塞的
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/05 15:40:32
+********************************************************************/
+bool eventloop::accept_one(){
+    struct sockaddr_in client_address;
+    socklen_t client_addrlen = sizeof(client_address);
+    int connfd = Accept4(m_listenfd, (sockaddr*)&client_address, &client_addrlen, SOCK_NONBLOCK);
+    if(connfd < 0){
+        if(errno == EMFILE || errno == ENFILE){
+            LOG_WARN("文件描述符耗尽，暂时无法接收新连接");
+        }
+        return false;
+    }
+    char str[INET_ADDRSTRLEN];
+    LOG_DEBUG("有新客户端连接 IP：%s 端口号：%d connfd:%d loop:%d",
+              inet_ntop(AF_INET,&client_address.sin_addr,str,sizeof(str)), ntohs(client_address.sin_port), connfd, m_id);
+    if(connfd >= MAX_FD){
+        //目前连接数满了（连接表以fd为索引，fd超出表的大小）
+        //*给客户端写一个信息：服务器内部正忙
+        LOG_WARN("目前连接数满了");
+        Close(connfd);
+        return true;
+    }
+    //为新的客户端分配连接对象并初始化，挂到本循环的epoll上
+    http_conn* conn = m_users->create(connfd);    //以connfd为索引放进连接表，方便之后的操作
+    if(!conn){
+        LOG_WARN("连接对象分配失败 connfd:%d", connfd);
+        Close(connfd);
+        return true;
+    }
+    conn->init(connfd, client_address, m_epollfd, &m_timers);
+    m_timers.add(conn->get_timer(), HEADER_TIMEOUT_MS);             //第一个请求也要在请求头超时内收完
+    LOG_DEBUG("已将客户端数据加入连接表(将connfd挂到epollfd上)");
+    return true;
+}
+
+/********************************************************************
+@FunName:void eventloop::loop()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  事件循环：epoll_wait阻塞监听，处理新连接以及已连接socket的读写。
+         epoll_wait最多等到时间轮上最近一个定时器到期，处理完事件后推进时间轮。
+         定时器：新连接和每个请求的第一个字节起算请求头超时；可写事件（发送有进展或发完）后改为空闲超时。
+         Reactor模式（-r）下可读事件直接交给线程池，由工作线程recv和发送，可写事件只在工作线程发送遇到EAGAIN后才有
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/02 11:10:27
+********************************************************************/
+void eventloop::loop(){
+    while(true){
+        LOG_DEBUG("epoll_wait监听... loop:%d", m_id);
+        int num = Epoll_wait(m_epollfd, m_events, MAX_EVENT_NUMBER, m_timers.next_timeout());//阻塞监听epoll上的fd，最多等到下一个定时器到期
+        uint64_t ready = trace::enabled() ? trace::now() : 0;  //这一轮事件的ready时间戳，排在后面的事件等前面的处理完的时间算在read阶段
+
+        //循环遍历事件数组
+        for(int i = 0; i<num; i++){
+            int sockfd = m_events[i].data.fd;
+            if(sockfd == m_listenfd){
+                //有新客户端连接进来
+                handle_accept();
+                continue;
+            }
+            conn_state* state = m_users->state(sockfd);   //定时器和读的状态都在热数据中，只有要收发时才碰冷数据
+            http_conn* conn = state->conn;
+            if(m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+                //对方异常断开或者错误等事件
+                LOG_DEBUG("客户端异常断开");
+                close_conn(conn);
+            }else if(m_events[i].events & EPOLLIN){
+                //可读
+                LOG_DEBUG("可读");
+                if(http_conn::m_reactor_mode){
+                    //Reactor模式：recv也由工作线程做，这里只管定时器。新请求开始时换成请求头超时
+                    if(!state->request_started()){
+                        state->clear_idle();
+                        m_timers.refresh(&state->timer, HEADER_TIMEOUT_MS);
+                    }
+                    conn->trace_mark(TP_READY, ready);
+                    dispatch(conn, sockfd);
+                    continue;
+                }
+                bool started = state->request_started();
+                conn->trace_mark(TP_READY, ready);
+                if(conn->read()){//一次性把数据都读完
+                    if(!started){
+                        //新请求的第一批数据：从空闲超时换成请求头超时，之后的数据不再延长期限
+                        m_timers.refresh(&state->timer, HEADER_TIMEOUT_MS);
+                    }
+                    //交给线程池处理
+                    LOG_DEBUG("交给线程池处理...");
+                    dispatch(conn, sockfd);   //fd同时作为亲和性提示
+                }else{
+                    //读失败
+                    close_conn(conn);
+                }
+            }else if(m_events[i].events & EPOLLOUT){
+                //可写
+                LOG_DEBUG("可写");
+                if(!conn->write()){//一次性写完所有数据
+                    //写失败
+                    close_conn(conn);
+                }else{
+                    //发送有进展（或者发完了在等下一个请求），重新计空闲超时
+                    m_timers.refresh(&state->timer, IDLE_TIMEOUT_MS);
+                    if(conn->request_pending()){
+                        //这一批流水线响应发完了，读缓冲区中还有请求，不等EPOLLIN直接交给线程池
+                        dispatch(conn, sockfd);
+                    }
+                }
+            }
+        }
+        m_timers.advance();
+    }
+}
+
+//连接超时。在事件循环线程中由时间轮回调，定时器节点在连接的热数据中
+void eventloop::on_timeout(timer_node* node, void* arg){
+    eventloop* el = (eventloop*)arg;
+    conn_state* state = (conn_state*)node->data;
+    //Reactor模式下响应是工作线程发完的，它只记下了空闲开始的时间，空闲超时在这里补上
+    uint64_t idle_since = state->idle_since.load(std::memory_order_relaxed);
+    if(idle_since != 0){
+        uint64_t now = timer_wheel::now_ms();
+        if(now < idle_since + IDLE_TIMEOUT_MS){
+            el->m_timers.add(node, idle_since + IDLE_TIMEOUT_MS - now);
+            return;
+        }
+    }
+    LOG_DEBUG("连接超时 connfd:%d loop:%d", state->sockfd, el->m_id);
+    state->expire();
+}
+
+//把连接交给线程池。队列满了append失败时关闭连接：fd是EPOLLONESHOT的，这时已经不在epoll上，
+//不关闭的话再也没有事件（定时器到期shutdown也不会触发），连接和它的slab位置就一直占着
+void eventloop::dispatch(http_conn* conn, int sockfd){
+    if(!m_pool->append(conn, sockfd)){
+        LOG_WARN("线程池队列已满，关闭连接 connfd:%d loop:%d", sockfd, m_id);
+        close_conn(conn);
+    }
+}
+
+//关闭连接并把连接对象还给连接表。顺序不能反：socket一关闭，别的事件循环就可能accept到同一个fd号，
+//在连接表的同一位置创建新连接，所以取下定时器、归还连接对象都要在关闭socket之前，关闭socket放在最后
+void eventloop::close_conn(http_conn* conn){
+    int fd = conn->get_sockfd();
+    if(fd == -1){
+        return;
+    }
+    conn->close_conn();
+    m_users->destroy(fd);
+    Close(fd);
+}
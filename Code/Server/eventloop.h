@@ -0,0 +1,61 @@
+/********************************************************************
+@FileName:eventloop.h
+@Version: 1.0
+@Notes:   事件循环类（one loop per thread）。每个事件循环拥有自己的epoll实例和监听socket，
+          多个事件循环时监听socket都设置SO_REUSEPORT绑定同一端口，由内核把新连接分散到各个循环，
+          这样accept和socket读写都可以分摊到多个核上，而不是全压在main一个线程上。
+          连接（http_conn）保存在以fd为索引的连接表（conn_table）中，fd在进程内唯一，所以各循环之间不会冲突。
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/02 10:40:12
+********************************************************************/
+#ifndef _EVENTLOOP_H_
+#define _EVENTLOOP_H_
+
+#include<string.h>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include<sys/epoll.h>
+#include<pthread.h>
+#include"../Pool/pool_base.h"
+#include"../Http/http_conn.h"
+#include"../Wrap/wrap.h"
+#include"../Log/log.h"
+#include"../Timer/timer_wheel.h"
+#include"conn_table.h"
+
+#define MAX_FD  65535   //最大的文件描述符数
+#define MAX_EVENT_NUMBER 10000   //监听的最大的事件数量
+#define TIMER_TICK_MS 100         //时间轮一格100毫秒
+#define HEADER_TIMEOUT_MS 15000   //从请求的第一个字节起，15秒内请求没收完就断开（慢速请求头攻击）
+#define IDLE_TIMEOUT_MS 60000     //keep-alive连接空闲（或响应发不出去）60秒断开
+
+class eventloop{
+public:
+    //id：循环编号，port：监听端口，reuseport：是否设置SO_REUSEPORT（多个循环时需要），et：监听socket是否边沿触发
+    eventloop(int id, int port, bool reuseport, bool et, conn_table* users, pool_base<http_conn>* pool);
+    ~eventloop();
+
+    void loop();                    //事件循环，阻塞运行
+    bool start();                   //新开一个线程运行loop()
+private:
+    static void* worker(void* arg); //线程处理函数
+    void handle_accept();           //处理监听socket上的新连接
+    bool accept_one();              //接收一个新连接，监听队列已空时返回false
+    void close_conn(http_conn* conn);   //关闭连接，连接对象还给连接表
+    void dispatch(http_conn* conn, int sockfd);    //交给线程池，队列满时关闭连接
+    static void on_timeout(timer_node* node, void* arg);   //连接超时回调
+
+    int m_id;                       //循环编号
+    int m_listenfd;                 //本循环的监听socket
+    int m_epollfd;                  //本循环的epoll实例
+    bool m_et;                      //监听socket是否边沿触发，ET模式下一次通知要把连接全部accept完
+    epoll_event* m_events;          //epoll_wait传出的就绪事件数组
+    conn_table* m_users;            //所有连接，以fd查找
+    pool_base<http_conn>* m_pool;  //线程池
+    timer_wheel m_timers;           //本循环所有连接的超时定时器
+    pthread_t m_thread;
+};
+
+#endif
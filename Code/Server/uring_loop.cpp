@@ -0,0 +1,496 @@
+/********************************************************************
+@FileName:uring_loop.cpp
+@Version: 1.0
+@Notes:   io_uring事件引擎实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/09 14:03:10
+********************************************************************/
+#include"uring_loop.h"
+#include"eventloop.h"   //MAX_FD
+#include"../Metrics/metrics.h"
+
+//user_data的高32位是请求类型，低32位是fd
+#define URING_DATA(op, fd) (((uint64_t)(op) << 32) | (uint32_t)(fd))
+#define URING_OP(data) ((int)((data) >> 32))
+#define URING_FD(data) ((int)((data) & 0xffffffff))
+
+/********************************************************************
+@FunName:uring_loop(int id, int port, bool reuseport, conn_table* users, pool_base<http_conn>* pool)
+@Input:  id：循环编号
+         port：监听端口
+         reuseport：是否设置SO_REUSEPORT
+         users：连接表，以fd查找连接
+         pool：线程池
+@Output: None
+@Retuval:None
+@Notes:  构造函数，创建监听socket、io_uring实例、接收缓冲区环和唤醒用的eventfd
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 15:10:26
+********************************************************************/
+uring_loop::uring_loop(int id, int port, bool reuseport, conn_table* users, pool_base<http_conn>* pool):
+    m_id(id), m_listenfd(-1), m_ringfd(-1), m_eventfd(-1), m_eventfd_val(0), m_ready(0), m_users(users), m_pool(pool),
+    m_timers(TIMER_TICK_MS, on_timeout, this), m_sq_local_tail(0), m_buf_ring(NULL), m_bufs(NULL), m_buf_tail(0), m_nobufs_retry(0){
+
+    m_listenfd = Tcp_listen(port, reuseport, 5);
+
+    m_eventfd = eventfd(0, EFD_CLOEXEC);
+    if(m_eventfd < 0){
+        perr_exit("eventfd error");
+    }
+
+    setup_ring();
+    setup_buf_ring();
+}
+
+uring_loop::~uring_loop(){
+    Munmap(m_buf_ring, BUF_COUNT * sizeof(struct io_uring_buf));
+    delete [] m_bufs;
+    Munmap(m_sqes, m_sqes_size);
+    if(m_cq_ptr != m_sq_ptr){
+        Munmap(m_cq_ptr, m_cq_size);
+    }
+    Munmap(m_sq_ptr, m_sq_size);
+    Close(m_ringfd);
+    Close(m_eventfd);
+    Close(m_listenfd);
+}
+
+/********************************************************************
+@FunName:void uring_loop::setup_ring()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  创建io_uring，把内核的提交队列、完成队列、提交队列项数组映射到用户空间
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 15:20:41
+********************************************************************/
+void uring_loop::setup_ring(){
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_ringfd = Io_uring_setup(RING_ENTRIES, &p);
+
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        //5.4以后提交队列和完成队列可以一次映射
+        if(m_cq_size > m_sq_size){
+            m_sq_size = m_cq_size;
+        }
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = Mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQ_RING);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        m_cq_ptr = m_sq_ptr;
+    }else{
+        m_cq_ptr = Mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_CQ_RING);
+    }
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe*)Mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQES);
+
+    char* sq = (char*)m_sq_ptr;
+    m_sq_head = (unsigned*)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    m_sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    m_sq_array = (unsigned*)(sq + p.sq_off.array);
+    m_sq_entries = p.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+
+    char* cq = (char*)m_cq_ptr;
+    m_cq_head = (unsigned*)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    m_cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+}
+
+/********************************************************************
+@FunName:void uring_loop::setup_buf_ring()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  注册provided buffer ring。recv请求不事先指定缓冲区，数据到达时内核才从环中取一个，
+         所以几万个空闲的keep-alive连接也不占用接收缓冲区
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 15:32:07
+********************************************************************/
+void uring_loop::setup_buf_ring(){
+    //环本身要页对齐，用mmap申请
+    m_buf_ring = (struct io_uring_buf_ring*)Mmap(0, BUF_COUNT * sizeof(struct io_uring_buf),
+                    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)m_buf_ring;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    Io_uring_register(m_ringfd, IORING_REGISTER_PBUF_RING, &reg, 1);
+
+    m_bufs = new char[BUF_COUNT * BUF_SIZE];
+    for(int i = 0; i < BUF_COUNT; i++){
+        recycle_buf(i);
+    }
+}
+
+/********************************************************************
+@FunName:void uring_loop::recycle_buf(int bid)
+@Input:  bid：缓冲区编号
+@Output: None
+@Retuval:None
+@Notes:  把接收缓冲区放回环尾。环的tail和bufs[0].resv共用同一块内存，所以只能逐个字段赋值。
+         注意不能用m_buf_ring->bufs：内核头文件里的柔性数组在C++下前面多了一个空结构体，偏移是错的。
+         有因为缓冲区用光而停下的连接时，每还一个缓冲区为其中一个重新提交recv
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 15:40:55
+********************************************************************/
+void uring_loop::recycle_buf(int bid){
+    struct io_uring_buf* buf = (struct io_uring_buf*)m_buf_ring + (m_buf_tail & (BUF_COUNT - 1));
+    buf->addr = (uint64_t)(m_bufs + bid * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = bid;
+    m_buf_tail++;
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+    if(!m_nobufs.empty()){
+        prep_recv(m_nobufs.front());
+        m_nobufs.pop_front();
+    }
+}
+
+/********************************************************************
+@FunName:struct io_uring_sqe* uring_loop::get_sqe()
+@Input:  None
+@Output: None
+@Retuval:一个清零的提交队列项
+@Notes:  提交队列满了就先把已填好的提交给内核，腾出位置
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 15:48:19
+********************************************************************/
+struct io_uring_sqe* uring_loop::get_sqe(){
+    while(m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries){
+        submit_and_wait(0);
+    }
+    unsigned idx = m_sq_local_tail & *m_sq_mask;
+    struct io_uring_sqe* sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[idx] = idx;
+    m_sq_local_tail++;
+    return sqe;
+}
+
+/********************************************************************
+@FunName:int uring_loop::submit_and_wait(int wait_nr, int timeout_ms)
+@Input:  wait_nr：至少等待多少个完成事件，0表示只提交不等待
+         timeout_ms：最多等待的毫秒数，-1表示一直等
+@Output: None
+@Retuval:实际提交的请求个数，-1表示完成队列暂时满了
+@Notes:  一次io_uring_enter系统调用同时完成提交和等待，等待超时也正常返回
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 15:52:44
+********************************************************************/
+int uring_loop::submit_and_wait(int wait_nr, int timeout_ms){
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return Io_uring_enter(m_ringfd, to_submit, wait_nr, flags, timeout_ms);
+}
+
+//多发accept：提交一次，之后每来一个连接产生一个完成事件（带IORING_CQE_F_MORE）
+//客户端地址不需要，传NULL（多发模式下多个完成事件共用同一个地址缓冲区，本来也取不准）
+void uring_loop::prep_accept(){
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_DATA(OP_ACCEPT, m_listenfd);
+}
+
+//recv：由内核从缓冲区组BUF_GROUP中挑缓冲区
+void uring_loop::prep_recv(int fd){
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = URING_DATA(OP_RECV, fd);
+}
+
+//writev：发送连接中的m_iv，完成前m_iv不会被改动（每个连接同一时刻只有一个请求在内核中）
+void uring_loop::prep_writev(http_conn* conn){
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = conn->get_sockfd();
+    sqe->addr = (uint64_t)conn->get_iovec();
+    sqe->len = conn->get_iovec_count();
+    sqe->user_data = URING_DATA(OP_WRITEV, conn->get_sockfd());
+}
+
+//读eventfd，工作线程post时写eventfd，这个请求就完成了
+void uring_loop::prep_wakeup(){
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_eventfd;
+    sqe->addr = (uint64_t)&m_eventfd_val;
+    sqe->len = sizeof(m_eventfd_val);
+    sqe->user_data = URING_DATA(OP_WAKEUP, m_eventfd);
+}
+
+/********************************************************************
+@FunName:void uring_loop::post(http_conn* conn, int ev)
+@Input:  conn：连接
+         ev：EPOLLIN表示继续接收请求，EPOLLOUT表示发送已生成的响应
+@Output: None
+@Retuval:None
+@Notes:  由工作线程调用（代替epoll引擎下的modfd）。列表由空变非空时才写eventfd，
+         本线程还没来得及处理时后续的post不再重复唤醒
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 16:05:30
+********************************************************************/
+void uring_loop::post(http_conn* conn, int ev){
+    m_posted_locker.lock();
+    bool was_empty = m_posted.empty();
+    m_posted.push_back(std::make_pair(conn, ev));
+    m_posted_locker.unlock();
+    if(was_empty){
+        uint64_t one = 1;
+        Write(m_eventfd, &one, sizeof(one));
+    }
+}
+
+void uring_loop::handle_accept(struct io_uring_cqe* cqe){
+    if(!(cqe->flags & IORING_CQE_F_MORE)){
+        //多发accept被内核终止了（出错或资源不足），重新提交
+        prep_accept();
+    }
+    int connfd = cqe->res;
+    if(connfd < 0){
+        LOG_WARN("accept失败:%s", strerror(-connfd));
+        return;
+    }
+    LOG_DEBUG("有新客户端连接 connfd:%d loop:%d", connfd, m_id);
+    if(connfd >= MAX_FD){
+        //目前连接数满了（连接表以fd为索引，fd超出表的大小）
+        LOG_WARN("目前连接数满了");
+        Close(connfd);
+        return;
+    }
+    struct sockaddr_in client_address;
+    memset(&client_address, 0, sizeof(client_address));
+    http_conn* conn = m_users->create(connfd);
+    if(!conn){
+        LOG_WARN("连接对象分配失败 connfd:%d", connfd);
+        Close(connfd);
+        return;
+    }
+    conn->init(connfd, client_address, this, &m_timers);
+    m_timers.add(conn->get_timer(), HEADER_TIMEOUT_MS);     //第一个请求也要在请求头超时内收完
+    prep_recv(connfd);
+}
+
+void uring_loop::handle_recv(int fd, struct io_uring_cqe* cqe){
+    http_conn* conn = m_users->get(fd);
+    if(cqe->res == -ENOBUFS){
+        //缓冲区暂时被用光了。马上重新提交还是没有缓冲区，本线程会一直空转提交/完成，
+        //所以先停下来，等别的连接归还缓冲区时（recycle_buf）再提交。
+        //停下时内核中没有这个连接的请求，超时shutdown后也要等重新提交的recv失败才关闭，不会在列表中被关掉
+        metrics::recv_nobufs();
+        if(m_nobufs.empty()){
+            m_nobufs_retry = timer_wheel::now_ms() + NOBUFS_RETRY_MS;
+        }
+        m_nobufs.push_back(fd);
+        return;
+    }
+    if(cqe->res <= 0){
+        //对方关闭连接或出错
+        LOG_DEBUG("客户端断开");
+        close_conn(conn);
+        return;
+    }
+    int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    conn_state* state = m_users->state(fd);
+    bool started = state->request_started();
+    conn->trace_mark(TP_READY, m_ready);
+    bool ok = conn->feed(m_bufs + bid * BUF_SIZE, cqe->res);
+    recycle_buf(bid);
+    if(!ok){
+        //读缓冲区满了
+        close_conn(conn);
+        return;
+    }
+    if(!started){
+        //新请求的第一批数据：从空闲超时换成请求头超时，之后的数据不再延长期限
+        m_timers.refresh(&state->timer, HEADER_TIMEOUT_MS);
+    }
+    //交给线程池处理
+    LOG_DEBUG("可读，交给线程池处理...");
+    dispatch(conn, fd);
+}
+
+void uring_loop::handle_writev(int fd, struct io_uring_cqe* cqe){
+    http_conn* conn = m_users->get(fd);
+    if(cqe->res < 0){
+        LOG_WARN("发送失败！%s", strerror(-cqe->res));
+        conn->unmap();
+        close_conn(conn);
+        return;
+    }
+    //发送有进展（或者发完了在等下一个请求），重新计空闲超时
+    m_timers.refresh(conn->get_timer(), IDLE_TIMEOUT_MS);
+    switch(conn->written(cqe->res)){
+        case http_conn::WRITE_AGAIN:
+            prep_writev(conn);
+            break;
+        case http_conn::WRITE_KEEPALIVE:
+            prep_recv(fd);
+            break;
+        case http_conn::WRITE_PROCESS:
+            //读缓冲区中还有流水线请求，直接交给线程池，处理完由它决定提交recv还是writev
+            dispatch(conn, fd);
+            break;
+        case http_conn::WRITE_CLOSE:
+            close_conn(conn);
+            break;
+    }
+}
+
+void uring_loop::handle_wakeup(){
+    m_posted_locker.lock();
+    m_posted_swap.swap(m_posted);
+    m_posted_locker.unlock();
+    for(size_t i = 0; i < m_posted_swap.size(); i++){
+        http_conn* conn = m_posted_swap[i].first;
+        if(m_posted_swap[i].second == EPOLLOUT){
+            prep_writev(conn);
+        }else{
+            prep_recv(conn->get_sockfd());
+        }
+    }
+    m_posted_swap.clear();
+    prep_wakeup();
+}
+
+bool uring_loop::start(){
+    if(pthread_create(&m_thread, NULL, worker, (void*)this) != 0){
+        return false;
+    }
+    return pthread_detach(m_thread) == 0;
+}
+
+void* uring_loop::worker(void* arg){
+    uring_loop* ul = (uring_loop*)arg;
+    ul->loop();
+    return NULL;
+}
+
+/********************************************************************
+@FunName:void uring_loop::loop()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  事件循环：提交这一轮产生的所有请求并等待完成事件（最多等到时间轮上最近一个定时器到期），
+         然后逐个处理完成事件，最后推进时间轮，重试因为缓冲区用光停下的连接
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 16:20:13
+********************************************************************/
+void uring_loop::loop(){
+    prep_accept();
+    prep_wakeup();
+    while(true){
+        submit_and_wait(1, wait_timeout());
+        m_ready = trace::enabled() ? trace::now() : 0;
+
+        unsigned head = *m_cq_head;
+        while(head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)){
+            struct io_uring_cqe cqe = m_cqes[head & *m_cq_mask];
+            head++;
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+
+            int fd = URING_FD(cqe.user_data);
+            switch(URING_OP(cqe.user_data)){
+                case OP_ACCEPT:
+                    handle_accept(&cqe);
+                    break;
+                case OP_RECV:
+                    handle_recv(fd, &cqe);
+                    break;
+                case OP_WRITEV:
+                    handle_writev(fd, &cqe);
+                    break;
+                case OP_WAKEUP:
+                    handle_wakeup();
+                    break;
+                default:
+                    break;
+            }
+        }
+        m_timers.advance();
+        retry_nobufs();
+    }
+}
+
+int uring_loop::wait_timeout(){
+    int timeout = m_timers.next_timeout();
+    if(m_nobufs.empty()){
+        return timeout;
+    }
+    uint64_t now = timer_wheel::now_ms();
+    int retry = m_nobufs_retry > now ? (int)(m_nobufs_retry - now) : 0;
+    return (timeout < 0 || retry < timeout) ? retry : timeout;
+}
+
+//只靠recycle_buf唤醒的话，压力突然停下时已经没有缓冲区可以归还，停下的连接（包括已经断开的）就一直挂着。
+//隔NOBUFS_RETRY_MS全部重新提交一次：还是没有缓冲区就再停下，不会空转
+void uring_loop::retry_nobufs(){
+    if(m_nobufs.empty()){
+        return;
+    }
+    uint64_t now = timer_wheel::now_ms();
+    if(now < m_nobufs_retry){
+        return;
+    }
+    std::deque<int> parked;
+    parked.swap(m_nobufs);
+    for(size_t i = 0; i < parked.size(); i++){
+        prep_recv(parked[i]);
+    }
+    m_nobufs_retry = now + NOBUFS_RETRY_MS;
+}
+
+//连接超时。在本循环线程中由时间轮回调，定时器节点在连接的热数据中。
+//只shutdown：连接可能在内核中挂着recv/writev，或者正在工作线程中，都由它们完成后的出错路径关闭
+void uring_loop::on_timeout(timer_node* node, void* arg){
+    uring_loop* ul = (uring_loop*)arg;
+    conn_state* state = (conn_state*)node->data;
+    LOG_DEBUG("连接超时 connfd:%d loop:%d", state->sockfd, ul->m_id);
+    state->expire();
+}
+
+//把连接交给线程池。队列满了append失败时关闭连接，否则这个连接没有提交任何请求，再也不会有完成事件。
+//调用的地方（recv、writev完成后）这个连接在内核中都没有未完成的请求，可以直接关闭
+void uring_loop::dispatch(http_conn* conn, int fd){
+    if(!m_pool->append(conn, fd)){
+        LOG_WARN("线程池队列已满，关闭连接 connfd:%d loop:%d", fd, m_id);
+        close_conn(conn);
+    }
+}
+
+//关闭连接并把连接对象还给连接表。io_uring引擎下每个连接同一时刻最多只有一个请求在内核中，关闭时没有未完成的请求。
+//顺序不能反：socket一关闭，别的事件循环就可能accept到同一个fd号，
+//在连接表的同一位置创建新连接，所以取下定时器、归还连接对象都要在关闭socket之前，关闭socket放在最后
+void uring_loop::close_conn(http_conn* conn){
+    int fd = conn->get_sockfd();
+    if(fd == -1){
+        return;
+    }
+    conn->close_conn();
+    m_users->destroy(fd);
+    Close(fd);
+}
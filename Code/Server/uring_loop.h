@@ -0,0 +1,134 @@
+/********************************************************************
+@FileName:uring_loop.h
+@Version: 1.0
+@Notes:   io_uring事件引擎，与eventloop（epoll）二选一，命令行-u选择。
+          accept、recv、writev都以请求的形式提交给内核，完成后从完成队列取结果，一次io_uring_enter
+          既提交这一轮攒下的所有请求又等待完成事件，小文件请求的系统调用次数大大减少：
+            accept：多发（multishot）accept，提交一次，每来一个连接产生一个完成事件
+            recv：  从注册给内核的缓冲区环（provided buffer ring）中由内核挑选缓冲区，
+                    连接空闲时不占用缓冲区，收完拷进http_conn的读缓冲区后立即归还；
+                    缓冲区被用光时连接先停下来，等有缓冲区归还再提交recv，没有归还的（比如压力突然停了）隔一会儿统一重试
+            writev：直接发送http_conn中的m_iv（响应头+mmap的文件）
+          工作线程处理完请求后不能直接提交io_uring请求（提交队列只能由本线程操作），
+          而是把连接放进m_posted并写eventfd唤醒本线程，由本线程统一提交。
+          请求头超时和空闲超时和epoll引擎一样由本循环的时间轮管理：io_uring_enter最多等到下一个定时器到期，
+          到期时shutdown连接，内核中挂着的recv/writev随之完成，由正常的出错路径关闭。
+          需要Linux 5.19以上内核（multishot accept、provided buffer ring）。
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/09 14:02:45
+********************************************************************/
+#ifndef _URING_LOOP_H_
+#define _URING_LOOP_H_
+
+#include<vector>
+#include<deque>
+#include<string.h>
+#include<stdint.h>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<sys/eventfd.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#include<linux/io_uring.h>
+#include<pthread.h>
+#include"../Pool/locker.h"
+#include"../Pool/pool_base.h"
+#include"../Http/http_conn.h"
+#include"../Wrap/wrap.h"
+#include"../Log/log.h"
+#include"../Timer/timer_wheel.h"
+#include"conn_table.h"
+
+class uring_loop{
+public:
+    static const int RING_ENTRIES = 4096;   //提交队列大小
+    static const int BUF_COUNT = 4096;      //缓冲区环中缓冲区个数（必须是2的幂）
+    static const int BUF_SIZE = 2048;       //每个接收缓冲区大小，收到的数据拷进http_conn的读缓冲区（不够时会扩大）
+    static const int BUF_GROUP = 0;         //缓冲区组号
+    static const int NOBUFS_RETRY_MS = 10;  //缓冲区用光而停下的连接，没有缓冲区归还时最多隔这么久全部重新提交一次
+
+    //id：循环编号，port：监听端口，reuseport：是否设置SO_REUSEPORT
+    uring_loop(int id, int port, bool reuseport, conn_table* users, pool_base<http_conn>* pool);
+    ~uring_loop();
+
+    void loop();                            //事件循环，阻塞运行
+    bool start();                           //新开一个线程运行loop()
+    void post(http_conn* conn, int ev);     //工作线程调用：请求本线程为conn提交recv（EPOLLIN）或writev（EPOLLOUT）
+
+private:
+    //完成事件对应的请求类型，和fd一起编码进user_data
+    enum OP{
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_WRITEV,
+        OP_WAKEUP
+    };
+
+    static void* worker(void* arg);
+    void setup_ring();                      //创建io_uring并映射提交/完成队列
+    void setup_buf_ring();                  //注册provided buffer ring
+    struct io_uring_sqe* get_sqe();         //取一个空闲的提交队列项，队列满时先提交
+    int submit_and_wait(int wait_nr, int timeout_ms = -1); //提交攒下的请求并等待至少wait_nr个完成事件，最多等timeout_ms毫秒
+
+    void prep_accept();
+    void prep_recv(int fd);
+    void prep_writev(http_conn* conn);
+    void prep_wakeup();
+    void recycle_buf(int bid);              //把接收缓冲区还给内核，有等缓冲区的连接时为它重新提交recv
+    int wait_timeout();                     //本轮io_uring_enter最多等多少毫秒：下一个定时器，有停下的连接时不超过重试时间
+    void retry_nobufs();                    //到了重试时间，为所有停下的连接重新提交recv
+
+    void handle_accept(struct io_uring_cqe* cqe);
+    void handle_recv(int fd, struct io_uring_cqe* cqe);
+    void handle_writev(int fd, struct io_uring_cqe* cqe);
+    void handle_wakeup();
+    void close_conn(http_conn* conn);       //关闭连接，连接对象还给连接表
+    void dispatch(http_conn* conn, int fd); //交给线程池，队列满时关闭连接
+    static void on_timeout(timer_node* node, void* arg);   //连接超时回调
+
+    int m_id;
+    int m_listenfd;
+    int m_ringfd;
+    int m_eventfd;                          //工作线程用来唤醒本线程
+    uint64_t m_eventfd_val;                 //OP_WAKEUP读eventfd的缓冲区
+    uint64_t m_ready;                       //这一轮完成事件的ready时间戳（打开追踪时）
+    conn_table* m_users;
+    pool_base<http_conn>* m_pool;
+    timer_wheel m_timers;                   //本循环所有连接的超时定时器
+    pthread_t m_thread;
+
+    //提交队列（SQ）
+    void* m_sq_ptr;
+    size_t m_sq_size;
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned* m_sq_mask;
+    unsigned* m_sq_array;
+    struct io_uring_sqe* m_sqes;
+    size_t m_sqes_size;
+    unsigned m_sq_entries;
+    unsigned m_sq_local_tail;               //已填好但还没提交的请求写到这里，提交时才更新到*m_sq_tail
+
+    //完成队列（CQ）
+    void* m_cq_ptr;
+    size_t m_cq_size;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned* m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    //provided buffer ring
+    struct io_uring_buf_ring* m_buf_ring;
+    char* m_bufs;
+    unsigned short m_buf_tail;
+    std::deque<int> m_nobufs;               //recv因为缓冲区用光（-ENOBUFS）而停下的连接，有缓冲区归还时按先后再提交
+    uint64_t m_nobufs_retry;                //下一次全部重新提交的时间（timer_wheel::now_ms）
+
+    //工作线程交回来的连接
+    locker m_posted_locker;
+    std::vector< std::pair<http_conn*, int> > m_posted;
+    std::vector< std::pair<http_conn*, int> > m_posted_swap;
+};
+
+#endif
@@ -0,0 +1,189 @@
+/********************************************************************
+@FileName:timer_wheel.cpp
+@Version: 1.0
+@Notes:   分层时间轮实现。放置规则与Linux早期的定时器相同：
+          到期tick与当前tick相差d，d < 64放第0层，d < 64^2放第1层……，
+          第n层的槽号取到期tick的第n组6位。第0层每转一圈（当前tick低6位回到0），
+          把第1层当前槽里的节点重新放置一次，依此类推
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/24 20:06:02
+********************************************************************/
+#include"timer_wheel.h"
+#include<time.h>
+
+static const uint64_t SLOT_MASK = timer_wheel::SLOTS - 1;
+
+//链表操作，槽的头结点prev/next指向自己表示空
+static void list_init(timer_node* head)
+{
+    head->prev = head;
+    head->next = head;
+}
+
+static void list_add_tail(timer_node* head, timer_node* node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void list_del(timer_node* node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+timer_wheel::timer_wheel(int tick_ms, callback cb, void* arg):
+    m_tick_ms(tick_ms), m_count(0), m_cb(cb), m_arg(arg){
+    for(int l = 0; l < LEVELS; l++){
+        for(int i = 0; i < SLOTS; i++){
+            list_init(&m_slots[l][i]);
+        }
+    }
+    m_current = now_ms() / m_tick_ms;
+}
+
+//单调时钟毫秒数。CLOCK_MONOTONIC_COARSE走vDSO，精度几毫秒，对100毫秒一格的时间轮足够
+uint64_t timer_wheel::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/********************************************************************
+@FunName:void timer_wheel::insert(timer_node* node)
+@Input:  node：已设置好expire的节点
+@Output: None
+@Retuval:None
+@Notes:  按到期时间与当前tick的差选层，再按到期tick在该层的6位选槽。超出最高层范围的按最高层最远处放
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/24 20:20:46
+********************************************************************/
+void timer_wheel::insert(timer_node* node)
+{
+    if(node->expire < m_current){
+        node->expire = m_current;
+    }
+    uint64_t diff = node->expire - m_current;
+    uint64_t max_diff = ((uint64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+    if(diff > max_diff){
+        node->expire = m_current + max_diff;
+        diff = max_diff;
+    }
+    int level = 0;
+    while(level < LEVELS - 1 && (diff >> (SLOT_BITS * (level + 1))) != 0){
+        level++;
+    }
+    int slot = (node->expire >> (SLOT_BITS * level)) & SLOT_MASK;
+    list_add_tail(&m_slots[level][slot], node);
+}
+
+void timer_wheel::add(timer_node* node, int timeout_ms)
+{
+    if(node->pending()){
+        list_del(node);
+        m_count--;
+    }
+    node->expire = now_ms() / m_tick_ms + (timeout_ms + m_tick_ms - 1) / m_tick_ms;
+    insert(node);
+    m_count++;
+}
+
+void timer_wheel::refresh(timer_node* node, int timeout_ms)
+{
+    add(node, timeout_ms);
+}
+
+void timer_wheel::cancel(timer_node* node)
+{
+    if(node->pending()){
+        list_del(node);
+        m_count--;
+    }
+}
+
+//第level层当前槽的节点都在接下来SLOTS^level个tick内到期，重新放到低层
+void timer_wheel::cascade(int level)
+{
+    int slot = (m_current >> (SLOT_BITS * level)) & SLOT_MASK;
+    timer_node* head = &m_slots[level][slot];
+    while(head->next != head){
+        timer_node* node = head->next;
+        list_del(node);
+        insert(node);
+    }
+}
+
+/********************************************************************
+@FunName:void timer_wheel::advance()
+@Input:  None
+@Output: None
+@Retuval:None
+@Notes:  一格一格推进到当前时间：第0层转回0时逐层cascade，然后把第0层当前槽里的节点全部取出并回调。
+         回调里可以再添加/取消定时器。时间轮空时直接跳到当前时间
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/24 20:31:15
+********************************************************************/
+void timer_wheel::advance()
+{
+    uint64_t now = now_ms() / m_tick_ms;
+    if(m_count == 0){
+        if(now + 1 > m_current){
+            m_current = now + 1;
+        }
+        return;
+    }
+    while(m_current <= now){
+        int idx = m_current & SLOT_MASK;
+        if(idx == 0){
+            for(int l = 1; l < LEVELS; l++){
+                cascade(l);
+                if(((m_current >> (SLOT_BITS * l)) & SLOT_MASK) != 0){
+                    break;
+                }
+            }
+        }
+        timer_node* head = &m_slots[0][idx];
+        while(head->next != head){
+            timer_node* node = head->next;
+            list_del(node);
+            m_count--;
+            m_cb(node, m_arg);
+        }
+        m_current++;
+    }
+}
+
+/********************************************************************
+@FunName:int timer_wheel::next_timeout()
+@Input:  None
+@Output: None
+@Retuval:距离下一次需要advance的毫秒数，没有定时器返回-1
+@Notes:  在第0层从当前格往后找第一个非空槽，最多找到本圈结束（那时要cascade，也得醒一次）
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/24 20:40:02
+********************************************************************/
+int timer_wheel::next_timeout()
+{
+    if(m_count == 0){
+        return -1;
+    }
+    uint64_t target = m_current;
+    int idx = m_current & SLOT_MASK;
+    for(int i = idx; i < SLOTS; i++, target++){
+        if(m_slots[0][i].next != &m_slots[0][i]){
+            break;
+        }
+    }
+    uint64_t now = now_ms();
+    uint64_t at = target * m_tick_ms;
+    return at > now ? (int)(at - now) : 0;
+}
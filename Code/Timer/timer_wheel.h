@@ -0,0 +1,64 @@
+/********************************************************************
+@FileName:timer_wheel.h
+@Version: 1.0
+@Notes:   分层时间轮。每个事件循环一个，只在事件循环线程中使用，不加锁。
+          LEVELS层，每层SLOTS个槽，第0层一格是一个tick，第n层一格是SLOTS^n个tick。
+          定时器节点（timer_node）直接嵌在连接对象里，槽里是侵入式双向链表，
+          添加、刷新、取消都是O(1)，不分配内存；高层的槽转到时把里面的节点重新分到低层（cascade）。
+          epoll_wait的超时时间由next_timeout()给出，醒来后advance()处理到期的定时器。
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/06/24 20:05:17
+********************************************************************/
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include<stdint.h>
+#include<stddef.h>
+
+//定时器节点，嵌在需要定时的对象里
+struct timer_node{
+    timer_node* prev;
+    timer_node* next;
+    uint64_t expire;        //到期的tick
+    void* data;             //到期回调用的参数（如http_conn*）
+    timer_node():prev(NULL), next(NULL), expire(0), data(NULL){}
+    bool pending() const { return prev != NULL; }   //是否在时间轮中
+};
+
+class timer_wheel{
+public:
+    typedef void (*callback)(timer_node* node, void* arg);
+
+    //tick_ms：一格的毫秒数。cb：定时器到期时调用，arg原样传给cb
+    timer_wheel(int tick_ms, callback cb, void* arg);
+    ~timer_wheel(){}
+
+    void add(timer_node* node, int timeout_ms);     //添加定时器，节点已在时间轮中则相当于refresh
+    void refresh(timer_node* node, int timeout_ms); //重新设置到期时间
+    void cancel(timer_node* node);                  //取消定时器，不在时间轮中时什么也不做
+    void advance();                                 //推进到当前时间，调用所有到期定时器的回调
+    int next_timeout();                             //距下一个可能到期的定时器的毫秒数，没有定时器返回-1（epoll_wait一直阻塞）
+
+    static uint64_t now_ms();                       //单调时钟毫秒数
+
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;        //每层64格，4层共64^4个tick
+
+private:
+    void insert(timer_node* node);      //按到期时间放进对应层的槽
+    void cascade(int level);            //第level层当前槽的节点重新分配到低层
+
+    timer_node m_slots[LEVELS][SLOTS];  //每个槽是一个带头结点的双向循环链表
+    uint64_t m_current;                 //当前tick，小于它的定时器都已处理
+    int m_tick_ms;
+    size_t m_count;                     //时间轮中的定时器个数
+    callback m_cb;
+    void* m_arg;
+
+    timer_wheel(const timer_wheel&);
+    void operator=(const timer_wheel&);
+};
+
+#endif
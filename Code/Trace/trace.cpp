@@ -0,0 +1,203 @@
+/********************************************************************
+@FileName:trace.cpp
+@Version: 1.0
+@Notes:   请求分阶段计时的实现
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/06 10:20:33
+********************************************************************/
+#include"trace.h"
+#include<unistd.h>
+#include<sys/syscall.h>
+
+bool trace::m_enabled = false;
+
+//追踪文件中各时间戳的名字，和TRACE_POINT一一对应
+static const char* point_name[TP_NUM] = {"ready", "read", "dequeue", "begin", "parsed",
+                                         "handled", "built", "batch_done", "write", "sent"};
+
+trace::trace():m_file(NULL), m_slow_ticks(0), m_ticks_per_us(1000), m_running(false), m_thread(0){}
+
+trace* trace::get_instance()
+{
+    static trace instance;
+    return &instance;
+}
+
+/********************************************************************
+@FunName:bool trace::init(const char* path, int slow_us)
+@Input:  path：追踪文件路径
+         slow_us：慢请求阈值（微秒），0表示记录所有请求
+@Output: None
+@Retuval:true：成功。false：文件打不开或线程创建失败
+@Notes:  用CLOCK_MONOTONIC校准时间戳的频率（睡20毫秒，对比两边走过的时间），打开追踪文件，启动写文件的线程。
+         m_enabled在最后才置位，事件循环和连接都还没开始工作，不需要同步。线程不detach，由stop()回收
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/06 10:26:41
+********************************************************************/
+bool trace::init(const char* path, int slow_us)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t c0 = now();
+    usleep(20000);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    uint64_t c1 = now();
+    double us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+    m_ticks_per_us = (c1 - c0) / us;
+    m_slow_ticks = slow_us * m_ticks_per_us;
+
+    m_file = fopen(path, "w");
+    if(!m_file){
+        return false;
+    }
+    fprintf(m_file, "# trace ticks_per_us=%.3f slow_us=%d\n", m_ticks_per_us, slow_us);
+    m_running.store(true, std::memory_order_release);
+    if(pthread_create(&m_thread, NULL, flush_thread, this) != 0){
+        m_running.store(false, std::memory_order_release);
+        return false;
+    }
+    m_enabled = true;
+    return true;
+}
+
+//当前线程的环形缓冲区。线程第一次提交记录时分配并登记
+trace::ring* trace::thread_ring()
+{
+    static __thread ring* t_ring = NULL;
+    if(!t_ring){
+        t_ring = new ring;
+        t_ring->id = syscall(SYS_gettid);
+        m_rings_lock.lock();
+        m_rings.push_back(t_ring);
+        m_rings_lock.unlock();
+    }
+    return t_ring;
+}
+
+//一个请求的记录：从第一个时间戳到发完没超过阈值的直接丢掉，否则拷进当前线程的环形缓冲区，满了丢弃并计数
+void trace::submit(const trace_record& r)
+{
+    uint64_t first = r.tsc[TP_SENT];
+    for(int p = 0; p < TP_NUM; p++){
+        if(r.tsc[p] != 0 && r.tsc[p] < first){
+            first = r.tsc[p];
+        }
+    }
+    if(r.tsc[TP_SENT] - first < m_slow_ticks){
+        return;
+    }
+    ring* q = thread_ring();
+    size_t head = q->head.load(std::memory_order_relaxed);
+    size_t tail = q->tail.load(std::memory_order_acquire);
+    if(head - tail == RING_SIZE){
+        q->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    q->buf[head & (RING_SIZE - 1)] = r;
+    q->head.store(head + 1, std::memory_order_release);
+}
+
+//一条记录写成一行："tid= fd= req=第几个/这一批的请求数 status= total_us= 各时间戳="，
+//时间戳换算成相对这个请求第一个时间戳的微秒数，没有经过的位置不写
+void trace::write_record(const trace_record& r, int tid)
+{
+    uint64_t first = r.tsc[TP_SENT];
+    for(int p = 0; p < TP_NUM; p++){
+        if(r.tsc[p] != 0 && r.tsc[p] < first){
+            first = r.tsc[p];
+        }
+    }
+    fprintf(m_file, "tid=%d fd=%d req=%d/%d status=%d total_us=%.3f", tid, r.fd, r.index, r.count, r.status,
+            (r.tsc[TP_SENT] - first) / m_ticks_per_us);
+    for(int p = 0; p < TP_NUM; p++){
+        if(r.tsc[p] != 0){
+            fprintf(m_file, " %s=%.3f", point_name[p], (r.tsc[p] - first) / m_ticks_per_us);
+        }
+    }
+    fputc('\n', m_file);
+}
+
+//把所有环形缓冲区中的记录写出去，写出了记录返回true
+bool trace::drain()
+{
+    bool wrote = false;
+    m_drain_lock.lock();
+    m_rings_lock.lock();
+    for(size_t i = 0; i < m_rings.size(); i++){
+        ring* q = m_rings[i];
+        size_t tail = q->tail.load(std::memory_order_relaxed);
+        size_t head = q->head.load(std::memory_order_acquire);
+        for(; tail != head; tail++){
+            write_record(q->buf[tail & (RING_SIZE - 1)], q->id);
+            wrote = true;
+        }
+        q->tail.store(tail, std::memory_order_release);
+        unsigned dropped = q->dropped.exchange(0, std::memory_order_relaxed);
+        if(dropped){
+            fprintf(m_file, "# dropped=%u tid=%d\n", dropped, q->id);
+        }
+    }
+    m_rings_lock.unlock();
+    if(wrote){
+        fflush(m_file);
+    }
+    m_drain_lock.unlock();
+    return wrote;
+}
+
+void trace::flush()
+{
+    if(m_enabled){
+        drain();
+    }
+}
+
+//等写文件的线程退出（最多晚一个FLUSH_INTERVAL_US），然后在本线程把剩下的记录写出去，不会和线程中的drain同时进行
+void trace::stop()
+{
+    if(!m_running.exchange(false, std::memory_order_acq_rel)){
+        return;
+    }
+    pthread_join(m_thread, NULL);
+    drain();
+}
+
+void* trace::flush_thread(void* arg)
+{
+    trace* t = (trace*)arg;
+    while(t->m_running.load(std::memory_order_acquire)){
+        if(!t->drain()){
+            usleep(FLUSH_INTERVAL_US);
+        }
+    }
+    return t;
+}
+
+/********************************************************************
+@FunName:void trace_batch::emit(int fd, int count)
+@Input:  fd：连接的socket
+         count：这一批的请求数
+@Output: None
+@Retuval:None
+@Notes:  这一批发完时调用（sent已记下）：第i个请求的记录由这一批共用的时间戳加上它自己的BEGIN到BUILT组成，
+         交给trace::submit。然后清空共用的时间戳，下一批的时间戳都是之后重新记的
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/07/06 10:52:07
+********************************************************************/
+void trace_batch::emit(int fd, int count)
+{
+    trace_record r;
+    memcpy(r.tsc, tsc, sizeof(tsc));
+    r.fd = fd;
+    r.count = count;
+    for(int i = 0; i < count && i < MAX_REQ; i++){
+        memcpy(r.tsc + TP_BEGIN, req[i], sizeof(req[i]));
+        r.status = status[i];
+        r.index = i;
+        trace::get_instance()->submit(r);
+    }
+    memset(tsc, 0, sizeof(tsc));
+}
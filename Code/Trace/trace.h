@@ -0,0 +1,163 @@
+/********************************************************************
+@FileName:trace.h
+@Version: 1.0
+@Notes:   请求的分阶段计时（命令行-T打开）。一个请求从epoll报告可读到响应发完要经过事件循环、线程池队列、
+          解析、取文件、生成响应、发送几个阶段，每个阶段的边界记一个TSC时间戳（rdtsc，二三十个周期，没有系统调用）：
+            ready       epoll_wait（io_uring引擎下是io_uring_enter）返回
+            read        read()读到数据（io_uring引擎下是feed）
+            dequeue     工作线程从线程池取到任务
+            begin       开始解析这个请求（流水线请求一个接一个解析）
+            parsed      请求解析完整，调用do_request之前
+            handled     do_request返回（stat/open/mmap，缓存命中时没有系统调用）
+            built       process_write生成完响应
+            batch_done  这一批流水线请求都生成完了
+            write       开始发送这一批（Proactor模式下是事件循环收到EPOLLOUT）
+            sent        这一批发完
+          时间戳记在连接自己的trace_batch中（只在打开追踪时分配），这一批发完时每个请求生成一条trace_record，
+          从第一个时间戳到sent超过慢请求阈值（-S，微秒，默认0即全部）的放进当前线程的环形缓冲区
+          （单生产者单消费者，无锁，满了丢弃并计数）。后台线程像异步日志一样轮询所有环形缓冲区，
+          把记录格式化成一行一条的"键=值"写到追踪文件，格式化和写文件都不在处理请求的线程中。
+          离线工具Bench/trace_stat.cpp读追踪文件，按阶段输出分位数表。
+          不同线程的时间戳要能直接相减，需要CPU的TSC是恒定频率且各核同步的（/proc/cpuinfo中有constant_tsc、nonstop_tsc），
+          近年的x86服务器都满足；其他架构用CLOCK_MONOTONIC代替
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/06 09:48:15
+********************************************************************/
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include<stdio.h>
+#include<stdint.h>
+#include<string.h>
+#include<time.h>
+#include<atomic>
+#include<vector>
+#include"../Pool/locker.h"
+#include"../Pool/mpmc_queue.h"  //CACHE_LINE_SIZE
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#endif
+
+//时间戳的位置，按一个请求通常经过的顺序
+enum TRACE_POINT{
+    TP_READY = 0,
+    TP_READ,
+    TP_DEQUEUE,
+    TP_BEGIN,           //BEGIN到BUILT每个请求一个，其余的这一批共用
+    TP_PARSED,
+    TP_HANDLED,
+    TP_BUILT,
+    TP_BATCH_DONE,
+    TP_WRITE,
+    TP_SENT,
+    TP_NUM
+};
+
+//一个请求的时间戳，0表示没有经过这个位置（比如读缓冲区中剩下的流水线请求没有ready和read）
+struct trace_record{
+    uint64_t tsc[TP_NUM];
+    int fd;
+    int status;
+    int index;          //这一批中的第几个请求
+    int count;          //这一批的请求数
+};
+
+//一个连接正在处理的这一批请求的时间戳，由连接所在的线程依次写
+struct trace_batch{
+    static const int MAX_REQ = 16;      //不小于http_conn::MAX_PIPELINE
+    static const int REQ_POINTS = TP_BUILT - TP_BEGIN + 1;
+
+    uint64_t tsc[TP_NUM];               //这一批共用的时间戳，BEGIN到BUILT不用
+    uint64_t req[MAX_REQ][REQ_POINTS];  //每个请求自己的BEGIN到BUILT
+    int status[MAX_REQ];
+    int cur;                            //正在解析的请求
+
+    void begin(int i);                  //开始解析这一批的第i个请求：清掉这个位置上次留下的时间戳，记BEGIN
+    void mark(TRACE_POINT p, uint64_t t);
+    void mark(TRACE_POINT p);
+    void emit(int fd, int count);       //这一批发完：每个请求生成一条记录交给trace，清空时间戳
+};
+
+class trace{
+public:
+    static trace* get_instance();
+
+    //打开追踪文件并启动写文件的后台线程，slow_us为慢请求阈值（微秒）。之后新建的连接才开始记时间戳
+    bool init(const char* path, int slow_us);
+    //把所有缓冲区中的记录写出去
+    void flush();
+    //停止写文件的线程并等它退出，再把剩下的记录写出去（进程退出前调用）。之后提交的记录留在缓冲区中不再写出
+    void stop();
+    //一个请求的记录，超过阈值的放进当前线程的环形缓冲区
+    void submit(const trace_record& r);
+
+    static bool enabled() { return m_enabled; }
+    static uint64_t now(){
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+    }
+
+    static const size_t RING_SIZE = 4096;       //每个线程的环形缓冲区能放的记录数，2的幂
+    static const int FLUSH_INTERVAL_US = 100000; //写文件线程没有记录可写时的睡眠时间
+
+private:
+    struct ring{
+        std::atomic<size_t> head;   //生产者写到的位置
+        char pad0[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail;   //消费者读到的位置
+        char pad1[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+        std::atomic<unsigned> dropped;  //缓冲区满丢弃的记录数
+        int id;                     //线程号，写在记录中
+        trace_record buf[RING_SIZE];
+        ring():head(0), tail(0), dropped(0), id(0){}
+    };
+
+    trace();
+    ~trace(){}
+    trace(const trace&);
+    void operator=(const trace&);
+
+    ring* thread_ring();        //当前线程的环形缓冲区，第一次调用时注册
+    bool drain();               //把所有环形缓冲区写出去，有记录返回true
+    void write_record(const trace_record& r, int tid);
+    static void* flush_thread(void* arg);
+
+    static bool m_enabled;
+    FILE* m_file;
+    uint64_t m_slow_ticks;      //慢请求阈值，换算成时间戳的单位
+    double m_ticks_per_us;      //启动时用CLOCK_MONOTONIC校准的TSC频率
+    std::atomic<bool> m_running;    //写文件的线程在运行，stop()清掉后线程退出
+    pthread_t m_thread;
+    locker m_rings_lock;
+    std::vector<ring*> m_rings;
+    locker m_drain_lock;
+};
+
+inline void trace_batch::begin(int i)
+{
+    cur = i;
+    memset(req[i], 0, sizeof(req[i]));
+    req[i][0] = trace::now();
+}
+
+inline void trace_batch::mark(TRACE_POINT p, uint64_t t)
+{
+    if(p >= TP_BEGIN && p <= TP_BUILT){
+        req[cur][p - TP_BEGIN] = t;
+    }else{
+        tsc[p] = t;
+    }
+}
+
+inline void trace_batch::mark(TRACE_POINT p)
+{
+    mark(p, trace::now());
+}
+
+#endif
@@ -125,6 +125,42 @@ int Listen(int fd, int backlog)
     return n;
 }
 
+/********************************************************************
+@FunName:int Tcp_listen(int port, bool reuseport, int backlog)
+@Input:  port:监听端口
+         reuseport:是否设置SO_REUSEPORT（多个事件循环各持有一个监听socket时需要）
+         backlog:同时与服务器建立连接的上限数
+@Output: None
+@Retuval:成功：监听套接字
+         失败：直接退出
+@Notes:  创建监听套接字：socket+setsockopt+bind+listen，绑定INADDR_ANY
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/08 20:10:31
+********************************************************************/
+int Tcp_listen(int port, bool reuseport, int backlog)
+{
+    int listenfd = Socket(PF_INET, SOCK_STREAM, 0);
+
+    //设置端口复用
+    int reuse = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(reuseport){
+        //多个监听socket绑定同一端口，内核按四元组哈希把新连接分给其中一个
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    Bind(listenfd, (struct sockaddr*)&address, sizeof(address));
+
+    Listen(listenfd, backlog);
+    return listenfd;
+}
+
 /********************************************************************
 @FunName:int Accept(int fd, struct sockaddr *sa, socklen_t *salenptr)
 @Input:  fd:监听套接字
@@ -152,6 +188,35 @@ again:
 }
 
 
+/********************************************************************
+@FunName:int Accept4(int fd, struct sockaddr *sa, socklen_t *salenptr, int flags)
+@Input:  fd:监听套接字（非阻塞）
+         *sa:传出参数
+         addrlen：传入传出
+         flags：SOCK_NONBLOCK、SOCK_CLOEXEC，直接设置到新连接上，省去之后的两次fcntl
+@Output: *sa:成功建立连接的客户端地址结构
+@Retuval:成功：新连接的socket
+         -1：已没有待接收的连接（EAGAIN）或文件描述符耗尽（EMFILE/ENFILE），由调用者根据errno处理
+@Notes:  非阻塞版本的accept，用于在一次epoll通知里把监听队列中的连接全部取完（ET模式）。
+         与Accept不同，没有连接可取不是错误，不能退出进程
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/05 15:21:09
+********************************************************************/
+int Accept4(int fd, struct sockaddr *sa, socklen_t *salenptr, int flags)
+{
+    int n;
+again:
+    if ((n = accept4(fd, sa, salenptr, flags)) < 0) {
+        if((errno == ECONNABORTED) || (errno == EINTR)) //出错排除处理：1.软件导致的连接终止 2.中断的系统调用
+            goto again;
+        else if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EMFILE) || (errno == ENFILE))
+            return -1;
+        else    perr_exit("accept4 error");
+    }
+    return n;
+}
+
 /********************************************************************
 @FunName:int Connect(int fd, const struct sockaddr *sa, socklen_t salen)
 @Input:  fd:客户端套接字
@@ -263,6 +328,33 @@ again:
 	return n;
 }
 
+/********************************************************************
+@FunName:ssize_t Sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+@Input:  out_fd：要写入的socket
+		 in_fd：要读取的文件（必须支持mmap，即普通文件）
+		 offset：（传入传出参数）从文件的哪个位置开始读，返回时已加上发送的字节数
+		 count：最多发送的字节数
+@Output: None
+@Retuval:成功为发送的字节数，出错为 -1 并设置相应的 errno（EAGAIN等由调用者处理）
+@Notes:  在内核中直接把文件页拷贝到socket，数据不经过用户态，也不需要mmap/munmap
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/20 10:12:36
+********************************************************************/
+ssize_t Sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+	ssize_t n;
+
+again:
+	if ( (n = sendfile(out_fd, in_fd, offset, count)) == -1) {
+		if (errno == EINTR)
+			goto again;
+		else
+			return -1;
+	}
+	return n;
+}
+
 
 
 /********************************************************************
@@ -616,7 +708,95 @@ int Munmap (void *__addr, size_t __len)
 	return i;
 }
 
+/********************************************************************
+@FunName:int Io_uring_setup(unsigned entries, struct io_uring_params *p)
+@Input:  entries:提交队列大小（会向上取整为2的幂）
+		 p:传入传出，传入创建参数，传出各队列在共享内存中的偏移和内核支持的特性
+@Output: p:各队列的偏移、实际大小、features
+@Retuval:成功：io_uring的文件描述符
+		 失败：直接退出（内核不支持io_uring或被禁用）
+@Notes:  创建一个io_uring实例。glibc没有封装，直接走syscall
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 14:30:12
+********************************************************************/
+int Io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	int n;
+	if((n = syscall(__NR_io_uring_setup, entries, p)) < 0)
+	{
+		perr_exit("io_uring_setup error");
+	}
+	return n;
+}
 
+/********************************************************************
+@FunName:int Io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, int timeout_ms)
+@Input:  fd:io_uring的文件描述符
+		 to_submit:要提交的请求个数
+		 min_complete:至少等待多少个完成事件（flags带IORING_ENTER_GETEVENTS时有效）
+		 flags:IORING_ENTER_GETEVENTS等
+		 timeout_ms:等待完成事件最多多少毫秒，-1表示一直等（同epoll_wait）
+@Output: None
+@Retuval:成功：实际提交的请求个数（等待超时也算成功）
+		 -1：完成队列暂时满了（EBUSY/EAGAIN），调用者先处理完成事件再重试
+@Notes:  提交请求并（可选）等待完成事件，被信号中断时重试。
+         有超时时用IORING_ENTER_EXT_ARG把超时传给内核（5.11以上），超时返回ETIME
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 14:33:40
+********************************************************************/
+int Io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, int timeout_ms)
+{
+	int n;
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	void* argp = NULL;
+	size_t argsz = 0;
+	if(timeout_ms >= 0 && (flags & IORING_ENTER_GETEVENTS))
+	{
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (uint64_t)&ts;
+		flags |= IORING_ENTER_EXT_ARG;
+		argp = &arg;
+		argsz = sizeof(arg);
+	}
+again:
+	if((n = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, argp, argsz)) < 0)
+	{
+		if(errno == EINTR)
+			goto again;
+		else if(errno == ETIME)
+			return 0;
+		else if(errno == EBUSY || errno == EAGAIN)
+			return -1;
+		else
+			perr_exit("io_uring_enter error");
+	}
+	return n;
+}
 
-
-
+/********************************************************************
+@FunName:int Io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+@Input:  fd:io_uring的文件描述符
+		 opcode:注册的类型，如IORING_REGISTER_PBUF_RING
+		 arg、nr_args:注册的参数
+@Output: None
+@Retuval:成功：0
+		 失败：直接退出
+@Notes:  向io_uring注册资源（缓冲区、文件等）
+@Author: XiaoDexin
+@Email:  xiaodexin0701@163.com
+@Time:   2022/06/09 14:36:02
+********************************************************************/
+int Io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	int n;
+	if((n = syscall(__NR_io_uring_register, fd, opcode, arg, nr_args)) < 0)
+	{
+		perr_exit("io_uring_register error");
+	}
+	return n;
+}
@@ -20,22 +20,29 @@
 #include<sys/stat.h>
 #include<errno.h>
 #include<sys/mman.h>
+#include<sys/sendfile.h>
+#include<string.h>
+#include<netinet/in.h>
+#include<sys/syscall.h>
+#include<linux/io_uring.h>
 
 void perr_exit(const char *s);
 int Open (const char *__path, int __oflag, ...);
 int Stat(const char *path, struct stat *buf);
 int Accept(int fd, struct sockaddr *sa, socklen_t *salenptr);
+int Accept4(int fd, struct sockaddr *sa, socklen_t *salenptr, int flags);
 int Bind(int fd, const struct sockaddr *sa, socklen_t salen);
 int Connect(int fd, const struct sockaddr *sa, socklen_t salen);
 int Listen(int fd, int backlog);
+int Tcp_listen(int port, bool reuseport, int backlog);
 int Socket(int family, int type, int protocol);
 ssize_t Read(int fd, void *ptr, size_t nbytes);
 ssize_t Write(int fd, const void *ptr, size_t nbytes);
 ssize_t Writev (int __fd, const struct iovec *__iovec, int __count);
+ssize_t Sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 int Close(int fd);
 ssize_t Readn(int fd, void *vptr, size_t n);
 ssize_t Writen(int fd, const void *vptr, size_t n);
-static ssize_t my_read(int fd, char *ptr);
 ssize_t Readline(int fd, void *vptr, size_t maxlen);
 int Epoll_create(int size);
 int Epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
@@ -45,5 +52,8 @@ ssize_t Send(int __fd, const void *__buf, size_t __n, int __flags);
 void *Mmap (void *__addr, size_t __len, int __prot,
 		   int __flags, int __fd, __off_t __offset);
 int Munmap (void *__addr, size_t __len);
+int Io_uring_setup(unsigned entries, struct io_uring_params *p);
+int Io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, int timeout_ms);
+int Io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args);
 
 #endif
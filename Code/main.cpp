@@ -1,4 +1,3 @@
-#include<iostream>
 #include<cstdio>
 #include<cstring>
 #include<sys/socket.h>
@@ -10,12 +9,16 @@
 #include<fcntl.h>
 #include"./Pool/locker.h"
 #include"./Pool/threadpool.h"
+#include"./Pool/ws_threadpool.h"
 #include"signal.h"
 #include"./Http/http_conn.h"
 #include"./Wrap/wrap.h"
-
-#define MAX_FD  65535   //最大的文件描述符数
-#define MAX_EVENT_NUMBER 10000   //监听的最大的事件数量
+#include"./Config/config.h"
+#include"./Log/log.h"
+#include"./Server/eventloop.h"
+#include"./Server/uring_loop.h"
+#include"./Metrics/metrics.h"
+#include"./Trace/trace.h"
 
 /********************************************************************
 @FunName:void addsig(int sig, void(handler)(int))
@@ -36,159 +39,129 @@ void addsig(int sig, void(handler)(int))
     sigaction(sig, &sa, NULL);
 }
 
-/********************************************************************
-@FunName:extern int addfd(int epollfd, int fd)
-@Input:  None
-@Output: None
-@Retuval:None
-@Notes:  添加文件描述符到epoll中
-@Author: XiaoDexin
-@Email:  xiaodexin0701@163.com
-@Time:   2022/05/04 16:08:56
-********************************************************************/
-extern void addfd(int epollfd, int fd, bool one_shot);
+//按事件循环类型创建事件循环（两种循环的构造参数不同）
+template<class LOOP>
+LOOP* make_loop(int id, Config& config, bool reuseport, conn_table* users, pool_base<http_conn>* pool);
 
-/********************************************************************
-@FunName:extern int removefd(int epollfd, int fd);
-@Input:  None
-@Output: None
-@Retuval:None
-@Notes:  从epoll中删除文件描述符
-@Author: XiaoDexin
-@Email:  xiaodexin0701@163.com
-@Time:   2022/05/04 16:09:16
-********************************************************************/
-extern void removefd(int epollfd, int fd);
+template<>
+eventloop* make_loop<eventloop>(int id, Config& config, bool reuseport, conn_table* users, pool_base<http_conn>* pool)
+{
+    return new eventloop(id, config.port, reuseport, config.et, users, pool);
+}
+
+template<>
+uring_loop* make_loop<uring_loop>(int id, Config& config, bool reuseport, conn_table* users, pool_base<http_conn>* pool)
+{
+    return new uring_loop(id, config.port, reuseport, users, pool);
+}
 
 /********************************************************************
-@FunName:extern void modfd(int epollfd,  int fd, int ev);
-@Input:  None
+@FunName:template<class LOOP> void run_loops(Config& config, bool reuseport, conn_table* users, pool_base<http_conn>* pool)
+@Input:  LOOP：事件循环类型，eventloop（epoll）或uring_loop（io_uring）
+         config：配置
+         reuseport：是否设置SO_REUSEPORT
+         users：连接表
+         pool：线程池
 @Output: None
 @Retuval:None
-@Notes:  修改文件epoll上的描述符
+@Notes:  创建config.loop_num个事件循环，第0个在主线程中跑，其余的各开一个线程
 @Author: XiaoDexin
 @Email:  xiaodexin0701@163.com
-@Time:   2022/05/04 16:40:00
+@Time:   2022/06/09 17:02:18
 ********************************************************************/
-extern void modfd(int epollfd,  int fd, int ev);
+template<class LOOP>
+void run_loops(Config& config, bool reuseport, conn_table* users, pool_base<http_conn>* pool)
+{
+    LOOP ** loops = new LOOP*[config.loop_num];
+    for(int i = 0; i < config.loop_num; i++){
+        loops[i] = make_loop<LOOP>(i, config, reuseport, users, pool);
+    }
+    for(int i = 1; i < config.loop_num; i++){
+        if(!loops[i]->start()){
+            perr_exit("eventloop start error");
+        }
+    }
+    LOG_INFO("服务器已开启");
+    loops[0]->loop();
 
+    for(int i = 0; i < config.loop_num; i++){
+        delete loops[i];
+    }
+    delete [] loops;
+}
 
 int main(int argc, char* argv[])
 {
-    if(argc <= 1){
-        std::cout<<"请按照如下格式运行："<<basename(argv[0])<<"port_number"<<std::endl;   // ./server 端口号
+    //解析命令行参数
+    Config config;
+    if(!config.parse_arg(argc, argv)){
+        config.usage(basename(argv[0]));   // ./server 端口号 [-l 事件循环数] [-t 线程数] [-e] [-u] [-w] [-s] [-r] [-v 日志级别] [-o 日志文件] [-T 追踪文件] [-S 慢请求阈值]
         exit(-1);
     }
 
-    //获取端口号
-    int port = atoi(argv[1]);   //argv[0]是./server
+    //启动异步日志，之后的输出都经过日志的后台线程
+    if(!Log::get_instance()->init(config.log_file, config.log_level)){
+        perr_exit("log init error");
+    }
+
+    //-T：请求分阶段计时，要在连接对象分配之前打开（连接创建时才决定要不要带trace_batch）
+    if(config.trace_file){
+        if(!trace::get_instance()->init(config.trace_file, config.slow_us)){
+            perr_exit("trace init error");
+        }
+        LOG_INFO("请求追踪写到%s，慢请求阈值%d微秒", config.trace_file, config.slow_us);
+    }
     
     //对SIGPIE信号做处理，SIGPIPE：向一个没有读端的管道写数据，会触发这个信号，默认为终止进程。
     //此处是网络对端（客户端）关闭时直接忽略
     addsig(SIGPIPE,SIG_IGN);
 
     //创建线程池，初始化线程池
-    std::cout<<"创建线程池threadpool..."<<std::endl;
-    threadpool<http_conn> * pool = NULL;
+    //-w：工作窃取线程池，每个工作线程一个队列，按连接fd分派；否则所有线程共用一个队列
+    LOG_INFO("创建线程池threadpool...");
+    pool_base<http_conn> * pool = NULL;
     try{
-        pool = new threadpool<http_conn>;
+        if(config.ws){
+            pool = new ws_threadpool<http_conn>(config.thread_num);
+        }else{
+            pool = new threadpool<http_conn>(config.thread_num);
+        }
     }catch(...){
         exit(-1);
     }
-    std::cout<<"线程池threadpool创建完成！"<<std::endl;
-
-    //创建一个数组用于保存所有的客户端信息
-    std::cout<<"创建http_conn任务队列数组users..."<<std::endl;
-    http_conn * users = new http_conn[MAX_FD];
-    std::cout<<"http_conn任务队列数组users创建完成！"<<std::endl;
-
-    std::cout<<"开启服务器，进行监听..."<<std::endl;
-    //监听套接字  
-    int listenfd = Socket(PF_INET, SOCK_STREAM, 0);
-    
-    //设置端口复用
-    int reuse = 1;
-    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-
-    //绑定
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_family = INADDR_ANY;
-    address.sin_port = htons(port);
-    Bind(listenfd, (struct sockaddr*)&address, sizeof(address));
+    LOG_INFO("线程池threadpool创建完成！");
+    //线程池的排队任务数在/__metrics被抓取时读
+    metrics::add_gauge("webserver_pool_queue_depth", "Tasks waiting in the thread pool queues.",
+                       [pool]{ return pool->queued(); });
 
-    //监听
-    Listen(listenfd,5);
-
-    //创建epoll对象，事件数组，添加
-    std::cout<<"创建epoll对象..."<<std::endl;
-    epoll_event events[MAX_EVENT_NUMBER];
-    int epollfd = Epoll_create(5);
-
-
-    //将监听的文件描述符添加到epoll对象中
-    addfd(epollfd, listenfd, false);    //listenfd不需要添加oneshot
-    http_conn::m_epollfd = epollfd;
-    std::cout<<"服务器已开启"<<std::endl;
-
-    while(true){
-        std::cout<<std::endl<<"epoll_wait监听..."<<std::endl<<std::endl;
-        int num = Epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);//阻塞监听epoll上的fd
+    //创建连接表，连接对象在客户端连进来时才分配
+    conn_table * users = NULL;
+    try{
+        users = new conn_table(MAX_FD);
+    }catch(...){
+        exit(-1);
+    }
 
-        //循环遍历事件数组
-        for(int i = 0; i<num; i++){
-            int sockfd = events[i].data.fd;
-            if(sockfd == listenfd){
-                //有新客户端连接进来
-                std::cout<<"有新客户端连接"<<std::endl;
-                struct sockaddr_in client_address;
-                socklen_t client_addrlen = sizeof(client_address);
-                int connfd = Accept(listenfd, (sockaddr*)&client_address,&client_addrlen);
-                char str[INET_ADDRSTRLEN];
-                std::cout<<"新客户端IP："<<inet_ntop(AF_INET,&client_address.sin_addr,str,sizeof(str))<<\
-                "端口号："<<ntohs(client_address.sin_port)<<std::endl;
-                std::cout<<"connfd:"<<connfd<<std::endl;
-                sleep(3);
-                if(http_conn::m_user_count >= MAX_FD){
-                    //目前连接数满了
-                    //*给客户端写一个信息：服务器内部正忙
-                    std::cout<<"目前连接数满了"<<std::endl;
-                    Close(connfd);
-                    continue;
-                }
-                //将新的客户端的数据初始化，并将此客户端信息加入users数组中
-                users[connfd].init(connfd, client_address);       //直接将connfd作为索引，方便之后的操作
-                std::cout<<"已将客户端数据加入users数组中(将connfd挂到epollfd上)"<<std::endl;
-            }else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
-                //对方异常断开或者错误等事件
-                std::cout<<"客户端异常断开"<<std::endl;
-                users[sockfd].close_conn();
-            }else if(events[i].events & EPOLLIN){
-                //可读
-                std::cout<<"可读"<<std::endl;
-                if(users[sockfd].read()){//一次性把数据都读完
-                    //交给线程池处理
-                    std::cout<<"交给线程池处理..."<<std::endl;
-                    pool->append(users + sockfd);   //users + sockfd就是该sockfd的地址，因为sockfd也是users[sockfd]的索引值(在第160行添加的时候是直接将connfd作为索引的)
-                }else{
-                    //读失败
-                    users[sockfd].close_conn();
-                }
-            }else if(events[i].events & EPOLLOUT){
-                //可写
-                std::cout<<"可写"<<std::endl;
-                if(!users[sockfd].write()){//一次性写完所有数据
-                    //写失败
-                    users[sockfd].close_conn();
-                }
-            }
-        }
-        
+    //创建事件循环，每个循环一个epoll实例（或io_uring实例）+一个监听socket
+    //多个循环时监听socket设置SO_REUSEPORT，由内核把新连接分散到各个循环
+    bool reuseport = config.loop_num > 1;
+    if(config.uring){
+        LOG_INFO("开启服务器，进行监听...事件循环数：%d io_uring引擎", config.loop_num);
+        run_loops<uring_loop>(config, reuseport, users, pool);
+    }else{
+        LOG_INFO("开启服务器，进行监听...事件循环数：%d%s%s%s", config.loop_num,
+                 config.et ? " ET模式" : " LT模式", config.sendfile ? " sendfile" : " mmap+writev",
+                 config.reactor ? " Reactor" : " Proactor");
+        http_conn::m_et_mode = config.et;
+        http_conn::m_sendfile_mode = config.sendfile;
+        http_conn::m_reactor_mode = config.reactor;
+        run_loops<eventloop>(config, reuseport, users, pool);
     }
-    Close(epollfd);
-    Close(listenfd);
-    delete [] users;
-    delete [] pool;
+
+    delete users;
+    delete pool;
+    trace::get_instance()->stop();
+    Log::get_instance()->flush();
     
     return 0;
-}
\ No newline at end of file
+}
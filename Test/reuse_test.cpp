@@ -0,0 +1,345 @@
+/********************************************************************
+@FileName:reuse_test.cpp
+@Version: 1.0
+@Notes:   连接复用的回归测试。http_conn::init()不再清零读写缓冲区和m_real_file，这里验证上一个请求的数据不会漏到下一个请求：
+          在本进程中起一个真正的事件循环和线程池（和main一样，监听127.0.0.1的端口），用TCP客户端发请求并检查响应：
+            · 分片：每个请求几个字节一段地发，长URL、长请求头的请求后面跟短的请求（同一个连接）
+            · 流水线：多个请求一次发出，或者拼在一起后按奇怪的位置切开发
+            · 请求头不串：Range、If-None-Match只对带它的那个请求生效，后面的请求回完整的200
+            · 404不串：上一个请求的文件路径不会留给不存在的文件
+            · 连接表的位置复用：连接发了半个请求就断开，新连接（同一个fd、同一个slab位置）的请求要完整解析
+            · Content-Length：超过读缓冲区或int放不下的值回400，服务器不受影响
+            · 请求体：分片到达的请求体读完后，流水线上的下一个请求从请求体后面开始解析
+          响应体和网站根目录中的文件逐字节比较。
+          用法：./reuse_test [-u] [-r] [-e] [-p 端口] [-d 网站根目录]，-u/-r/-e同服务器的选项
+          编译运行：make test
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/04 17:20:15
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<signal.h>
+#include<time.h>
+#include<string>
+#include<vector>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include"../Code/Log/log.h"
+#include"../Code/Pool/threadpool.h"
+#include"../Code/Server/eventloop.h"
+#include"../Code/Server/uring_loop.h"
+
+static int port = 19906;
+static std::string doc_root = "/home/xiaodexin/桌面/MyProject2_WebServer/Resources";    //和http_conn.cpp中的doc_root一致
+static int passed = 0;
+static int failed = 0;
+
+//一个解析好的响应
+struct response{
+    int status;
+    std::string head;
+    std::string body;
+    bool has(const char* header) const { return strcasestr(head.c_str(), header) != NULL; }
+};
+
+static void check(bool ok, const char* name)
+{
+    if(ok){
+        passed++;
+    }else{
+        failed++;
+        printf("FAIL %s\n", name);
+    }
+}
+
+static std::string read_file(const std::string& path)
+{
+    std::string data;
+    FILE* fp = fopen((doc_root + path).c_str(), "rb");
+    if(!fp){
+        printf("打不开%s%s\n", doc_root.c_str(), path.c_str());
+        exit(2);
+    }
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0){
+        data.append(buf, n);
+    }
+    fclose(fp);
+    return data;
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("connect");
+        exit(2);
+    }
+    struct timeval tv = {3, 0};     //服务器出错不回响应时不会一直卡住
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+//把data按每段step字节发出去，段之间停一下，让服务器每次只读到一段
+static void send_split(int fd, const std::string& data, size_t step)
+{
+    for(size_t i = 0; i < data.size(); i += step){
+        size_t len = data.size() - i < step ? data.size() - i : step;
+        if(send(fd, data.data() + i, len, MSG_NOSIGNAL) != (ssize_t)len){
+            perror("send");
+            return;
+        }
+        if(step < data.size()){
+            usleep(1000);
+        }
+    }
+}
+
+//读n个响应（按Content-Length分开），连接关闭或超时时返回已读到的
+static std::vector<response> read_responses(int fd, size_t n)
+{
+    static std::string buf;     //同一个连接上多读到的部分（测试中每个连接读完才换下一个）
+    buf.clear();
+    std::vector<response> out;
+    char tmp[65536];
+    while(out.size() < n){
+        size_t end = buf.find("\r\n\r\n");
+        if(end != std::string::npos){
+            response r;
+            r.head = buf.substr(0, end + 2);
+            r.status = atoi(r.head.c_str() + strlen("HTTP/1.1 "));
+            const char* cl = strcasestr(r.head.c_str(), "Content-Length:");
+            size_t len = cl ? strtoul(cl + strlen("Content-Length:"), NULL, 10) : 0;
+            if(r.status == 304){
+                len = 0;    //304带的Content-Length是完整响应的长度，没有响应体
+            }
+            if(buf.size() >= end + 4 + len){
+                r.body = buf.substr(end + 4, len);
+                buf.erase(0, end + 4 + len);
+                out.push_back(r);
+                continue;
+            }
+        }
+        ssize_t got = recv(fd, tmp, sizeof(tmp), 0);
+        if(got <= 0){
+            break;
+        }
+        buf.append(tmp, got);
+    }
+    return out;
+}
+
+static std::string request(const std::string& url, const std::string& extra = "")
+{
+    return "GET " + url + " HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n" + extra + "\r\n";
+}
+
+//同一个连接上长请求后面跟短请求，每个请求都分片发送：读缓冲区中上一个请求留下的字节比新请求长
+static void test_fragmented(const std::string& index, const std::string& image)
+{
+    int fd = connect_server();
+    std::string pad(900, 'p');
+    std::string reqs[] = {
+        request(std::string(100, '/') + "images/image1.jpg", "X-Pad: " + pad + "\r\n"),
+        request("/index.html"),
+        request(std::string(60, '/') + "index.html", "X-Pad: " + pad.substr(0, 50) + "\r\nRange: bytes=5-14\r\n"),
+        request("/index.html"),
+        request("/nope.html"),
+        request("/index.html"),
+    };
+    std::vector<response> r;
+    for(size_t i = 0; i < sizeof(reqs) / sizeof(reqs[0]); i++){
+        send_split(fd, reqs[i], 7);
+        std::vector<response> one = read_responses(fd, 1);
+        r.insert(r.end(), one.begin(), one.end());
+    }
+    close(fd);
+    check(r.size() == 6, "fragmented: 6 responses");
+    if(r.size() == 6){
+        check(r[0].status == 200 && r[0].body == image, "fragmented: long URL gets the image");
+        check(r[1].status == 200 && r[1].body == index, "fragmented: short URL after long one gets index.html");
+        check(r[2].status == 206 && r[2].body == index.substr(5, 10), "fragmented: range request");
+        check(r[3].status == 200 && r[3].body == index && !r[3].has("Content-Range"), "fragmented: range does not leak into next request");
+        check(r[4].status == 404, "fragmented: missing file after served file is 404");
+        check(r[5].status == 200 && r[5].body == index, "fragmented: request after 404");
+    }
+}
+
+//流水线请求一次发出，和拼在一起按5字节切开发
+static void test_pipelined(const std::string& index, const std::string& image, size_t step, const char* name)
+{
+    int fd = connect_server();
+    std::string all = request(std::string(80, '/') + "images/image1.jpg", "X-Pad: " + std::string(500, 'q') + "\r\n")
+                    + request("/index.html")
+                    + request("/nope.html")
+                    + request("/index.html", "Range: bytes=0-3\r\n")
+                    + request("/images/image1.jpg");
+    send_split(fd, all, step);
+    std::vector<response> r = read_responses(fd, 5);
+    close(fd);
+    std::string prefix = std::string(name) + ": ";
+    check(r.size() == 5, (prefix + "5 responses").c_str());
+    if(r.size() == 5){
+        check(r[0].status == 200 && r[0].body == image, (prefix + "image").c_str());
+        check(r[1].status == 200 && r[1].body == index, (prefix + "index.html").c_str());
+        check(r[2].status == 404, (prefix + "404").c_str());
+        check(r[3].status == 206 && r[3].body == index.substr(0, 4), (prefix + "range").c_str());
+        check(r[4].status == 200 && r[4].body == image && !r[4].has("Content-Range"), (prefix + "image after range").c_str());
+    }
+}
+
+//条件GET之后不带条件的请求要回完整的响应
+static void test_conditional(const std::string& index)
+{
+    int fd = connect_server();
+    send_split(fd, request("/index.html"), 1 << 20);
+    std::vector<response> first = read_responses(fd, 1);
+    std::string etag;
+    if(first.size() == 1){
+        const char* p = strcasestr(first[0].head.c_str(), "ETag: ");
+        if(p){
+            etag.assign(p + strlen("ETag: "), strcspn(p + strlen("ETag: "), "\r\n"));
+        }
+    }
+    check(!etag.empty(), "conditional: ETag present");
+    send_split(fd, request("/index.html", "If-None-Match: " + etag + "\r\n") + request("/index.html"), 3);
+    std::vector<response> r = read_responses(fd, 2);
+    close(fd);
+    check(r.size() == 2 && r[0].status == 304 && r[0].body.empty(), "conditional: matching ETag gets 304");
+    check(r.size() == 2 && r[1].status == 200 && r[1].body == index, "conditional: next request without it gets 200");
+}
+
+//连接发了半个请求就断开，下一个连接（同一个fd号，连接表中同一个位置）从干净的状态开始
+static void test_reused_slot(const std::string& index)
+{
+    for(int i = 0; i < 20; i++){
+        int fd = connect_server();
+        std::string partial = "GET " + std::string(150, '/') + "images/image1.jpg HTTP/1.1\r\nHost: localhost\r\nRange: bytes=1-2\r\nX-Pad: ";
+        send_split(fd, partial, partial.size());
+        usleep(2000);
+        close(fd);
+        usleep(2000);   //等服务器关掉旧连接，新连接才会拿到同一个fd
+
+        fd = connect_server();
+        send_split(fd, request("/index.html"), 4);
+        std::vector<response> r = read_responses(fd, 1);
+        close(fd);
+        check(r.size() == 1 && r[0].status == 200 && r[0].body == index && !r[0].has("Content-Range"),
+              "reused slot: new connection after half request gets index.html");
+    }
+}
+
+//Content-Length超过读缓冲区能放下的请求体（包括int放不下的10位数）回400并关闭连接，服务器继续正常服务
+static void test_content_length(const std::string& index)
+{
+    const char* lengths[] = {"65537", "2147483647", "2147483648", "3000000000", "99999999999999999999"};
+    for(size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++){
+        int fd = connect_server();
+        send_split(fd, request("/index.html", std::string("Content-Length: ") + lengths[i] + "\r\n") + "abc", 1 << 20);
+        std::vector<response> r = read_responses(fd, 2);
+        close(fd);
+        std::string name = std::string("content-length ") + lengths[i] + ": 400 and close";
+        check(r.size() == 1 && r[0].status == 400, name.c_str());
+    }
+
+    //服务器还活着
+    int fd = connect_server();
+    send_split(fd, request("/index.html"), 1 << 20);
+    std::vector<response> r = read_responses(fd, 1);
+    close(fd);
+    check(r.size() == 1 && r[0].status == 200 && r[0].body == index, "content-length: server still serves after rejecting");
+}
+
+//带请求体的请求：请求体分片到达、后面流水线跟着下一个请求，下一个请求从请求体后面开始解析
+static void test_body(const std::string& index, size_t step, const char* name)
+{
+    int fd = connect_server();
+    std::string body(300, 'b');
+    body += "\r\nGET /nope.html HTTP/1.1\r\n\r\n";     //请求体中像请求行的内容不能被当成请求
+    send_split(fd, request("/index.html", "Content-Length: " + std::to_string(body.size()) + "\r\n") + body
+                   + request("/index.html", "Range: bytes=2-5\r\n"), step);
+    std::vector<response> r = read_responses(fd, 3);
+    close(fd);
+    std::string prefix = std::string(name) + ": ";
+    check(r.size() == 2, (prefix + "2 responses").c_str());
+    if(r.size() == 2){
+        check(r[0].status == 200 && r[0].body == index, (prefix + "request with body").c_str());
+        check(r[1].status == 206 && r[1].body == index.substr(2, 4), (prefix + "next request after body").c_str());
+    }
+
+    //请求头加请求体超过读缓冲区的最大大小
+    fd = connect_server();
+    send_split(fd, request("/index.html", "X-Pad: " + std::string(1000, 'x') + "\r\nContent-Length: 65536\r\n") + "abc", step);
+    r = read_responses(fd, 2);
+    close(fd);
+    check(r.size() == 1 && r[0].status == 400, (prefix + "head plus body over the read buffer gets 400").c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    bool uring = false;
+    int opt;
+    while((opt = getopt(argc, argv, "urep:d:")) != -1){
+        switch(opt){
+            case 'u':
+                uring = true;
+                break;
+            case 'r':
+                http_conn::m_reactor_mode = true;
+                break;
+            case 'e':
+                http_conn::m_et_mode = true;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                doc_root = optarg;
+                break;
+            default:
+                printf("usage: %s [-u] [-r] [-e] [-p port] [-d doc_root]\n", argv[0]);
+                return 2;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    Log::get_instance()->init(NULL, LOG_LEVEL_WARN);
+
+    //和main一样：线程池、连接表、一个事件循环，事件循环在自己的线程中跑，进程退出时一起结束
+    pool_base<http_conn>* pool = new threadpool<http_conn>(4);
+    conn_table* users = new conn_table(MAX_FD);
+    bool started;
+    if(uring){
+        started = (new uring_loop(0, port, false, users, pool))->start();
+    }else{
+        started = (new eventloop(0, port, false, http_conn::m_et_mode, users, pool))->start();
+    }
+    if(!started){
+        printf("事件循环启动失败\n");
+        return 2;
+    }
+
+    std::string index = read_file("/index.html");
+    std::string image = read_file("/images/image1.jpg");
+    test_fragmented(index, image);
+    test_pipelined(index, image, 1 << 20, "pipelined");
+    test_pipelined(index, image, 5, "pipelined split");
+    test_conditional(index);
+    test_reused_slot(index);
+    test_content_length(index);
+    test_body(index, 1 << 20, "body");
+    test_body(index, 7, "body split");
+
+    printf("%d passed, %d failed\n", passed, failed);
+    Log::get_instance()->flush();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+/********************************************************************
+@FileName:trace_test.cpp
+@Version: 1.0
+@Notes:   请求分阶段计时（-T）的回归测试：在本进程中打开追踪（阈值0，记录所有请求），起事件循环和线程池，
+          发一组已知的请求（一个连接上逐个发，一个连接上流水线一次发出），然后trace::stop()等写文件的线程退出，
+          检查追踪文件：
+            · 第一行是"# trace ticks_per_us= slow_us=0"的文件头
+            · 每个请求正好一行，状态码和发出的请求一一对应
+            · 每行有tid、fd、req=第几个/请求数、status、total_us，时间戳的名字都认识，
+              值都在0到total_us之间，sent等于total_us
+          用法：./trace_test [-u] [-r] [-e] [-p 端口]，-u/-r/-e同服务器的选项
+          编译运行：make test
+@Author:  XiaoDexin
+@Email:   xiaodexin0701@163.com
+@Date:    2022/07/06 17:05:26
+********************************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<signal.h>
+#include<algorithm>
+#include<string>
+#include<vector>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include"../Code/Log/log.h"
+#include"../Code/Pool/threadpool.h"
+#include"../Code/Server/eventloop.h"
+#include"../Code/Server/uring_loop.h"
+#include"../Code/Trace/trace.h"
+
+static int port = 19907;
+static int passed = 0;
+static int failed = 0;
+
+//和Code/Trace/trace.cpp中的时间戳名字一致
+static const char* point_name[TP_NUM] = {"ready", "read", "dequeue", "begin", "parsed",
+                                         "handled", "built", "batch_done", "write", "sent"};
+
+static void check(bool ok, const char* name)
+{
+    if(ok){
+        passed++;
+    }else{
+        failed++;
+        printf("FAIL %s\n", name);
+    }
+}
+
+static int connect_server()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("connect");
+        exit(2);
+    }
+    struct timeval tv = {3, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+static std::string request(const std::string& url, const std::string& extra = "")
+{
+    return "GET " + url + " HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n" + extra + "\r\n";
+}
+
+//发出data，读n个响应，返回它们的状态码
+static std::vector<int> exchange(int fd, const std::string& data, size_t n)
+{
+    send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    std::string buf;
+    std::vector<int> status;
+    char tmp[65536];
+    while(status.size() < n){
+        size_t end = buf.find("\r\n\r\n");
+        if(end != std::string::npos){
+            const char* cl = strcasestr(buf.c_str(), "Content-Length:");
+            size_t len = cl && cl < buf.c_str() + end ? strtoul(cl + strlen("Content-Length:"), NULL, 10) : 0;
+            if(buf.size() >= end + 4 + len){
+                status.push_back(atoi(buf.c_str() + strlen("HTTP/1.1 ")));
+                buf.erase(0, end + 4 + len);
+                continue;
+            }
+        }
+        ssize_t got = recv(fd, tmp, sizeof(tmp), 0);
+        if(got <= 0){
+            break;
+        }
+        buf.append(tmp, got);
+    }
+    return status;
+}
+
+//检查一行记录的格式，返回它的状态码，格式不对返回-1
+static int check_line(char* line)
+{
+    int status = -1, index = -1, count = -1;
+    double total = -1, sent = -1;
+    bool has_tid = false, has_fd = false;
+    std::vector<double> points;
+    for(char* tok = strtok(line, " \n"); tok; tok = strtok(NULL, " \n")){
+        char* eq = strchr(tok, '=');
+        if(!eq || eq[1] == '\0'){
+            return -1;
+        }
+        *eq = '\0';
+        const char* value = eq + 1;
+        if(strcmp(tok, "tid") == 0){
+            has_tid = atoi(value) > 0;
+        }else if(strcmp(tok, "fd") == 0){
+            has_fd = atoi(value) >= 0;
+        }else if(strcmp(tok, "req") == 0){
+            if(sscanf(value, "%d/%d", &index, &count) != 2){
+                return -1;
+            }
+        }else if(strcmp(tok, "status") == 0){
+            status = atoi(value);
+        }else if(strcmp(tok, "total_us") == 0){
+            total = atof(value);
+        }else{
+            const char** name = std::find(point_name, point_name + TP_NUM, std::string(tok));
+            if(name == point_name + TP_NUM){
+                return -1;
+            }
+            points.push_back(atof(value));
+            if(name == point_name + TP_SENT){
+                sent = atof(value);
+            }
+        }
+    }
+    if(!has_tid || !has_fd || index < 0 || index >= count || total < 0 || sent != total || points.size() < 2){
+        return -1;
+    }
+    for(size_t i = 0; i < points.size(); i++){
+        if(points[i] < 0 || points[i] > total){
+            return -1;
+        }
+    }
+    return status;
+}
+
+int main(int argc, char* argv[])
+{
+    bool uring = false;
+    int opt;
+    while((opt = getopt(argc, argv, "urep:")) != -1){
+        switch(opt){
+            case 'u':
+                uring = true;
+                break;
+            case 'r':
+                http_conn::m_reactor_mode = true;
+                break;
+            case 'e':
+                http_conn::m_et_mode = true;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            default:
+                printf("usage: %s [-u] [-r] [-e] [-p port]\n", argv[0]);
+                return 2;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    Log::get_instance()->init(NULL, LOG_LEVEL_WARN);
+
+    //和main一样，追踪要在连接对象分配之前打开
+    char path[] = "/tmp/trace_test.XXXXXX";
+    int tmp = mkstemp(path);
+    if(tmp < 0 || !trace::get_instance()->init(path, 0)){
+        printf("追踪文件打不开\n");
+        return 2;
+    }
+    close(tmp);
+
+    pool_base<http_conn>* pool = new threadpool<http_conn>(4);
+    conn_table* users = new conn_table(MAX_FD);
+    bool started;
+    if(uring){
+        started = (new uring_loop(0, port, false, users, pool))->start();
+    }else{
+        started = (new eventloop(0, port, false, http_conn::m_et_mode, users, pool))->start();
+    }
+    if(!started){
+        printf("事件循环启动失败\n");
+        return 2;
+    }
+
+    //逐个发的请求和流水线请求，记下每个响应的状态码
+    std::vector<int> expect;
+    int fd = connect_server();
+    const char* urls[] = {"/index.html", "/nope.html", "/images/image1.jpg"};
+    for(size_t i = 0; i < sizeof(urls) / sizeof(urls[0]); i++){
+        std::vector<int> s = exchange(fd, request(urls[i]), 1);
+        expect.insert(expect.end(), s.begin(), s.end());
+    }
+    close(fd);
+    fd = connect_server();
+    std::vector<int> s = exchange(fd, request("/index.html") + request("/index.html", "Range: bytes=0-3\r\n")
+                                      + request("/nope.html") + request("/index.html"), 4);
+    expect.insert(expect.end(), s.begin(), s.end());
+    close(fd);
+    check(expect.size() == 7, "7 responses");
+
+    //客户端收到响应时服务器可能还没提交这一批的记录，等一下再停
+    usleep(100000);
+    trace::get_instance()->stop();
+
+    FILE* fp = fopen(path, "r");
+    char line[1024];
+    bool header = fp && fgets(line, sizeof(line), fp) && strncmp(line, "# trace ticks_per_us=", 21) == 0
+                  && strstr(line, "slow_us=0") != NULL;
+    check(header, "trace file header");
+    std::vector<int> got;
+    bool well_formed = true;
+    while(fp && fgets(line, sizeof(line), fp)){
+        if(line[0] == '#'){
+            continue;
+        }
+        int status = check_line(line);
+        if(status < 0){
+            well_formed = false;
+        }
+        got.push_back(status);
+    }
+    if(fp){
+        fclose(fp);
+    }
+    unlink(path);
+    check(well_formed, "every record is well formed");
+    std::sort(expect.begin(), expect.end());
+    std::sort(got.begin(), got.end());
+    check(got.size() == expect.size(), "one record per request");
+    check(got == expect, "record statuses match the responses");
+
+    printf("%d passed, %d failed\n", passed, failed);
+    Log::get_instance()->flush();
+    return failed ? 1 : 0;
+}